@@ -0,0 +1,37 @@
+#pragma once
+
+#include "filePool.h"
+#include "streamInfo.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace TracyPlayback {
+struct DiscoveryOptions {
+  // fnmatch(3) globs. Patterns without a '/' match the file name, others the
+  // path relative to the directory given. Empty includes all files.
+  std::vector<std::string> include;
+  std::vector<std::string> exclude;
+  // Scanning waits on I/O, more threads than cores pay off on network mounts
+  unsigned threads = 16;
+  // Skip captures whose first event isn't a StartEvent. Follow mode files may
+  // not have it yet.
+  bool requireStartEvent = true;
+};
+
+struct DiscoveryResult {
+  // Sorted by path, positioned past the recording header
+  std::vector<StreamInfo> streams;
+  // Files that looked like captures but could not be read
+  std::vector<std::filesystem::path> failed;
+};
+
+// Walks the directories recursively and validates the files found on a pool
+// of threads. Files other than recordings and recorder mapped buffers are
+// skipped. Files given directly are always scanned, the globs only filter
+// directory contents. Mapped buffers are recovered, see recoverMappedBuffer.
+DiscoveryResult
+discoverCaptures(std::vector<std::filesystem::path> const &roots,
+                 DiscoveryOptions const &options, FilePool &files);
+} // namespace TracyPlayback
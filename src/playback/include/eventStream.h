@@ -1,16 +1,34 @@
 #pragma once
 
+#include "eventReader.h"
+#include "fiberOrder.h"
+#include "followOptions.h"
 #include "rawEntries.h"
+#include "readAhead.h"
 
+#include <chrono>
+#include <deque>
 #include <istream>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace TracyPlayback {
 
 class EventStream {
 public:
+  enum class State {
+    Ready,    // An event is available
+    Starved,  // Follow mode only, no complete event has been written yet
+    Finished, // No more events will come
+  };
+
   using StreamInfo = std::pair<std::unique_ptr<std::istream>, std::string>;
-  EventStream(StreamInfo &&stream);
+  // Events are decoded on the read-ahead pool when one is given. Follow mode
+  // streams retry partial reads and are always decoded when polled.
+  EventStream(StreamInfo &&stream,
+              std::optional<FollowOptions> follow = std::nullopt,
+              std::shared_ptr<ReadAheadPool> const &readAhead = nullptr);
   EventStream(EventStream const &) = delete;
   EventStream &operator=(EventStream const &) = delete;
   EventStream(EventStream &&) = default;
@@ -20,7 +38,21 @@ public:
   peek() const;
   std::optional<TracyRecorder::Event<false>> pop();
 
+  // Chains a later segment of a rotated recording. Both must have had their
+  // StartEvent popped already. Segments replay in the order of their first
+  // event.
+  void addSegment(EventStream &&segment);
+
+  State state() const;
+  // Retry reading a starved stream
+  void poll();
+
   uint64_t getNanosecondsSincePosix() const;
+  uint64_t getStartPosixTime() const { return mStartPosixTime + mClockOffset; }
+
+  // Externally measured offset of the recording host's wall clock, added to
+  // every timestamp of the stream
+  void setClockOffset(int64_t offset) { mClockOffset = offset; }
 
   std::strong_ordering operator<=>(EventStream const &other) const {
     return getNanosecondsSincePosix() <=> other.getNanosecondsSincePosix();
@@ -29,11 +61,51 @@ public:
   std::string_view getStreamName() const { return mStream.second; }
 
 private:
+  void orderNextEvent();
   void queryNextEvent();
+  void followNextEvent();
+  bool nextSegment();
+  void addClockSync(uint64_t time, uint64_t unixTime);
+  uint64_t toPosixTime(uint64_t time) const;
 
   StreamInfo mStream;
+  // Decodes mStream unless reading ahead
+  std::optional<TracyRecorder::EventReader> mReader;
+  // Owns the stream instead of mStream when reading ahead
+  ReadAheadStream mReadAhead;
+  // Next event read, before FiberOrder
   std::optional<TracyRecorder::Event<false>> mLastEvent;
+  FiberOrder mFiberOrder;
+  // Next event to pop
+  std::optional<TracyRecorder::Event<false>> mNextEvent;
   uint64_t mStartPosixTime = 0;
+  int64_t mClockOffset = 0;
+
+  struct ClockSync {
+    uint64_t time;
+    uint64_t unixTime;
+  };
+  // Recent sync points ordered by recording time. Events between two points
+  // are interpolated, later ones extrapolated from the last two.
+  std::deque<ClockSync> mClockSyncs;
+
+  std::optional<FollowOptions> mFollow;
+  std::chrono::steady_clock::time_point mLastDataTime;
+  bool mFinished = false;
+
+  std::vector<EventStream> mNextSegments;
 };
 
-} // namespace TracyPlayback
\ No newline at end of file
+// A recording opened for offline processing, past its StartEvent
+struct Recording {
+  std::string host;
+  uint64_t processId;
+  EventStream events;
+};
+
+// Opens the streams and chains rotated segments of the same recording, see
+// EventStream::addSegment. Streams without a StartEvent are skipped.
+std::vector<Recording>
+openRecordings(std::vector<EventStream::StreamInfo> streams);
+
+} // namespace TracyPlayback
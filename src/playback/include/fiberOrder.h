@@ -0,0 +1,44 @@
+#pragma once
+
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace TracyPlayback {
+// Puts the events of fibers handed over between threads back in order. Each
+// thread's events are written in order, but the batch of a thread continuing
+// a fiber may be written before the one that handed it over. The enter
+// continuing a fiber waits for its handover, along with everything its
+// thread recorded after it. Other events pass straight through.
+class FiberOrder {
+public:
+  void push(TracyRecorder::Event<false> &&event);
+  std::optional<TracyRecorder::Event<false>> pop();
+
+  // At the end of the recording, releases the threads still waiting for a
+  // handover that was lost. False if none was waiting.
+  bool release();
+
+  // Moves everything pushed but not popped yet to the end of another order,
+  // each thread's events staying in order
+  void appendTo(FiberOrder &other);
+
+private:
+  void pass(TracyRecorder::Event<false> &&event);
+
+  struct Waiting {
+    uint64_t handover;
+    std::deque<TracyRecorder::Event<false>> events;
+  };
+
+  std::deque<TracyRecorder::Event<false>> mReady;
+  // By thread
+  std::unordered_map<uint64_t, Waiting> mWaiting;
+  // Handovers passed whose fiber wasn't continued yet
+  std::unordered_set<uint64_t> mHandovers;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+namespace TracyPlayback {
+// Reads many files through a bounded number of open descriptors. Files are
+// opened on their first read, the least recently read ones are closed when
+// the budget is used up and reopened when they are read again.
+class FilePool : public std::enable_shared_from_this<FilePool> {
+public:
+  // Zero uses half of the process' descriptor limit
+  static std::shared_ptr<FilePool> create(size_t maxOpenFiles = 0);
+  ~FilePool();
+
+  // The stream reads through the pool and supports seeking. Nothing is opened
+  // until it is read from.
+  std::unique_ptr<std::istream> open(std::filesystem::path path);
+
+  size_t openFiles();
+
+private:
+  explicit FilePool(size_t maxOpenFiles);
+
+  friend class PooledFileBuffer;
+  uint64_t add(std::filesystem::path path);
+  void remove(uint64_t file);
+  // Bytes read at the offset, zero at the end of the file, -1 on errors
+  int64_t read(uint64_t file, uint64_t offset, std::span<char> buffer);
+  void closeLeastRecentlyRead();
+
+  struct File {
+    std::filesystem::path path;
+    int fd = -1;
+    // Reads in flight, the descriptor can't be closed meanwhile
+    unsigned readers = 0;
+    std::list<uint64_t>::iterator recentlyRead;
+  };
+
+  size_t mMaxOpenFiles;
+  std::mutex mMutex;
+  std::unordered_map<uint64_t, File> mFiles;
+  // Open files, most recently read first
+  std::list<uint64_t> mOpenFiles;
+  uint64_t mNextFile = 0;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <chrono>
+
+namespace TracyPlayback {
+// Follow mode keeps streams open after they run dry and polls them for data
+// that is still being written. Only the segments found when a recording was
+// added are followed, segments a rotating file sink opens later are not picked
+// up.
+struct FollowOptions {
+  // Longest time the merge holds back the other streams while waiting for a
+  // stream that ran dry. Bounds how far the replay can go out of order.
+  std::chrono::milliseconds maxLatency{100};
+  std::chrono::milliseconds pollInterval{10};
+  // Streams without new data for this long are considered done. Zero keeps
+  // them open forever.
+  std::chrono::milliseconds idleTimeout{0};
+};
+} // namespace TracyPlayback
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+namespace TracyPlayback {
+// Stream buffer filled by a producer thread while the merge reads from it.
+// Reads never block, running out of data looks like a short read, which is
+// what follow mode expects. Seeking back is supported up to the last tellg()
+// so EventStream can retry partially received events.
+class LiveStreamBuffer : public std::streambuf {
+public:
+  // Producer side
+  void append(std::span<char const> data);
+  void close();
+  size_t queuedBytes();
+
+protected:
+  int_type underflow() override;
+  std::streamsize showmanyc() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+  std::mutex mMutex;
+  std::vector<char> mIncoming;
+  bool mClosed = false;
+
+  // Consumer side, mBuffer holds everything from the last tellg() on
+  std::vector<char> mBuffer;
+  uint64_t mBufferPosition = 0;
+  uint64_t mMark = 0;
+};
+
+class LiveStream : public std::istream {
+public:
+  LiveStream(std::shared_ptr<LiveStreamBuffer> buffer)
+      : std::istream(buffer.get()), mBuffer(std::move(buffer)) {}
+
+private:
+  std::shared_ptr<LiveStreamBuffer> mBuffer;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+
+namespace TracyPlayback {
+// Rebuilds a recording stream from the mapped buffer file of a recorder, see
+// TracyRecorder::setMappedBuffer. The stream holds the events that were
+// recorded but never reached the flush callback, e.g. the last ones before a
+// crash. Like the streams taken by Playback::addStream it is positioned past
+// the recording header. Returns nullptr when the file isn't a valid mapped
+// buffer.
+std::unique_ptr<std::istream> recoverMappedBuffer(std::istream &file);
+} // namespace TracyPlayback
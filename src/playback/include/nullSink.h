@@ -0,0 +1,34 @@
+#pragma once
+
+#include "processInfo.h"
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace TracyPlayback {
+// Drops everything, so playing into it measures the merge and dispatch on
+// their own. Inline so the calls compile away.
+class NullSink {
+public:
+  class Thread {
+  public:
+    Thread(NullSink &, ProcessInfo const &, uint64_t) {}
+
+    void name(std::string_view) {}
+    void zoneBegin(TracyRecorder::StartZoneEvent<false> const &, uint64_t) {}
+    void zoneEnd(uint64_t) {}
+    void zoneText(std::string_view) {}
+    void zoneValue(uint64_t) {}
+    void zoneColor(uint32_t) {}
+    void message(std::string_view, uint32_t, uint64_t) {}
+    void frameMark(TracyRecorder::FrameMarkEvent<false> const &, uint64_t) {}
+    void fiberEnter(TracyRecorder::FiberEnterEvent<false> const &, uint64_t) {}
+    void fiberLeave(uint64_t) {}
+  };
+
+  uint64_t now() const { return 0; }
+  long double nanosecondScale() const { return 1; }
+  void plot(ProcessInfo const &, std::string_view, int64_t, uint64_t) {}
+};
+} // namespace TracyPlayback
@@ -1,7 +1,16 @@
 #pragma once
 
+#include "followOptions.h"
+#include "playbackSink.h"
+#include "progressOptions.h"
+#include "readAheadOptions.h"
+
+#include <cstdint>
 #include <istream>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace TracyPlayback {
 class Playback {
@@ -9,8 +18,31 @@ public:
   Playback();
   ~Playback();
   using StreamInfo = std::pair<std::unique_ptr<std::istream>, std::string>;
+  // Keep replaying streams that are still being written. Must be called
+  // before adding streams.
+  void setFollowMode(FollowOptions const &options);
+  // Streams are decoded ahead of the merge on a pool of threads, with the
+  // default options unless changed. Pass nullopt to decode on the merge
+  // thread. Follow mode streams are never read ahead. Must be called before
+  // adding streams.
+  void setReadAhead(std::optional<ReadAheadOptions> const &options);
+  // Wall clock offset of a host measured by other means, added to all of its
+  // timestamps. Must be called before adding the host's streams.
+  void setHostClockOffset(std::string const &host, int64_t offset);
+  // Thread safe, streams added while playing join the merge in flight
   void addStream(StreamInfo &&stream);
-  void play(bool trace);
+  // Opens the streams in parallel and logs a summary instead of every stream
+  void addStreams(std::vector<StreamInfo> streams);
+  // While set, play() keeps waiting for new streams even when all current
+  // streams are done
+  void setAcceptingStreams(bool accepting);
+  // Reports statistics about the replay itself to stderr while playing
+  void play(ProgressOptions const &options = {});
+  // Replays into the sink instead of Tracy, e.g. a NullSink to measure the
+  // replay's own throughput. Defined for the sinks in tracySink.h,
+  // nullSink.h and recordingSink.h.
+  template <PlaybackSink Sink>
+  void play(Sink &sink, ProgressOptions const &options = {});
 
 private:
   struct P;
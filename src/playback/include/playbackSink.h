@@ -0,0 +1,42 @@
+#pragma once
+
+#include "processInfo.h"
+#include "rawEntries.h"
+
+#include <concepts>
+#include <cstdint>
+#include <string_view>
+
+namespace TracyPlayback {
+// Where Playback replays to, chosen at compile time so every event is a
+// direct call. The merge thread asks the sink for its clock and hands it the
+// recorder metrics, which belong to no thread. Each replayed thread gets a
+// Sink::Thread of its own, constructed, used and destroyed on the playback
+// thread replaying it, so sinks that queue per OS thread like Tracy work as
+// is. Times are in the sink's ticks, see now() and nanosecondScale().
+template <class Sink>
+concept PlaybackSink = requires(
+    Sink &sink, typename Sink::Thread &thread, ProcessInfo const &process,
+    std::string_view text, uint64_t time,
+    TracyRecorder::StartZoneEvent<false> const &zone,
+    TracyRecorder::FrameMarkEvent<false> const &frameMark,
+    TracyRecorder::FiberEnterEvent<false> const &fiber) {
+  requires std::constructible_from<typename Sink::Thread, Sink &,
+                                   ProcessInfo const &, uint64_t>;
+  // Replayed times start here and advance by this many ticks per nanosecond
+  { sink.now() } -> std::convertible_to<uint64_t>;
+  { sink.nanosecondScale() } -> std::convertible_to<long double>;
+  sink.plot(process, text, int64_t(), time);
+
+  thread.name(text);
+  thread.zoneBegin(zone, time);
+  thread.zoneEnd(time);
+  thread.zoneText(text);
+  thread.zoneValue(uint64_t());
+  thread.zoneColor(uint32_t());
+  thread.message(text, uint32_t(), time);
+  thread.frameMark(frameMark, time);
+  thread.fiberEnter(fiber, time);
+  thread.fiberLeave(time);
+};
+} // namespace TracyPlayback
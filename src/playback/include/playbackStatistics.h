@@ -0,0 +1,75 @@
+#pragma once
+
+#include "processInfo.h"
+#include "progressOptions.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace TracyPlayback {
+// Where the time of the merge loop goes
+enum class PlaybackPhase {
+  Decode,   // Taking the next event from a stream
+  Dispatch, // Waiting for a playback thread to hand the event to Tracy
+  Stall,    // Waiting for streams that ran dry or haven't started
+  Count,
+};
+
+// Runtime statistics of Playback::play, only touched by the merge thread
+class PlaybackStatistics {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class StreamState { Ready, Starved, Finished };
+
+  PlaybackStatistics(ProgressOptions const &options, std::ostream &out);
+
+  void addTime(PlaybackPhase phase, Clock::duration duration);
+  void addStall() { ++mStalls; }
+  // An event of the stream was replayed at this position of the timeline,
+  // nanoseconds since the replay origin
+  void addEvent(void const *stream, ProcessInfo const &processInfo,
+                uint64_t position);
+  void setStreamState(void const *stream, ProcessInfo const &processInfo,
+                      StreamState state);
+  void setPlaybackThreads(size_t threads) { mPlaybackThreads = threads; }
+
+  // Reports when the interval has passed, or right away when forced
+  void report(bool force = false);
+
+private:
+  struct Stream {
+    ProcessInfo processInfo;
+    uint64_t events = 0;
+    uint64_t position = 0;
+    StreamState state = StreamState::Ready;
+    // Finished streams are reported once more, then left out
+    bool reportedFinished = false;
+  };
+
+  Stream &stream(void const *stream, ProcessInfo const &processInfo);
+
+  void writeText(double eventsPerSecond);
+  void writeJson(double eventsPerSecond);
+  void plot(double eventsPerSecond);
+
+  ProgressOptions mOptions;
+  std::ostream &mOut;
+
+  Clock::time_point mStart;
+  Clock::time_point mLastReport;
+  uint64_t mEvents = 0;
+  uint64_t mEventsAtLastReport = 0;
+  Clock::duration mPhaseTime[size_t(PlaybackPhase::Count)] = {};
+  uint64_t mStalls = 0;
+  size_t mPlaybackThreads = 0;
+  // Newest position replayed, streams behind it lag
+  uint64_t mFront = 0;
+  // In the order the streams started replaying
+  std::vector<Stream> mStreams;
+  std::unordered_map<void const *, size_t> mStreamIndices;
+};
+} // namespace TracyPlayback
@@ -1,25 +1,38 @@
 #pragma once
 
+#include "playbackSink.h"
 #include "processInfo.h"
 #include "rawEntries.h"
+#include "symbolizer.h"
 
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
+#include <optional>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace TracyPlayback {
-class PlaybackThread {
+// Replays one recorded thread into the sink on a thread of its own. Defined
+// for the sinks in tracySink.h, nullSink.h and recordingSink.h.
+template <PlaybackSink Sink> class PlaybackThread {
 public:
-  PlaybackThread(ProcessInfo const &processInfo, uint64_t threadId);
+  PlaybackThread(Sink &sink, ProcessInfo const &processInfo,
+                 uint64_t threadId);
 
   void submitEvent(TracyRecorder::Event<false> event, uint64_t adjustedTime);
 
 private:
   void threadFunc(std::stop_token stopToken, ProcessInfo processInfo,
                   uint64_t threadId);
-  bool handleEvent(ProcessInfo const &processInfo,
+  void handleEvent(typename Sink::Thread &thread,
                    TracyRecorder::Event<false> const &event,
                    uint64_t adjustedTime);
+  // Symbolized stack recorded for the zone start or message being handled
+  std::optional<std::string> takeStack();
+
+  Sink &mSink;
 
   std::condition_variable_any mCondReceiveNextEvent;
   std::mutex mMutexRecieveNextEvent;
@@ -29,6 +42,35 @@ private:
   std::mutex mMutexProcessedNextEvent;
   std::uint64_t mProcessedNextEvent = 0;
 
+  // Performance counters summed up since the thread started
+  struct Counters {
+    TracyRecorder::CounterValues totals{};
+    uint8_t available = 0;
+    // Of the latest CountersEvent, which shares it with the zone event it
+    // was read for
+    uint64_t time = 0;
+  };
+  struct OpenZone {
+    std::optional<uint32_t> cpu;
+    uint64_t start;
+    std::optional<Counters> counters;
+  };
+  // The counters read for the zone event at the given time
+  std::optional<Counters> countersAt(uint64_t time) const;
+
+  // Only touched by the playback thread. The CPU and counters last recorded,
+  // and what they were when each open zone started. Zones of a fiber are
+  // followed while the fiber runs here, not across threads.
+  std::optional<uint32_t> mCpu;
+  std::optional<Counters> mCounters;
+  std::vector<OpenZone> mZones;
+  std::vector<OpenZone> mThreadZones;
+  bool mInFiber = false;
+
+  // Stacks are defined on the thread using them, before their first use
+  Symbolizer mSymbolizer;
+  std::optional<uint32_t> mStack;
+
   std::jthread mThread;
 };
 
@@ -7,5 +7,7 @@ namespace TracyPlayback {
 struct ProcessInfo {
   std::string hostName;
   uint64_t processId;
+
+  bool operator==(ProcessInfo const &) const = default;
 };
 } // namespace TracyPlayback
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+namespace TracyPlayback {
+enum class ProgressFormat {
+  Text, // Human readable lines
+  Json, // One JSON object per report and line
+};
+
+// What Playback::play reports about itself while replaying, on stderr
+struct ProgressOptions {
+  // Period of the statistics report, zero only reports once done
+  std::chrono::milliseconds interval{1000};
+  ProgressFormat format = ProgressFormat::Text;
+  // Also plot the statistics in the playback process' own Tracy capture
+  bool plots = false;
+  // Debug level, logs every replayed event. Slows playback down a lot.
+  bool logEvents = false;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "rawEntries.h"
+#include "readAheadOptions.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace TracyPlayback {
+struct ReadAheadQueue;
+class ReadAheadPool;
+
+// Consumer side of a stream decoded by a ReadAheadPool
+class ReadAheadStream {
+public:
+  ReadAheadStream() = default;
+  ReadAheadStream(ReadAheadStream const &) = delete;
+  ReadAheadStream &operator=(ReadAheadStream const &) = delete;
+  ReadAheadStream(ReadAheadStream &&) = default;
+  ReadAheadStream &operator=(ReadAheadStream &&other);
+  // Stops decoding, the pool drops the stream after its current batch
+  ~ReadAheadStream();
+
+  explicit operator bool() const { return bool(mQueue); }
+
+  // Waits for the next decoded event, nullopt once the stream is exhausted
+  std::optional<TracyRecorder::Event<false>> pop();
+
+  // A suspended stream isn't decoded further until resumed, e.g. a segment
+  // that is waiting for its turn
+  void suspend();
+  void resume();
+
+private:
+  friend class ReadAheadPool;
+  ReadAheadStream(std::shared_ptr<ReadAheadPool> pool,
+                  std::deque<std::shared_ptr<ReadAheadQueue>> parts);
+
+  void cancel();
+  void resume(std::shared_ptr<ReadAheadQueue> const &queue);
+
+  std::shared_ptr<ReadAheadPool> mPool;
+  std::shared_ptr<ReadAheadQueue> mQueue;
+  // Parts of a split stream after the current one, in order
+  std::deque<std::shared_ptr<ReadAheadQueue>> mParts;
+};
+
+// Decodes streams ahead of their consumer on a pool of threads, so reading
+// and deserializing is off the consumer's critical path. Each stream is
+// decoded by one thread at a time, in batches, so its events stay in order.
+// Large streams of blocks are split into parts that are decoded like separate
+// streams, a few parts ahead of the consumer.
+class ReadAheadPool : public std::enable_shared_from_this<ReadAheadPool> {
+public:
+  static std::shared_ptr<ReadAheadPool>
+  create(ReadAheadOptions const &options = {});
+  ~ReadAheadPool();
+
+  ReadAheadStream open(std::unique_ptr<std::istream> stream);
+
+private:
+  explicit ReadAheadPool(ReadAheadOptions const &options);
+
+  friend class ReadAheadStream;
+  // Offsets splitting the stream into parts, from its position to its size.
+  // Empty if it stays whole.
+  std::vector<uint64_t> splitOffsets(std::istream &in) const;
+  void schedule(std::shared_ptr<ReadAheadQueue> queue);
+  void decodeThreadFunc(std::stop_token stopToken);
+  void decodeBatch(std::shared_ptr<ReadAheadQueue> const &queue);
+
+  ReadAheadOptions mOptions;
+
+  std::mutex mMutexWork;
+  std::condition_variable_any mCondWork;
+  std::deque<std::shared_ptr<ReadAheadQueue>> mWork;
+
+  // Keep last, we want to finish these threads before destroying the pool
+  std::vector<std::jthread> mThreads;
+};
+} // namespace TracyPlayback
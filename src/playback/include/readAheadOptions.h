@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TracyPlayback {
+// Read-ahead decodes streams on a pool of threads ahead of the merge.
+struct ReadAheadOptions {
+  // Decoder threads shared by all streams, zero uses one per core
+  unsigned threads = 0;
+  // Decoded events buffered per stream. Decoding of a stream pauses when its
+  // queue is full and resumes once the merge took half of it.
+  size_t queuedEvents = 4096;
+  // Streams of blocks larger than this are split at block markers into parts
+  // of about this size. The parts are decoded in parallel and handed to the
+  // merge in order. Zero decodes each stream as a whole.
+  uint64_t partBytes = 64 << 20;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "processInfo.h"
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace TracyPlayback {
+// Keeps what was replayed in memory, in the order the merge dispatched it,
+// for tests asserting on the output. Times are nanoseconds since the
+// earliest stream started.
+class RecordingSink {
+public:
+  enum class Kind {
+    ThreadName,
+    ZoneBegin,
+    ZoneEnd,
+    ZoneText,
+    ZoneValue,
+    ZoneColor,
+    Message,
+    FrameMark,
+    FiberEnter,
+    FiberLeave,
+    Plot,
+  };
+
+  struct Record {
+    Kind kind;
+    ProcessInfo process;
+    // Zero for plots
+    uint64_t threadId = 0;
+    // The thread, zone, frame, fiber or plot name, zone text or message
+    std::string text;
+    // Zone value or color, message color or plotted value
+    int64_t value = 0;
+    // Zero for zone annotations and thread names
+    uint64_t time = 0;
+
+    bool operator==(Record const &) const = default;
+  };
+
+  class Thread {
+  public:
+    Thread(RecordingSink &sink, ProcessInfo const &process, uint64_t threadId)
+        : mSink(sink), mProcess(process), mThreadId(threadId) {}
+
+    void name(std::string_view name);
+    void zoneBegin(TracyRecorder::StartZoneEvent<false> const &zone,
+                   uint64_t time);
+    void zoneEnd(uint64_t time);
+    void zoneText(std::string_view text);
+    void zoneValue(uint64_t value);
+    void zoneColor(uint32_t color);
+    void message(std::string_view message, uint32_t color, uint64_t time);
+    void frameMark(TracyRecorder::FrameMarkEvent<false> const &frameMark,
+                   uint64_t time);
+    void fiberEnter(TracyRecorder::FiberEnterEvent<false> const &fiber,
+                    uint64_t time);
+    void fiberLeave(uint64_t time);
+
+  private:
+    void add(Kind kind, std::string_view text = {}, int64_t value = 0,
+             uint64_t time = 0);
+
+    RecordingSink &mSink;
+    ProcessInfo mProcess;
+    uint64_t mThreadId;
+  };
+
+  uint64_t now() const { return 0; }
+  long double nanosecondScale() const { return 1; }
+  void plot(ProcessInfo const &process, std::string_view name, int64_t value,
+            uint64_t time);
+
+  std::vector<Record> records() const;
+
+private:
+  void add(Record record);
+
+  mutable std::mutex mMutex;
+  std::vector<Record> mRecords;
+};
+} // namespace TracyPlayback
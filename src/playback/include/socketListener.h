@@ -0,0 +1,50 @@
+#pragma once
+
+#include "liveStreamBuffer.h"
+#include "playback.h"
+
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace TracyPlayback {
+// Accepts recorder connections (see TracyRecorder::makeSocketSink) and feeds
+// each one to the playback as its own stream. A single thread services all
+// connections with poll(), so a slow producer never holds up the others.
+// Pair with Playback::setAcceptingStreams so play() waits for producers that
+// haven't connected yet.
+class SocketListener {
+public:
+  // Throws std::runtime_error when the address can't be listened on
+  SocketListener(Playback &playback, std::string_view address);
+  ~SocketListener();
+  SocketListener(SocketListener const &) = delete;
+  SocketListener &operator=(SocketListener const &) = delete;
+
+  // Stops accepting, already connected producers are closed as well
+  void stop();
+
+private:
+  struct Connection {
+    int socket;
+    std::string name;
+    std::string header;
+    std::shared_ptr<LiveStreamBuffer> buffer;
+  };
+
+  void ioThreadFunc(std::stop_token stopToken);
+  void accept();
+  bool receive(Connection &connection);
+
+  Playback &mPlayback;
+  std::string mAddress;
+  std::string mUnixPath;
+  int mSocket = -1;
+  uint64_t mConnectionCount = 0;
+  std::vector<Connection> mConnections;
+
+  // Keep last, we want to finish this thread before destroying the main object
+  std::jthread mIoThread;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace TracyPlayback {
+// A recording stream positioned past its header, and a name for it
+using StreamInfo = std::pair<std::unique_ptr<std::istream>, std::string>;
+} // namespace TracyPlayback
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+namespace TracyPlayback {
+// Tracy keeps raw pointers to frame names for the whole session, so those
+// strings must never move or be released once handed over.
+class StringPool {
+public:
+  char const *intern(std::string_view string);
+
+private:
+  std::mutex mMutex;
+  std::unordered_set<std::string> mStrings;
+};
+} // namespace TracyPlayback
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace TracyPlayback {
+// Resolves the recorded stacks of one thread or recording to function names.
+// Symbols are read from the files at the recorded module paths, so the
+// binaries must still be around and unchanged. Frames that can't be resolved
+// show as an offset into their module, or as the bare address.
+class Symbolizer {
+public:
+  void addModule(TracyRecorder::ModuleEvent<false> const &module);
+  void addStack(TracyRecorder::StackFramesEvent<false> const &stack);
+
+  // Innermost first, empty for stacks never defined. Resolved on first use.
+  std::vector<std::string> const &frames(uint32_t stackId);
+
+  std::string symbolize(uint64_t address) const;
+
+private:
+  std::vector<TracyRecorder::ModuleEvent<false>> mModules;
+  std::unordered_map<uint32_t, std::vector<uint64_t>> mStacks;
+  std::unordered_map<uint32_t, std::vector<std::string>> mResolved;
+};
+} // namespace TracyPlayback
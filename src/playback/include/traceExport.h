@@ -0,0 +1,37 @@
+#pragma once
+
+#include "streamInfo.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace TracyPlayback {
+enum class ExportFormat {
+  ChromeJson, // Chrome trace event format, JSON object with traceEvents
+  Perfetto,   // Perfetto TracePacket protobuf stream
+};
+
+struct ExportOptions {
+  ExportFormat format = ExportFormat::ChromeJson;
+  // Time window in nanoseconds since the Unix epoch. Zones starting before it
+  // are left out, zones still open at its end are closed there.
+  uint64_t beginTime = 0;
+  uint64_t endTime = std::numeric_limits<uint64_t>::max();
+  // Recordings encoded in parallel, zero uses one thread per core
+  unsigned threads = 0;
+  // Encoded output is handed to the writer in chunks of about this size.
+  // Encoders wait while this much is queued, which bounds memory use.
+  size_t chunkBytes = 1024 * 1024;
+  size_t maxQueuedBytes = 64 * 1024 * 1024;
+};
+
+// Converts recordings to a format other trace viewers understand. Events are
+// streamed, each recording is encoded on its own worker and never held in
+// memory as a whole. Both formats allow recordings to interleave in the
+// output, the viewers sort events on load.
+void exportTrace(std::vector<StreamInfo> streams, std::ostream &out,
+                 ExportOptions const &options);
+} // namespace TracyPlayback
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "streamInfo.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace TracyPlayback {
+struct ReduceOptions {
+  // Zones shorter than this many nanoseconds are dropped along with
+  // everything recorded inside them. Back to back short zones of the same
+  // callsite become one summary zone, its value is the number of zones.
+  uint64_t minDuration = 0;
+  // Zones nested deeper than this are dropped, zero keeps all levels
+  unsigned maxDepth = 0;
+  // Time window in nanoseconds since the Unix epoch. Zones overlapping it
+  // are kept and run to their recorded start and end, along with what they
+  // contain inside the window. Zones entirely outside of it are dropped.
+  uint64_t beginTime = 0;
+  uint64_t endTime = std::numeric_limits<uint64_t>::max();
+  // Streams reduced in parallel, zero uses one thread per core
+  unsigned threads = 0;
+  // A zone not known to be kept yet holds back the events inside it. Past
+  // this many it is kept anyway, which bounds memory use.
+  size_t maxPendingEvents = 4096;
+};
+
+struct ReduceResult {
+  uint64_t eventsRead = 0;
+  uint64_t eventsWritten = 0;
+  uint64_t zonesDropped = 0;
+  // Zones replaced by summary zones, and the summaries written for them
+  uint64_t zonesSummarized = 0;
+  uint64_t summaries = 0;
+  // Outputs that could not be written
+  std::vector<std::filesystem::path> failed;
+
+  ReduceResult &operator+=(ReduceResult const &other);
+};
+
+// Writes a smaller recording that plays back like the original at a lower
+// level of detail. The input is positioned past its header, the output gets
+// one. Events are streamed, memory use doesn't grow with the recording.
+ReduceResult reduceTrace(std::istream &in, std::ostream &out,
+                         ReduceOptions const &options);
+
+// Reduces each stream into a file of the same name in the output directory.
+// Rotated segments are reduced on their own and chain up again in playback.
+ReduceResult reduceTraces(std::vector<StreamInfo> streams,
+                          std::filesystem::path const &outputDirectory,
+                          ReduceOptions const &options);
+} // namespace TracyPlayback
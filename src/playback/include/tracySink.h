@@ -0,0 +1,48 @@
+#pragma once
+
+#include "processInfo.h"
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace TracyPlayback {
+// Replays into the Tracy client linked into this process, which streams it
+// to a connected Tracy server. Threads are named after their host, process
+// and recorded thread ID unless the recording named them.
+class TracySink {
+public:
+  class Thread {
+  public:
+    Thread(TracySink &sink, ProcessInfo const &process, uint64_t threadId);
+    ~Thread();
+    Thread(Thread const &) = delete;
+    Thread &operator=(Thread const &) = delete;
+
+    void name(std::string_view name);
+    void zoneBegin(TracyRecorder::StartZoneEvent<false> const &zone,
+                   uint64_t time);
+    void zoneEnd(uint64_t time);
+    void zoneText(std::string_view text);
+    void zoneValue(uint64_t value);
+    void zoneColor(uint32_t color);
+    void message(std::string_view message, uint32_t color, uint64_t time);
+    void frameMark(TracyRecorder::FrameMarkEvent<false> const &frameMark,
+                   uint64_t time);
+    void fiberEnter(TracyRecorder::FiberEnterEvent<false> const &fiber,
+                    uint64_t time);
+    void fiberLeave(uint64_t time);
+
+  private:
+    ProcessInfo mProcess;
+    uint64_t mThreadId;
+    bool mNamed = false;
+  };
+
+  uint64_t now() const;
+  // Measured once per process, takes a second
+  long double nanosecondScale() const;
+  void plot(ProcessInfo const &process, std::string_view name, int64_t value,
+            uint64_t time);
+};
+} // namespace TracyPlayback
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "streamInfo.h"
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace TracyPlayback {
+// Durations of one call site, in nanoseconds. Percentiles come from a
+// log-linear histogram and are accurate to about 3%.
+struct ZoneStatistics {
+  std::string name;
+  std::string function;
+  std::string file;
+  uint32_t line = 0;
+
+  uint64_t count = 0;
+  uint64_t totalTime = 0;
+  // Total time minus the time spent in child zones
+  uint64_t selfTime = 0;
+  uint64_t p50 = 0;
+  uint64_t p99 = 0;
+  uint64_t maxTime = 0;
+  // Zones that ended on another CPU than they started on, only known for
+  // recordings with CPU tracking on
+  uint64_t migrations = 0;
+  // Zones measured with performance counters on, their total time, and the
+  // counters summed over them with child zones included. Counters no
+  // recording thread could open are unset.
+  uint64_t countedZones = 0;
+  uint64_t countedTime = 0;
+  std::optional<uint64_t> instructions;
+  std::optional<uint64_t> cycles;
+  std::optional<uint64_t> cacheMisses;
+  std::optional<uint64_t> contextSwitches;
+  std::optional<uint64_t> taskClockTime;
+
+  uint64_t meanTime() const { return count ? totalTime / count : 0; }
+};
+
+// Pairs zone starts and ends per thread and aggregates them per call site,
+// without replaying anything to Tracy. Rotated segments of a recording are
+// chained, recordings are analysed in parallel on up to `threads` threads,
+// zero uses one per core. Sorted by total time, longest first. Zones still
+// open at the end of a stream are left out.
+std::vector<ZoneStatistics>
+computeZoneStatistics(std::vector<StreamInfo> streams, unsigned threads = 0);
+
+void writeZoneStatisticsText(std::ostream &out,
+                             std::vector<ZoneStatistics> const &statistics);
+void writeZoneStatisticsCsv(std::ostream &out,
+                            std::vector<ZoneStatistics> const &statistics);
+} // namespace TracyPlayback
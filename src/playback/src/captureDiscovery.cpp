@@ -0,0 +1,197 @@
+#include "captureDiscovery.h"
+
+#include "mappedRecovery.h"
+#include "rawEntries.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fnmatch.h>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace TracyPlayback {
+namespace {
+bool matchesAny(std::vector<std::string> const &patterns,
+                std::filesystem::path const &relative) {
+  auto path = relative.generic_string();
+  auto name = relative.filename().string();
+  return std::any_of(patterns.begin(), patterns.end(), [&](auto &pattern) {
+    bool matchPath = pattern.find('/') != std::string::npos;
+    return fnmatch(pattern.c_str(), (matchPath ? path : name).c_str(),
+                   matchPath ? FNM_PATHNAME : 0) == 0;
+  });
+}
+
+enum class Scanned { Capture, Skipped, Failed };
+
+Scanned scanFile(FilePool &files, std::filesystem::path const &path,
+                 bool requireStartEvent, std::optional<StreamInfo> &capture) {
+  auto stream = files.open(path);
+  char magic[12] = {0};
+  if (!stream->read(magic, sizeof(magic))) {
+    return Scanned::Skipped;
+  }
+  std::string_view header(magic, sizeof(magic));
+  // Mapped buffers left behind by a recorder hold its unflushed events
+  if (header == std::string_view("TRCYMMAP\1\0\0\0", 12)) {
+    stream = recoverMappedBuffer(*stream);
+    if (!stream) {
+      return Scanned::Failed;
+    }
+  } else if (header != std::string_view("TRCYPLAY\1\0\0\0", 12)) {
+    return Scanned::Skipped;
+  }
+
+  if (requireStartEvent) {
+    auto position = stream->tellg();
+    auto start = TracyRecorder::Event<false>::deserialize(*stream);
+    if (!start || start->type() != TracyRecorder::EventType::Start) {
+      return Scanned::Failed;
+    }
+    stream->clear();
+    stream->seekg(position);
+  }
+  capture.emplace(std::move(stream), path.string());
+  return Scanned::Capture;
+}
+
+// Directories and files waiting to be scanned, shared by the workers
+class ScanQueue {
+public:
+  struct Item {
+    std::filesystem::path path;
+    std::filesystem::path root;
+    bool directory;
+  };
+
+  void push(Item item) {
+    std::scoped_lock lock(mMutex);
+    mItems.push_back(std::move(item));
+    mCond.notify_one();
+  }
+
+  // Waits until there is work, nullopt once all is done
+  std::optional<Item> pop() {
+    std::unique_lock lock(mMutex);
+    mCond.wait(lock, [this] { return !mItems.empty() || mBusy == 0; });
+    if (mItems.empty()) {
+      return std::nullopt;
+    }
+    ++mBusy;
+    auto item = std::move(mItems.front());
+    mItems.pop_front();
+    return item;
+  }
+
+  void done() {
+    std::scoped_lock lock(mMutex);
+    if (--mBusy == 0 && mItems.empty()) {
+      mCond.notify_all();
+    }
+  }
+
+private:
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  std::deque<Item> mItems;
+  // Workers handling an item, they may still add more
+  unsigned mBusy = 0;
+};
+} // namespace
+
+DiscoveryResult
+discoverCaptures(std::vector<std::filesystem::path> const &roots,
+                 DiscoveryOptions const &options, FilePool &files) {
+  DiscoveryResult result;
+  ScanQueue queue;
+  for (auto &root : roots) {
+    if (!std::filesystem::exists(root)) {
+      result.failed.push_back(root);
+      continue;
+    }
+    queue.push({root, root, std::filesystem::is_directory(root)});
+  }
+
+  std::mutex mutexResult;
+  std::vector<std::pair<std::filesystem::path, StreamInfo>> captures;
+
+  auto scanItem = [&](ScanQueue::Item const &item) {
+    if (item.directory) {
+      // An entry that can't be inspected only fails itself
+      auto entryFailed = [&](std::filesystem::path const &path) {
+        std::scoped_lock lock(mutexResult);
+        result.failed.push_back(path);
+      };
+      std::error_code error;
+      std::filesystem::directory_iterator entries(item.path, error);
+      for (; !error && entries != std::filesystem::directory_iterator();
+           entries.increment(error)) {
+        auto &entry = *entries;
+        std::error_code entryError;
+        // Symlinked directories may form cycles, only real ones are walked
+        auto symlink = entry.is_symlink(entryError);
+        auto directory = !entryError && entry.is_directory(entryError);
+        // A dangling symlink is not an error, it is just not a capture
+        if (entryError == std::errc::no_such_file_or_directory) {
+          continue;
+        }
+        if (entryError) {
+          entryFailed(entry.path());
+          continue;
+        }
+        if (directory) {
+          if (!symlink) {
+            queue.push({entry.path(), item.root, true});
+          }
+          continue;
+        }
+        auto relative = entry.path().lexically_relative(item.root);
+        if (!entry.is_regular_file(entryError) ||
+            (!options.include.empty() &&
+             !matchesAny(options.include, relative)) ||
+            matchesAny(options.exclude, relative)) {
+          continue;
+        }
+        queue.push({entry.path(), item.root, false});
+      }
+      if (error) {
+        entryFailed(item.path);
+      }
+      return;
+    }
+
+    std::optional<StreamInfo> capture;
+    auto scanned =
+        scanFile(files, item.path, options.requireStartEvent, capture);
+    std::scoped_lock lock(mutexResult);
+    if (scanned == Scanned::Capture) {
+      captures.emplace_back(item.path, std::move(*capture));
+    } else if (scanned == Scanned::Failed) {
+      result.failed.push_back(item.path);
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < std::max(options.threads, 1u); ++i) {
+      workers.emplace_back([&] {
+        while (auto item = queue.pop()) {
+          scanItem(*item);
+          queue.done();
+        }
+      });
+    }
+  }
+
+  // The scan order depends on timing, keep the result reproducible
+  std::sort(captures.begin(), captures.end(),
+            [](auto &a, auto &b) { return a.first < b.first; });
+  for (auto &[path, stream] : captures) {
+    result.streams.push_back(std::move(stream));
+  }
+  std::sort(result.failed.begin(), result.failed.end());
+  return result;
+}
+} // namespace TracyPlayback
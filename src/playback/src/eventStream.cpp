@@ -2,58 +2,265 @@
 
 #include "utilities.h"
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+namespace {
+// Batches are flushed in order, so only events of the last few batches can
+// still be older than the newest sync point
+constexpr size_t maxClockSyncs = 64;
+} // namespace
+
 namespace TracyPlayback {
 
-EventStream::EventStream(StreamInfo &&stream) : mStream(std::move(stream)) {
-  queryNextEvent();
+EventStream::EventStream(StreamInfo &&stream,
+                         std::optional<FollowOptions> follow,
+                         std::shared_ptr<ReadAheadPool> const &readAhead)
+    : mStream(std::move(stream)), mFollow(follow),
+      mLastDataTime(std::chrono::steady_clock::now()) {
+  if (readAhead && !mFollow) {
+    mReadAhead = readAhead->open(std::move(mStream.first));
+  } else if (mStream.first) {
+    mReader.emplace(*mStream.first);
+  }
+  orderNextEvent();
 }
 
 std::optional<std::reference_wrapper<TracyRecorder::Event<false> const>>
 EventStream::peek() const {
-  if (mLastEvent) {
-    return std::ref(*mLastEvent);
+  if (mNextEvent) {
+    return std::ref(*mNextEvent);
   }
   return std::nullopt;
 }
 
 std::optional<TracyRecorder::Event<false>> EventStream::pop() {
-  queryNextEvent();
+  orderNextEvent();
 
-  if (mLastEvent) {
-    auto event = std::move(mLastEvent);
-    mLastEvent.reset();
-    queryNextEvent();
+  if (mNextEvent) {
+    auto event = std::move(mNextEvent);
+    mNextEvent.reset();
+    orderNextEvent();
     return event;
   } else {
-    queryNextEvent();
+    orderNextEvent();
     return std::nullopt;
   }
 }
 
+void EventStream::addSegment(EventStream &&segment) {
+  for (auto &sync : segment.mClockSyncs) {
+    addClockSync(sync.time, sync.unixTime);
+  }
+  segment.mClockSyncs.clear();
+  mNextSegments.push_back(std::move(segment));
+
+  // Segments may be found in any order, make sure the earliest one is current
+  auto earliest = std::min_element(mNextSegments.begin(), mNextSegments.end());
+  if (*earliest < *this) {
+    std::swap(mStream, earliest->mStream);
+    std::swap(mReader, earliest->mReader);
+    std::swap(mReadAhead, earliest->mReadAhead);
+    std::swap(mLastEvent, earliest->mLastEvent);
+    std::swap(mFiberOrder, earliest->mFiberOrder);
+    std::swap(mNextEvent, earliest->mNextEvent);
+    std::swap(mFinished, earliest->mFinished);
+  }
+  std::sort(mNextSegments.begin(), mNextSegments.end());
+
+  // Only the current segment is read ahead, there may be thousands waiting
+  for (auto &next : mNextSegments) {
+    next.mReadAhead.suspend();
+  }
+  mReadAhead.resume();
+}
+
+bool EventStream::nextSegment() {
+  // A follow mode segment is complete as soon as the writer moved on
+  if (mLastEvent || mNextSegments.empty() || (!mFinished && !mFollow)) {
+    return false;
+  }
+  auto &next = mNextSegments.front();
+  mStream = std::move(next.mStream);
+  mReader = std::move(next.mReader);
+  mReadAhead = std::move(next.mReadAhead);
+  mReadAhead.resume();
+  mLastEvent = std::move(next.mLastEvent);
+  // The segment ordered its first events on its own, a fiber may continue
+  // there that was handed over here
+  if (next.mNextEvent) {
+    mFiberOrder.push(std::move(*next.mNextEvent));
+  }
+  next.mFiberOrder.appendTo(mFiberOrder);
+  mFinished = next.mFinished;
+  mLastDataTime = std::chrono::steady_clock::now();
+  mNextSegments.erase(mNextSegments.begin());
+  return true;
+}
+
+EventStream::State EventStream::state() const {
+  if (mNextEvent) {
+    return State::Ready;
+  }
+  return mFinished ? State::Finished : State::Starved;
+}
+
+void EventStream::poll() { orderNextEvent(); }
+
 uint64_t EventStream::getNanosecondsSincePosix() const {
-  if (mLastEvent) {
-    auto &event = *mLastEvent;
+  if (mNextEvent) {
+    auto &event = *mNextEvent;
     return std::visit(
-        overloads{[](TracyRecorder::StartEvent<false> const &event) {
-                    return event.unixTime;
+        overloads{[this](TracyRecorder::StartEvent<false> const &event) {
+                    return event.unixTime + mClockOffset;
                   },
-                  [this](auto &event) { return event.time + mStartPosixTime; }},
+                  [this](auto &event) { return toPosixTime(event.time); }},
         event.event);
   }
-  return mStartPosixTime;
+  return getStartPosixTime();
+}
+
+void EventStream::addClockSync(uint64_t time, uint64_t unixTime) {
+  auto position = std::upper_bound(
+      mClockSyncs.begin(), mClockSyncs.end(), time,
+      [](uint64_t time, ClockSync const &sync) { return time < sync.time; });
+  if (position != mClockSyncs.begin() && (position - 1)->time == time) {
+    return;
+  }
+  mClockSyncs.insert(position, ClockSync{time, unixTime});
+  if (mClockSyncs.size() > maxClockSyncs) {
+    mClockSyncs.pop_front();
+  }
+}
+
+uint64_t EventStream::toPosixTime(uint64_t time) const {
+  if (mClockSyncs.size() < 2) {
+    return mStartPosixTime + mClockOffset + time;
+  }
+
+  // Pick the segment around the event, or the closest one at either end
+  auto after = std::upper_bound(
+      mClockSyncs.begin() + 1, mClockSyncs.end() - 1, time,
+      [](uint64_t time, ClockSync const &sync) { return time < sync.time; });
+  auto &from = *(after - 1);
+  auto &to = *after;
+
+  // A wall clock step can make the rate nonsensical, keep time moving forward
+  double rate = 1.0;
+  if (to.time > from.time) {
+    rate = std::clamp(double(int64_t(to.unixTime - from.unixTime)) /
+                          double(to.time - from.time),
+                      0.5, 2.0);
+  }
+  auto elapsed = int64_t(time - from.time);
+  return from.unixTime + mClockOffset + int64_t(std::llround(elapsed * rate));
+}
+
+void EventStream::orderNextEvent() {
+  while (!mNextEvent) {
+    mNextEvent = mFiberOrder.pop();
+    if (mNextEvent) {
+      return;
+    }
+    queryNextEvent();
+    if (mLastEvent) {
+      mFiberOrder.push(std::move(*mLastEvent));
+      mLastEvent.reset();
+    } else if (!mFinished || !mFiberOrder.release()) {
+      return;
+    }
+  }
 }
 
 void EventStream::queryNextEvent() {
-  if (!mLastEvent && *mStream.first) {
-    mLastEvent = TracyRecorder::Event<false>::deserialize(*mStream.first);
+  if (!mLastEvent && !mFinished) {
+    if (mFollow) {
+      followNextEvent();
+    } else if (mReadAhead) {
+      mLastEvent = mReadAhead.pop();
+      mFinished = !mLastEvent;
+    } else if (mReader) {
+      // A torn tail ends the stream, damaged blocks in between are skipped
+      mLastEvent = mReader->next();
+      mFinished = !mLastEvent;
+    } else {
+      mFinished = true;
+    }
+  }
+  if (nextSegment()) {
+    queryNextEvent();
+    return;
   }
   if (mLastEvent) {
     auto &event = *mLastEvent;
     if (auto startEvent =
             std::get_if<TracyRecorder::StartEvent<false>>(&event.event)) {
       mStartPosixTime = startEvent->unixTime;
+      if (mClockSyncs.empty()) {
+        // The recording clock starts at zero when the start time is taken
+        addClockSync(0, startEvent->unixTime);
+      }
+    } else if (auto clockSync =
+                   std::get_if<TracyRecorder::ClockSyncEvent<false>>(
+                       &event.event)) {
+      // Sync points only correct the timeline, they are not played back
+      addClockSync(clockSync->time, clockSync->unixTime);
+      mLastEvent.reset();
+      queryNextEvent();
     }
   }
 }
 
+std::vector<Recording>
+openRecordings(std::vector<EventStream::StreamInfo> streams) {
+  std::map<std::tuple<std::string, uint64_t, uint64_t>, Recording> recordings;
+  for (auto &stream : streams) {
+    EventStream events{std::move(stream)};
+    auto start = events.pop();
+    auto startEvent =
+        start ? std::get_if<TracyRecorder::StartEvent<false>>(&start->event)
+              : nullptr;
+    if (!startEvent) {
+      continue;
+    }
+    std::tuple key{startEvent->host, startEvent->processId,
+                   startEvent->unixTime};
+    if (auto it = recordings.find(key); it != recordings.end()) {
+      it->second.events.addSegment(std::move(events));
+    } else {
+      recordings.emplace(std::move(key),
+                         Recording{std::move(startEvent->host),
+                                   startEvent->processId, std::move(events)});
+    }
+  }
+
+  std::vector<Recording> result;
+  for (auto &[key, recording] : recordings) {
+    result.push_back(std::move(recording));
+  }
+  return result;
+}
+
+void EventStream::followNextEvent() {
+  // An incomplete event or block only means the writer hasn't finished it
+  // yet. The reader leaves it unread, it is tried again on the next poll.
+  mLastEvent = mReader->next();
+  auto now = std::chrono::steady_clock::now();
+  if (mLastEvent) {
+    mLastDataTime = now;
+    return;
+  }
+
+  auto &stream = *mStream.first;
+  // in_avail() is -1 only when the source knows no more data will come, like
+  // a closed connection. Plain files never report that.
+  if (!stream || stream.rdbuf()->in_avail() == -1 ||
+      (mFollow->idleTimeout.count() > 0 &&
+       now - mLastDataTime > mFollow->idleTimeout)) {
+    mFinished = true;
+  }
+}
+
 } // namespace TracyPlayback
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "fiberOrder.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace TracyPlayback {
+namespace {
+std::optional<uint64_t> threadOf(TracyRecorder::Event<false> const &event) {
+  return std::visit(
+      [](auto const &e) -> std::optional<uint64_t> {
+        if constexpr (requires { e.threadId; }) {
+          return e.threadId;
+        } else {
+          return std::nullopt;
+        }
+      },
+      event.event);
+}
+
+uint64_t handoverOf(TracyRecorder::Event<false> const &event) {
+  if (auto enter =
+          std::get_if<TracyRecorder::FiberEnterEvent<false>>(&event.event)) {
+    return enter->handover;
+  }
+  if (auto leave =
+          std::get_if<TracyRecorder::FiberLeaveEvent<false>>(&event.event)) {
+    return leave->handover;
+  }
+  return 0;
+}
+} // namespace
+
+void FiberOrder::push(TracyRecorder::Event<false> &&event) {
+  auto threadId = threadOf(event);
+  if (threadId) {
+    if (auto waiting = mWaiting.find(*threadId); waiting != mWaiting.end()) {
+      waiting->second.events.push_back(std::move(event));
+      return;
+    }
+    auto enter =
+        std::get_if<TracyRecorder::FiberEnterEvent<false>>(&event.event);
+    if (enter && enter->continues != 0 &&
+        !mHandovers.contains(enter->continues)) {
+      auto &waiting = mWaiting[*threadId];
+      waiting.handover = enter->continues;
+      waiting.events.push_back(std::move(event));
+      return;
+    }
+  }
+  pass(std::move(event));
+}
+
+void FiberOrder::pass(TracyRecorder::Event<false> &&event) {
+  if (auto enter =
+          std::get_if<TracyRecorder::FiberEnterEvent<false>>(&event.event)) {
+    mHandovers.erase(enter->continues);
+  }
+  auto handover = handoverOf(event);
+  mReady.push_back(std::move(event));
+  if (handover == 0) {
+    return;
+  }
+  mHandovers.insert(handover);
+
+  // The thread continuing the fiber goes on, until it waits again
+  auto waiting = std::ranges::find_if(mWaiting, [handover](auto const &entry) {
+    return entry.second.handover == handover;
+  });
+  if (waiting != mWaiting.end()) {
+    auto events = std::move(waiting->second.events);
+    mWaiting.erase(waiting);
+    for (auto &event : events) {
+      push(std::move(event));
+    }
+  }
+}
+
+std::optional<TracyRecorder::Event<false>> FiberOrder::pop() {
+  if (mReady.empty()) {
+    return std::nullopt;
+  }
+  auto event = std::move(mReady.front());
+  mReady.pop_front();
+  return event;
+}
+
+bool FiberOrder::release() {
+  if (mWaiting.empty()) {
+    return false;
+  }
+  // Without their handover, the fibers' zones end up unbalanced
+  for (auto &[threadId, waiting] : mWaiting) {
+    std::ranges::move(waiting.events, std::back_inserter(mReady));
+  }
+  mWaiting.clear();
+  return true;
+}
+
+void FiberOrder::appendTo(FiberOrder &other) {
+  // A thread's passed events precede the ones it waits with
+  std::vector<TracyRecorder::Event<false>> events;
+  std::ranges::move(mReady, std::back_inserter(events));
+  for (auto &[threadId, waiting] : mWaiting) {
+    std::ranges::move(waiting.events, std::back_inserter(events));
+  }
+  mReady.clear();
+  mWaiting.clear();
+  mHandovers.clear();
+  for (auto &event : events) {
+    other.push(std::move(event));
+  }
+}
+} // namespace TracyPlayback
@@ -0,0 +1,186 @@
+#include "filePool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <streambuf>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+namespace TracyPlayback {
+namespace {
+// The first read only needs the header and the first events, files that are
+// actually replayed are read in larger chunks
+constexpr size_t firstReadBytes = 4 * 1024;
+constexpr size_t readBytes = 64 * 1024;
+
+size_t defaultMaxOpenFiles() {
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return 512;
+  }
+  return std::max<size_t>(limit.rlim_cur / 2, 1);
+}
+} // namespace
+
+class PooledFileBuffer : public std::streambuf {
+public:
+  PooledFileBuffer(std::shared_ptr<FilePool> pool, uint64_t file)
+      : mPool(std::move(pool)), mFile(file) {}
+  ~PooledFileBuffer() override { mPool->remove(mFile); }
+
+protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    mBufferOffset += egptr() - eback();
+    mBuffer.resize(mBuffer.empty() ? firstReadBytes : readBytes);
+    auto bytes = mPool->read(mFile, mBufferOffset, mBuffer);
+    if (bytes <= 0) {
+      setg(mBuffer.data(), mBuffer.data(), mBuffer.data());
+      return traits_type::eof();
+    }
+    setg(mBuffer.data(), mBuffer.data(), mBuffer.data() + bytes);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode which) override {
+    if (direction == std::ios_base::cur) {
+      offset += mBufferOffset + (gptr() - eback());
+    } else if (direction != std::ios_base::beg) {
+      return pos_type(off_type(-1));
+    }
+    return seekpos(offset, which);
+  }
+
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override {
+    off_type target = position;
+    if (!(which & std::ios_base::in) || target < 0) {
+      return pos_type(off_type(-1));
+    }
+    // Stay in the buffer when possible, otherwise read from there next time
+    if (uint64_t(target) >= mBufferOffset &&
+        uint64_t(target) <= mBufferOffset + (egptr() - eback())) {
+      setg(eback(), eback() + (target - mBufferOffset), egptr());
+    } else {
+      mBufferOffset = target;
+      setg(mBuffer.data(), mBuffer.data(), mBuffer.data());
+    }
+    return position;
+  }
+
+private:
+  std::shared_ptr<FilePool> mPool;
+  uint64_t mFile;
+  std::vector<char> mBuffer;
+  // File offset of the start of the buffer
+  uint64_t mBufferOffset = 0;
+};
+
+namespace {
+class PooledFileStream : public std::istream {
+public:
+  PooledFileStream(std::unique_ptr<PooledFileBuffer> buffer)
+      : std::istream(buffer.get()), mBuffer(std::move(buffer)) {}
+
+private:
+  std::unique_ptr<PooledFileBuffer> mBuffer;
+};
+} // namespace
+
+std::shared_ptr<FilePool> FilePool::create(size_t maxOpenFiles) {
+  return std::shared_ptr<FilePool>(
+      new FilePool(maxOpenFiles ? maxOpenFiles : defaultMaxOpenFiles()));
+}
+
+FilePool::FilePool(size_t maxOpenFiles) : mMaxOpenFiles(maxOpenFiles) {}
+
+FilePool::~FilePool() {
+  for (auto &[id, file] : mFiles) {
+    if (file.fd >= 0) {
+      ::close(file.fd);
+    }
+  }
+}
+
+std::unique_ptr<std::istream> FilePool::open(std::filesystem::path path) {
+  auto file = add(std::move(path));
+  return std::make_unique<PooledFileStream>(
+      std::make_unique<PooledFileBuffer>(shared_from_this(), file));
+}
+
+size_t FilePool::openFiles() {
+  std::scoped_lock lock(mMutex);
+  return mOpenFiles.size();
+}
+
+uint64_t FilePool::add(std::filesystem::path path) {
+  std::scoped_lock lock(mMutex);
+  auto id = mNextFile++;
+  mFiles[id].path = std::move(path);
+  return id;
+}
+
+void FilePool::remove(uint64_t id) {
+  std::scoped_lock lock(mMutex);
+  auto it = mFiles.find(id);
+  if (it == mFiles.end()) {
+    return;
+  }
+  if (it->second.fd >= 0) {
+    ::close(it->second.fd);
+    mOpenFiles.erase(it->second.recentlyRead);
+  }
+  mFiles.erase(it);
+}
+
+int64_t FilePool::read(uint64_t id, uint64_t offset, std::span<char> buffer) {
+  int fd = -1;
+  {
+    std::scoped_lock lock(mMutex);
+    auto &file = mFiles.at(id);
+    if (file.fd < 0) {
+      closeLeastRecentlyRead();
+      file.fd = ::open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (file.fd < 0) {
+        return -1;
+      }
+      mOpenFiles.push_front(id);
+      file.recentlyRead = mOpenFiles.begin();
+    } else {
+      mOpenFiles.splice(mOpenFiles.begin(), mOpenFiles, file.recentlyRead);
+    }
+    ++file.readers;
+    fd = file.fd;
+  }
+
+  // Streams read independently, only the bookkeeping is serialized
+  ssize_t bytes;
+  do {
+    bytes = ::pread(fd, buffer.data(), buffer.size(), offset);
+  } while (bytes < 0 && errno == EINTR);
+
+  std::scoped_lock lock(mMutex);
+  --mFiles.at(id).readers;
+  return bytes;
+}
+
+void FilePool::closeLeastRecentlyRead() {
+  // Files being read are skipped, the budget may be exceeded while all are
+  for (auto it = mOpenFiles.end();
+       mOpenFiles.size() >= mMaxOpenFiles && it != mOpenFiles.begin();) {
+    --it;
+    auto &file = mFiles.at(*it);
+    if (file.readers == 0) {
+      ::close(file.fd);
+      file.fd = -1;
+      it = mOpenFiles.erase(it);
+    }
+  }
+}
+} // namespace TracyPlayback
@@ -0,0 +1,71 @@
+#include "liveStreamBuffer.h"
+
+namespace TracyPlayback {
+void LiveStreamBuffer::append(std::span<char const> data) {
+  std::scoped_lock lock(mMutex);
+  mIncoming.insert(mIncoming.end(), data.begin(), data.end());
+}
+
+void LiveStreamBuffer::close() {
+  std::scoped_lock lock(mMutex);
+  mClosed = true;
+}
+
+size_t LiveStreamBuffer::queuedBytes() {
+  std::scoped_lock lock(mMutex);
+  return mIncoming.size();
+}
+
+LiveStreamBuffer::int_type LiveStreamBuffer::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  std::scoped_lock lock(mMutex);
+  if (mIncoming.empty()) {
+    return traits_type::eof();
+  }
+
+  // Drop what can no longer be seeked back to, then take the new data
+  size_t read = gptr() - eback();
+  size_t discard = mMark - mBufferPosition;
+  mBuffer.erase(mBuffer.begin(), mBuffer.begin() + discard);
+  mBufferPosition = mMark;
+  mBuffer.insert(mBuffer.end(), mIncoming.begin(), mIncoming.end());
+  mIncoming.clear();
+
+  setg(mBuffer.data(), mBuffer.data() + read - discard,
+       mBuffer.data() + mBuffer.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize LiveStreamBuffer::showmanyc() {
+  std::scoped_lock lock(mMutex);
+  if (!mIncoming.empty()) {
+    return mIncoming.size();
+  }
+  return mClosed ? -1 : 0;
+}
+
+LiveStreamBuffer::pos_type
+LiveStreamBuffer::seekoff(off_type offset, std::ios_base::seekdir direction,
+                          std::ios_base::openmode which) {
+  if (direction != std::ios_base::cur || !(which & std::ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+  return seekpos(mBufferPosition + (gptr() - eback()) + offset, which);
+}
+
+LiveStreamBuffer::pos_type
+LiveStreamBuffer::seekpos(pos_type position, std::ios_base::openmode which) {
+  uint64_t target = off_type(position);
+  if (!(which & std::ios_base::in) || target < mMark ||
+      target > mBufferPosition + mBuffer.size()) {
+    return pos_type(off_type(-1));
+  }
+  mMark = target;
+  setg(mBuffer.data(), mBuffer.data() + (target - mBufferPosition),
+       mBuffer.data() + mBuffer.size());
+  return position;
+}
+} // namespace TracyPlayback
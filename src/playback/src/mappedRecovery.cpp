@@ -0,0 +1,66 @@
+#include "mappedRecovery.h"
+
+#include "mappedBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace TracyPlayback {
+std::unique_ptr<std::istream> recoverMappedBuffer(std::istream &file) {
+  using namespace TracyRecorder;
+
+  MappedBufferHeader header;
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::string_view(header.magic, sizeof(header.magic)) !=
+          mappedBufferMagic ||
+      sizeof(header) + header.startEventBytes > mappedBufferHeaderBytes ||
+      header.ringBytes == 0) {
+    return nullptr;
+  }
+
+  std::string stream(std::string_view("TRCYPLAY\1\0\0\0", 12));
+  std::string startEvent(header.startEventBytes, '\0');
+  if (!file.read(startEvent.data(), startEvent.size())) {
+    return nullptr;
+  }
+  stream += startEvent;
+
+  // Rings only hold complete events up to committed, whatever was being
+  // written when the process died is past it
+  for (uint32_t index = 0; index < header.ringCount; ++index) {
+    auto ringStart =
+        mappedBufferHeaderBytes +
+        uint64_t(index) * (mappedRingHeaderBytes + header.ringBytes);
+    MappedRingHeader positions;
+    file.seekg(ringStart);
+    if (!file.read(reinterpret_cast<char *>(&positions), sizeof(positions))) {
+      return nullptr;
+    }
+    if (positions.committed < positions.consumed ||
+        positions.committed - positions.consumed > header.ringBytes) {
+      return nullptr;
+    }
+
+    auto size = positions.committed - positions.consumed;
+    auto offset = positions.consumed % header.ringBytes;
+    auto first = std::min<uint64_t>(size, header.ringBytes - offset);
+    auto end = stream.size();
+    stream.resize(end + size);
+    file.seekg(ringStart + mappedRingHeaderBytes + offset);
+    file.read(stream.data() + end, first);
+    file.seekg(ringStart + mappedRingHeaderBytes);
+    file.read(stream.data() + end + first, size - first);
+    if (!file) {
+      return nullptr;
+    }
+  }
+
+  auto recovered =
+      std::make_unique<std::istringstream>(std::move(stream), std::ios::binary);
+  recovered->seekg(12);
+  return recovered;
+}
+} // namespace TracyPlayback
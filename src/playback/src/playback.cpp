@@ -1,43 +1,103 @@
 #include "playback.h"
 
 #include "eventStream.h"
+#include "nullSink.h"
+#include "playbackStatistics.h"
 #include "playbackThread.h"
 #include "processInfo.h"
+#include "readAhead.h"
+#include "recordingSink.h"
+#include "tracySink.h"
 
-#include "tracy/Tracy.hpp"
 #include "utilities.h"
 
+#include <atomic>
+#include <chrono>
 #include <format>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
+namespace TracyPlayback {
 namespace {
-long double nanosecondScale() {
-  static const long double scale = [] {
-    uint64_t const startTime = tracy::Profiler::GetTime();
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    uint64_t const endTime = tracy::Profiler::GetTime();
-    return (endTime - startTime) / static_cast<long double>(1e9);
-  }();
-  return scale;
-}
-} // namespace
+// Opening a stream mostly waits on I/O
+constexpr size_t openThreads = 16;
 
-namespace TracyPlayback {
+// The threads replaying into one sink, by host, process and recorded thread
+template <PlaybackSink Sink> class PlaybackThreads {
+public:
+  explicit PlaybackThreads(Sink &sink) : mSink(sink) {}
 
-struct Playback::P {
+  PlaybackThread<Sink> &getOrEmplace(ProcessInfo const &processInfo,
+                                     uint64_t threadId) {
+    auto &processes = mThreads[processInfo.hostName];
+    auto &threads = processes[processInfo.processId];
+
+    auto it = threads.find(threadId);
+    if (it == threads.end()) {
+      it = threads
+               .try_emplace(threadId, std::make_unique<PlaybackThread<Sink>>(
+                                          mSink, processInfo, threadId))
+               .first;
+      ++mCount;
+    }
+    return *it->second;
+  }
+
+  // Recorded thread IDs are never reused, an exited thread's playback thread
+  // can go right away
+  void release(ProcessInfo const &processInfo, uint64_t threadId) {
+    auto &processes = mThreads[processInfo.hostName];
+    auto process = processes.find(processInfo.processId);
+    if (process != processes.end()) {
+      mCount -= process->second.erase(threadId);
+    }
+  }
+
+  size_t size() const { return mCount; }
+
+private:
+  Sink &mSink;
   std::unordered_map<
       std::string,
       std::unordered_map<
           uint64_t,
-          std::unordered_map<uint64_t, std::unique_ptr<PlaybackThread>>>>
-      playbackThreads;
+          std::unordered_map<uint64_t,
+                             std::unique_ptr<PlaybackThread<Sink>>>>>
+      mThreads;
+  size_t mCount = 0;
+};
 
+// Self-reports of a recorder are plotted per process, they belong to no
+// thread
+template <PlaybackSink Sink>
+void plotRecorderMetrics(
+    Sink &sink, ProcessInfo const &processInfo,
+    TracyRecorder::RecorderMetricsEvent<false> const &metrics,
+    uint64_t time) {
+  sink.plot(processInfo, "Recorder buffered events", metrics.bufferedEvents,
+            time);
+  sink.plot(processInfo, "Recorder buffered bytes", metrics.bufferedBytes,
+            time);
+  sink.plot(processInfo, "Recorder queued events", metrics.queuedEvents,
+            time);
+  sink.plot(processInfo, "Recorder dropped events", metrics.droppedEvents,
+            time);
+  sink.plot(processInfo, "Recorder flush waits", metrics.flushWaits, time);
+  sink.plot(processInfo, "Recorder mapped fallbacks", metrics.mappedFallbacks,
+            time);
+}
+} // namespace
+
+struct Playback::P {
   using StreamWithInfo =
       std::shared_ptr<std::pair<EventStream, ProcessInfo>>; // Could have been a
                                                             // unique ptr
@@ -53,72 +113,334 @@ struct Playback::P {
                       CompareStreamWithInfo>
       eventStreams;
 
+  // Follow mode only, streams waiting for their writer and since when
+  std::vector<std::pair<StreamWithInfo, std::chrono::steady_clock::time_point>>
+      starvedStreams;
+
+  // Follow mode only, streams whose StartEvent hasn't been written yet
+  std::vector<EventStream> pendingStarts;
+
+  // Streams handed over by other threads while playing
+  std::mutex mutexIncomingStreams;
+  std::vector<StreamInfo> incomingStreams;
+  std::atomic<bool> hasIncomingStreams = false;
+  std::atomic<bool> acceptingStreams = false;
+  bool playing = false;
+
+  // Rotated segments of one recording share host, PID and start time. They
+  // are chained into a single stream, for segments added before playing.
+  using RecordingKey = std::tuple<std::string, uint64_t, uint64_t>;
+  std::map<RecordingKey, StreamWithInfo> recordings;
+
   uint64_t minimumUnixTime = std::numeric_limits<uint64_t>::max();
+  std::optional<FollowOptions> follow;
+  std::unordered_map<std::string, int64_t> hostClockOffsets;
+
+  std::optional<ReadAheadOptions> readAheadOptions = ReadAheadOptions{};
+  std::shared_ptr<ReadAheadPool> readAhead;
 
   P() = default;
   ~P() = default;
 
-  void addStream(StreamInfo &&stream) {
-    EventStream events{std::move(stream)};
+  enum class Added { Stream, Segment, Pending, Failed };
+
+  // Logging can be left to the caller when adding many streams at once
+  Added addStream(EventStream &&events, bool log = true) {
+    if (events.state() == EventStream::State::Starved) {
+      pendingStarts.push_back(std::move(events));
+      return Added::Pending;
+    }
+
     auto event = events.pop();
     if (event.has_value()) {
       if (auto startEvent =
               std::get_if<TracyRecorder::StartEvent<false>>(&event->event)) {
-        minimumUnixTime = std::min(minimumUnixTime, startEvent->unixTime);
+        if (auto it = hostClockOffsets.find(startEvent->host);
+            it != hostClockOffsets.end()) {
+          events.setClockOffset(it->second);
+        }
+        // Once playing, the time origin stays put so replayed times don't jump
+        if (!playing ||
+            minimumUnixTime == std::numeric_limits<uint64_t>::max()) {
+          minimumUnixTime =
+              std::min(minimumUnixTime, events.getStartPosixTime());
+        }
+        RecordingKey key{startEvent->host, startEvent->processId,
+                         startEvent->unixTime};
+        if (auto it = recordings.find(key); it != recordings.end()) {
+          if (log) {
+            std::cout << std::format(
+                             "Added segment to stream from host '{}' PID '{}'",
+                             startEvent->host, startEvent->processId)
+                      << std::endl;
+          }
+          it->second->first.addSegment(std::move(events));
+          return Added::Segment;
+        }
+
         ProcessInfo processInfo{std::move(startEvent->host),
                                 startEvent->processId};
 
-        std::cout << std::format("Added stream from host '{}' PID '{}'",
-                                 processInfo.hostName, processInfo.processId)
-                  << std::endl;
+        if (log) {
+          std::cout << std::format("Added stream from host '{}' PID '{}'",
+                                   processInfo.hostName, processInfo.processId)
+                    << std::endl;
+        }
 
-        eventStreams.emplace(
+        auto eventStream =
             std::make_shared<std::pair<EventStream, ProcessInfo>>(
-                std::move(events), std::move(processInfo)));
+                std::move(events), std::move(processInfo));
+        if (!playing) {
+          recordings.emplace(std::move(key), eventStream);
+        }
+        eventStreams.emplace(std::move(eventStream));
 
-        return;
+        return Added::Stream;
       }
     }
 
-    std::cout << std::format("FAILED to add stream") << std::endl;
+    if (log) {
+      std::cout << "FAILED to add stream" << std::endl;
+    }
+    return Added::Failed;
   }
 
-  PlaybackThread &getOrEmplace(ProcessInfo const &processInfo,
-                               uint64_t threadId) {
-    auto &processes = playbackThreads[processInfo.hostName];
-    auto &threads = processes[processInfo.processId];
+  // Reading the first events waits on I/O, streams are opened in parallel
+  // and registered afterwards
+  void addStreams(std::vector<StreamInfo> streams) {
+    readAheadPool(); // Created before going parallel
+    std::vector<std::optional<EventStream>> opened(streams.size());
+    std::atomic<size_t> next = 0;
+    {
+      std::vector<std::jthread> workers;
+      auto threads = std::min<size_t>(openThreads, streams.size());
+      for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, &streams, &opened, &next] {
+          for (size_t index = next++; index < streams.size();
+               index = next++) {
+            opened[index].emplace(openStream(std::move(streams[index])));
+          }
+        });
+      }
+    }
 
-    auto it = threads.find(threadId);
-    if (it == threads.end()) {
-      it = threads
-               .try_emplace(threadId, std::make_unique<PlaybackThread>(
-                                          processInfo, threadId))
-               .first;
+    std::map<Added, size_t> added;
+    for (auto &events : opened) {
+      ++added[addStream(std::move(*events), false)];
     }
-    return *it->second;
+    std::cout << std::format("Added {} streams, {} segments, {} waiting for "
+                             "their start, {} failed",
+                             added[Added::Stream], added[Added::Segment],
+                             added[Added::Pending], added[Added::Failed])
+              << std::endl;
+  }
+
+  // Adding segments may have changed which event comes first in a stream
+  void startPlaying() {
+    recordings.clear();
+    std::vector<StreamWithInfo> streams;
+    for (; !eventStreams.empty(); eventStreams.pop()) {
+      streams.push_back(eventStreams.top());
+    }
+    for (auto &eventStream : streams) {
+      eventStreams.push(std::move(eventStream));
+    }
+  }
+
+  void registerIncomingStreams() {
+    if (hasIncomingStreams.exchange(false)) {
+      std::vector<StreamInfo> streams;
+      {
+        std::scoped_lock lock(mutexIncomingStreams);
+        std::swap(streams, incomingStreams);
+      }
+      for (auto &stream : streams) {
+        addStream(openStream(std::move(stream)));
+      }
+    }
+
+    std::erase_if(pendingStarts, [this](EventStream &events) {
+      events.poll();
+      if (events.state() == EventStream::State::Starved) {
+        return false;
+      }
+      addStream(std::move(events));
+      return true;
+    });
+  }
+
+  std::shared_ptr<ReadAheadPool> const &readAheadPool() {
+    if (!readAhead && readAheadOptions && !follow) {
+      readAhead = ReadAheadPool::create(*readAheadOptions);
+    }
+    return readAhead;
+  }
+
+  EventStream openStream(StreamInfo &&stream) {
+    return EventStream{std::move(stream), follow, readAheadPool()};
+  }
+
+  bool hasWork() const {
+    // Check acceptingStreams first, streams added before it was cleared are
+    // then guaranteed to show up in hasIncomingStreams
+    return acceptingStreams || hasIncomingStreams || !eventStreams.empty() ||
+           !starvedStreams.empty() || !pendingStarts.empty();
+  }
+
+  void requeue(StreamWithInfo const &eventStream) {
+    switch (eventStream->first.state()) {
+    case EventStream::State::Ready:
+      eventStreams.push(eventStream);
+      break;
+    case EventStream::State::Starved:
+      starvedStreams.emplace_back(eventStream,
+                                  std::chrono::steady_clock::now());
+      break;
+    case EventStream::State::Finished:
+      std::cout << std::format("Host '{}' PID '{}' DONE!\n",
+                               eventStream->second.hostName,
+                               eventStream->second.processId);
+      break;
+    }
+  }
+
+  // Returns true when the merge has to wait for starved streams before it
+  // may emit the next event.
+  bool pollStarvedStreams() {
+    auto now = std::chrono::steady_clock::now();
+    bool mustWait = false;
+    std::erase_if(starvedStreams, [&](auto &starved) {
+      auto &[eventStream, since] = starved;
+      eventStream->first.poll();
+      if (eventStream->first.state() != EventStream::State::Starved) {
+        requeue(eventStream);
+        return true;
+      }
+      mustWait |= now - since < follow->maxLatency;
+      return false;
+    });
+    return mustWait;
+  }
+
+  // Returns true when there is nothing the merge may emit right now
+  bool waitForStreams() {
+    registerIncomingStreams();
+    bool mustWait = !starvedStreams.empty() && pollStarvedStreams();
+    return mustWait || eventStreams.empty();
+  }
+
+  std::chrono::milliseconds pollInterval() const {
+    return follow.value_or(FollowOptions{}).pollInterval;
   }
 };
 
 Playback::Playback() : p(std::make_unique<P>()) {}
 Playback::~Playback() = default;
 
+void Playback::setFollowMode(FollowOptions const &options) {
+  p->follow = options;
+}
+
+void Playback::setReadAhead(std::optional<ReadAheadOptions> const &options) {
+  p->readAheadOptions = options;
+}
+
+void Playback::setHostClockOffset(std::string const &host, int64_t offset) {
+  p->hostClockOffsets[host] = offset;
+}
+
 void Playback::addStream(StreamInfo &&stream) {
-  p->addStream(std::move(stream));
+  {
+    std::scoped_lock lock(p->mutexIncomingStreams);
+    if (p->playing) {
+      p->incomingStreams.push_back(std::move(stream));
+      p->hasIncomingStreams = true;
+      return;
+    }
+  }
+  p->addStream(p->openStream(std::move(stream)));
 }
 
-void Playback::play(bool trace) {
-  using namespace tracy;
-  auto originTime = Profiler::GetTime();
+void Playback::addStreams(std::vector<StreamInfo> streams) {
+  {
+    std::scoped_lock lock(p->mutexIncomingStreams);
+    if (p->playing) {
+      std::move(streams.begin(), streams.end(),
+                std::back_inserter(p->incomingStreams));
+      p->hasIncomingStreams = true;
+      return;
+    }
+  }
+  p->addStreams(std::move(streams));
+}
 
-  std::cout << "nanosecondScale: " << nanosecondScale() << std::endl;
+void Playback::setAcceptingStreams(bool accepting) {
+  p->acceptingStreams = accepting;
+}
+
+void Playback::play(ProgressOptions const &options) {
+  TracySink sink;
+  play(sink, options);
+}
+
+template <PlaybackSink Sink>
+void Playback::play(Sink &sink, ProgressOptions const &options) {
+  using Clock = PlaybackStatistics::Clock;
+  {
+    std::scoped_lock lock(p->mutexIncomingStreams);
+    p->playing = true;
+  }
+  p->startPlaying();
+
+  PlaybackThreads<Sink> threads(sink);
+  auto originTime = sink.now();
+  auto nanosecondScale = sink.nanosecondScale();
+
+  std::cout << "nanosecondScale: " << nanosecondScale << std::endl;
   std::cout << "originTime: " << originTime << std::endl;
 
-  while (!p->eventStreams.empty()) {
+  PlaybackStatistics statistics(options, std::cerr);
+  auto streamState = [](EventStream const &events) {
+    switch (events.state()) {
+    case EventStream::State::Ready:
+      return PlaybackStatistics::StreamState::Ready;
+    case EventStream::State::Starved:
+      return PlaybackStatistics::StreamState::Starved;
+    case EventStream::State::Finished:
+      break;
+    }
+    return PlaybackStatistics::StreamState::Finished;
+  };
+
+  while (p->hasWork()) {
+    statistics.report();
+    auto waitStart = Clock::now();
+    if (p->waitForStreams()) {
+      std::this_thread::sleep_for(p->pollInterval());
+      statistics.addStall();
+      statistics.addTime(PlaybackPhase::Stall, Clock::now() - waitStart);
+      continue;
+    }
+
     auto eventStream = p->eventStreams.top();
     p->eventStreams.pop();
 
     auto eventTime = eventStream->first.getNanosecondsSincePosix();
-    if (auto event = eventStream->first.pop(); event.has_value()) {
+    auto decodeStart = Clock::now();
+    auto event = eventStream->first.pop();
+    auto dispatchStart = Clock::now();
+    statistics.addTime(PlaybackPhase::Decode, dispatchStart - decodeStart);
+    if (auto metrics =
+            event ? std::get_if<TracyRecorder::RecorderMetricsEvent<false>>(
+                        &event->event)
+                  : nullptr) {
+      plotRecorderMetrics(
+          sink, eventStream->second, *metrics,
+          uint64_t(originTime + int64_t(eventTime - p->minimumUnixTime) *
+                                    nanosecondScale));
+      statistics.addTime(PlaybackPhase::Dispatch,
+                         Clock::now() - dispatchStart);
+    } else if (event.has_value()) {
       auto eventType = event->type();
 
       auto threadId = std::visit(
@@ -134,16 +456,35 @@ void Playback::play(bool trace) {
                                                "should only happen once at the "
                                                "start of the stream");
                     },
+                    [](TracyRecorder::ClockSyncEvent<false> const &)
+                        -> uint64_t {
+                      throw std::logic_error(
+                          "ClockSyncEvent should be consumed by the stream");
+                    },
+                    [](TracyRecorder::RecorderMetricsEvent<false> const &)
+                        -> uint64_t {
+                      throw std::logic_error(
+                          "RecorderMetricsEvent has no thread");
+                    },
                     [](auto const &e) -> uint64_t { return e.threadId; }},
           event->event);
 
-      auto &thread = p->getOrEmplace(eventStream->second, threadId);
+      auto &thread = threads.getOrEmplace(eventStream->second, threadId);
       thread.submitEvent(
           std::move(*event),
-          uint64_t(originTime +
-                   (eventTime - p->minimumUnixTime) * nanosecondScale()));
+          uint64_t(originTime + int64_t(eventTime - p->minimumUnixTime) *
+                                    nanosecondScale));
+      if (eventType == TracyRecorder::EventType::ThreadExit) {
+        threads.release(eventStream->second, threadId);
+      }
+      statistics.addTime(PlaybackPhase::Dispatch,
+                         Clock::now() - dispatchStart);
+      statistics.addEvent(
+          eventStream.get(), eventStream->second,
+          eventTime - std::min(eventTime, p->minimumUnixTime));
+      statistics.setPlaybackThreads(threads.size());
 
-      if (trace) {
+      if (options.logEvents) {
         std::cout << std::format(
             "Event for host '{}' PID '{}' TID '{}' Event type {}\n",
             eventStream->second.hostName, eventStream->second.processId,
@@ -151,15 +492,18 @@ void Playback::play(bool trace) {
             static_cast<std::underlying_type_t<TracyRecorder::EventType>>(
                 eventType));
       }
-      if (!eventStream->first.peek().has_value()) {
-        std::cout << std::format(
-            "Host '{}' PID '{}' DONE!\n", eventStream->second.hostName,
-            eventStream->second.processId,
-            static_cast<std::underlying_type_t<TracyRecorder::EventType>>(
-                eventType));
-      }
-      p->eventStreams.push(eventStream);
     }
+    p->requeue(eventStream);
+    statistics.setStreamState(eventStream.get(), eventStream->second,
+                              streamState(eventStream->first));
   }
+  statistics.report(true);
+
+  std::scoped_lock lock(p->mutexIncomingStreams);
+  p->playing = false;
 }
+
+template void Playback::play(TracySink &, ProgressOptions const &);
+template void Playback::play(NullSink &, ProgressOptions const &);
+template void Playback::play(RecordingSink &, ProgressOptions const &);
 } // namespace TracyPlayback
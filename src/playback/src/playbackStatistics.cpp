@@ -0,0 +1,160 @@
+#include "playbackStatistics.h"
+
+#include "tracy/Tracy.hpp"
+
+#include <algorithm>
+#include <format>
+#include <string_view>
+
+namespace TracyPlayback {
+namespace {
+constexpr std::string_view phaseNames[] = {"decode", "dispatch", "stall"};
+constexpr std::string_view stateNames[] = {"ready", "starved", "finished"};
+
+std::string jsonString(std::string_view text) {
+  std::string quoted = "\"";
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (c < 0x20) {
+      quoted += std::format("\\u{:04x}", c);
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + '"';
+}
+
+double seconds(PlaybackStatistics::Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+} // namespace
+
+PlaybackStatistics::PlaybackStatistics(ProgressOptions const &options,
+                                       std::ostream &out)
+    : mOptions(options), mOut(out), mStart(Clock::now()),
+      mLastReport(mStart) {}
+
+void PlaybackStatistics::addTime(PlaybackPhase phase,
+                                 Clock::duration duration) {
+  mPhaseTime[size_t(phase)] += duration;
+}
+
+PlaybackStatistics::Stream &
+PlaybackStatistics::stream(void const *stream,
+                           ProcessInfo const &processInfo) {
+  auto [it, added] = mStreamIndices.try_emplace(stream, mStreams.size());
+  if (added) {
+    mStreams.push_back({processInfo});
+  }
+  return mStreams[it->second];
+}
+
+void PlaybackStatistics::addEvent(void const *stream,
+                                  ProcessInfo const &processInfo,
+                                  uint64_t position) {
+  auto &info = this->stream(stream, processInfo);
+  ++info.events;
+  info.position = position;
+  mFront = std::max(mFront, position);
+  ++mEvents;
+}
+
+void PlaybackStatistics::setStreamState(void const *stream,
+                                        ProcessInfo const &processInfo,
+                                        StreamState state) {
+  this->stream(stream, processInfo).state = state;
+}
+
+void PlaybackStatistics::report(bool force) {
+  auto now = Clock::now();
+  if (!force && (mOptions.interval.count() == 0 ||
+                 now - mLastReport < mOptions.interval)) {
+    return;
+  }
+  auto elapsed = seconds(now - mLastReport);
+  double eventsPerSecond =
+      elapsed > 0 ? (mEvents - mEventsAtLastReport) / elapsed : 0;
+
+  if (mOptions.format == ProgressFormat::Json) {
+    writeJson(eventsPerSecond);
+  } else {
+    writeText(eventsPerSecond);
+  }
+  if (mOptions.plots) {
+    plot(eventsPerSecond);
+  }
+  for (auto &stream : mStreams) {
+    stream.reportedFinished = stream.state == StreamState::Finished;
+  }
+  mLastReport = now;
+  mEventsAtLastReport = mEvents;
+}
+
+void PlaybackStatistics::writeText(double eventsPerSecond) {
+  auto total = seconds(Clock::now() - mStart);
+  auto line = std::format("Playback: {} events, {:.0f}/s, {} threads, {} "
+                          "stalls",
+                          mEvents, eventsPerSecond, mPlaybackThreads, mStalls);
+  for (size_t i = 0; i < size_t(PlaybackPhase::Count); ++i) {
+    line += std::format(", {} {:.1f}%", phaseNames[i],
+                        total > 0 ? 100 * seconds(mPhaseTime[i]) / total : 0);
+  }
+  mOut << line << '\n';
+  for (auto &stream : mStreams) {
+    if (stream.reportedFinished) {
+      continue;
+    }
+    mOut << std::format("  host '{}' PID '{}': {} events, at {:.3f} s, lag "
+                        "{:.3f} s, {}\n",
+                        stream.processInfo.hostName,
+                        stream.processInfo.processId, stream.events,
+                        stream.position / 1e9,
+                        (mFront - stream.position) / 1e9,
+                        stateNames[size_t(stream.state)]);
+  }
+  mOut.flush();
+}
+
+void PlaybackStatistics::writeJson(double eventsPerSecond) {
+  auto line = std::format("{{\"events\":{},\"eventsPerSecond\":{:.0f},"
+                          "\"playbackThreads\":{},\"stalls\":{}",
+                          mEvents, eventsPerSecond, mPlaybackThreads, mStalls);
+  for (size_t i = 0; i < size_t(PlaybackPhase::Count); ++i) {
+    line += std::format(
+        ",\"{}Ns\":{}", phaseNames[i],
+        std::chrono::duration_cast<std::chrono::nanoseconds>(mPhaseTime[i])
+            .count());
+  }
+  line += ",\"streams\":[";
+  bool first = true;
+  for (auto &stream : mStreams) {
+    if (stream.reportedFinished) {
+      continue;
+    }
+    line += std::format(
+        "{}{{\"host\":{},\"processId\":{},\"events\":{},\"positionNs\":{},"
+        "\"lagNs\":{},\"state\":\"{}\"}}",
+        first ? "" : ",", jsonString(stream.processInfo.hostName),
+        stream.processInfo.processId, stream.events, stream.position,
+        mFront - stream.position, stateNames[size_t(stream.state)]);
+    first = false;
+  }
+  mOut << line << "]}\n";
+  mOut.flush();
+}
+
+void PlaybackStatistics::plot(double eventsPerSecond) {
+  uint64_t maxLag = 0;
+  for (auto &stream : mStreams) {
+    if (stream.state != StreamState::Finished) {
+      maxLag = std::max(maxLag, mFront - stream.position);
+    }
+  }
+  TracyPlot("Playback events/s", eventsPerSecond);
+  TracyPlot("Playback threads", int64_t(mPlaybackThreads));
+  TracyPlot("Playback stalls", int64_t(mStalls));
+  TracyPlot("Playback max stream lag", int64_t(maxLag));
+}
+} // namespace TracyPlayback
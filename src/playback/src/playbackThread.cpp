@@ -1,97 +1,214 @@
 #include "playbackThread.h"
 
-#include "threadGroupAllocator.h"
+#include "nullSink.h"
+#include "recordingSink.h"
+#include "tracySink.h"
 #include "utilities.h"
 
+#include <algorithm>
 #include <format>
 #include <iostream>
-#include <tracy/Tracy.hpp>
 
 namespace TracyPlayback {
 namespace {
-ThreadGroupAllocator &getThreadGroupAllocator() {
-  static ThreadGroupAllocator allocator;
-  return allocator;
+// Like "IPC 1.52, 120 LLC misses, 1 context switch, 84% on CPU", leaving
+// out what wasn't counted
+std::string describeCounters(uint8_t available,
+                             TracyRecorder::CounterValues const &deltas,
+                             uint64_t duration) {
+  using TracyRecorder::Counter;
+  auto has = [available](Counter counter) {
+    return (available & TracyRecorder::counterBit(counter)) != 0;
+  };
+  auto value = [&deltas](Counter counter) { return deltas[size_t(counter)]; };
+  std::vector<std::string> parts;
+  if (has(Counter::Instructions) && has(Counter::Cycles) &&
+      value(Counter::Cycles) != 0) {
+    parts.push_back(std::format("IPC {:.2f}",
+                                double(value(Counter::Instructions)) /
+                                    value(Counter::Cycles)));
+  }
+  if (has(Counter::CacheMisses)) {
+    parts.push_back(
+        std::format("{} LLC misses", value(Counter::CacheMisses)));
+  }
+  if (has(Counter::ContextSwitches)) {
+    auto switches = value(Counter::ContextSwitches);
+    parts.push_back(std::format("{} context switch{}", switches,
+                                switches == 1 ? "" : "es"));
+  }
+  if (has(Counter::TaskClock) && duration != 0) {
+    parts.push_back(std::format(
+        "{:.0f}% on CPU", 100.0 * value(Counter::TaskClock) / duration));
+  }
+  std::string text;
+  for (auto &part : parts) {
+    text += (text.empty() ? "" : ", ") + part;
+  }
+  return text;
 }
+
 } // namespace
 
-PlaybackThread::PlaybackThread(ProcessInfo const &processInfo,
-                               uint64_t threadId) {
+template <PlaybackSink Sink>
+PlaybackThread<Sink>::PlaybackThread(Sink &sink,
+                                     ProcessInfo const &processInfo,
+                                     uint64_t threadId)
+    : mSink(sink) {
   mThread =
       std::jthread(&PlaybackThread::threadFunc, this, processInfo, threadId);
 }
 
-bool PlaybackThread::handleEvent(ProcessInfo const &processInfo,
-                                 TracyRecorder::Event<false> const &event,
-                                 uint64_t adjustedTime) {
-  using namespace tracy;
-  bool nameSetExplicitly = false;
-
+template <PlaybackSink Sink>
+void PlaybackThread<Sink>::handleEvent(
+    typename Sink::Thread &thread, TracyRecorder::Event<false> const &event,
+    uint64_t adjustedTime) {
   std::visit(
       overloads{
           [adjustedTime](TracyRecorder::StartEvent<false> const &e) {
             std::cout << "Unexpected StartEvent\n";
           },
-          [adjustedTime](TracyRecorder::StartZoneEvent<false> const &e) {
-            TracyQueuePrepare(QueueType::ZoneBeginAllocSrcLoc);
-            auto srcLocation = tracy::Profiler::AllocSourceLocation(
-                e.line, e.file.data(), e.file.size(), e.function.data(),
-                e.function.size(), e.name.data(), e.name.size(), e.color);
-            MemWrite(&item->zoneBegin.time, adjustedTime);
-            MemWrite(&item->zoneBegin.srcloc, srcLocation);
-            TracyQueueCommit(zoneBeginThread);
-          },
-          [adjustedTime](TracyRecorder::EndZoneEvent<false> const &e) {
-            TracyQueuePrepare(QueueType::ZoneEnd);
-            MemWrite(&item->zoneEnd.time, adjustedTime);
-            TracyQueueCommit(zoneEndThread);
-          },
-          [adjustedTime](TracyRecorder::MessageEvent<false> const &e) {
-            auto ptr = (char *)tracy_malloc(e.message.size());
-            memcpy(ptr, e.message.data(), e.message.size());
-
-            if (e.message.size() > std::numeric_limits<uint16_t>::max()) {
-              std::cout << std::format("Message too long: {}\n", e.message);
-              return;
+          [](TracyRecorder::ClockSyncEvent<false> const &) {
+            std::cout << "Unexpected ClockSyncEvent\n";
+          },
+          [](TracyRecorder::RecorderMetricsEvent<false> const &) {
+            std::cout << "Unexpected RecorderMetricsEvent\n";
+          },
+          // The thread's lifetime is managed by Playback
+          [](TracyRecorder::ThreadStartEvent<false> const &) {},
+          [](TracyRecorder::ThreadExitEvent<false> const &) {},
+          [this, &thread,
+           adjustedTime](TracyRecorder::StartZoneEvent<false> const &e) {
+            mZones.push_back({mCpu, e.time, countersAt(e.time)});
+            thread.zoneBegin(e, adjustedTime);
+            if (auto stack = takeStack()) {
+              thread.zoneText(*stack);
             }
-
-            if (e.color == 0) {
-              TracyQueuePrepare(QueueType::Message);
-              MemWrite(&item->messageFat.time, adjustedTime);
-              MemWrite(&item->messageFat.text, (uint64_t)ptr);
-              MemWrite(&item->messageFat.size, (uint16_t)e.message.size());
-              TracyQueueCommit(messageFatThread);
+          },
+          [this, &thread,
+           adjustedTime](TracyRecorder::EndZoneEvent<false> const &e) {
+            if (!mZones.empty()) {
+              auto zone = std::move(mZones.back());
+              mZones.pop_back();
+              if (zone.cpu && mCpu && *zone.cpu != *mCpu) {
+                thread.zoneText(std::format("Migrated from CPU {} to CPU {}",
+                                            *zone.cpu, *mCpu));
+              }
+              auto end = countersAt(e.time);
+              if (zone.counters && end) {
+                TracyRecorder::CounterValues deltas;
+                for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+                  deltas[i] = end->totals[i] - zone.counters->totals[i];
+                }
+                auto text = describeCounters(
+                    zone.counters->available & end->available, deltas,
+                    e.time - std::min(e.time, zone.start));
+                if (!text.empty()) {
+                  thread.zoneText(text);
+                }
+              }
+            }
+            thread.zoneEnd(adjustedTime);
+          },
+          [this, &thread,
+           adjustedTime](TracyRecorder::MessageEvent<false> const &e) {
+            if (auto stack = takeStack()) {
+              thread.message(e.message + '\n' + *stack, e.color, adjustedTime);
             } else {
-              TracyQueuePrepare(QueueType::MessageColor);
-              MemWrite(&item->messageColorFat.time, adjustedTime);
-              MemWrite(&item->messageColorFat.text, (uint64_t)ptr);
-              MemWrite(&item->messageColorFat.b, uint8_t((e.color) & 0xFF));
-              MemWrite(&item->messageColorFat.g,
-                       uint8_t((e.color >> 8) & 0xFF));
-              MemWrite(&item->messageColorFat.r,
-                       uint8_t((e.color >> 16) & 0xFF));
-              MemWrite(&item->messageColorFat.size, (uint16_t)e.message.size());
-              TracyQueueCommit(messageColorFatThread);
+              thread.message(e.message, e.color, adjustedTime);
+            }
+          },
+          [this, &thread,
+           adjustedTime](TracyRecorder::FiberEnterEvent<false> const &e) {
+            if (!mInFiber) {
+              std::swap(mZones, mThreadZones);
+              mInFiber = true;
+            }
+            mZones.clear();
+            thread.fiberEnter(e, adjustedTime);
+          },
+          [this, &thread,
+           adjustedTime](TracyRecorder::FiberLeaveEvent<false> const &e) {
+            if (mInFiber) {
+              std::swap(mZones, mThreadZones);
+              mInFiber = false;
+            }
+            thread.fiberLeave(adjustedTime);
+          },
+          [this](TracyRecorder::CpuEvent<false> const &e) { mCpu = e.cpu; },
+          [this](TracyRecorder::CountersEvent<false> const &e) {
+            auto &counters = mCounters ? *mCounters : mCounters.emplace();
+            for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+              counters.totals[i] += e.deltas[i];
             }
+            counters.available = e.available;
+            counters.time = e.time;
+          },
+          [this](TracyRecorder::ModuleEvent<false> const &e) {
+            mSymbolizer.addModule(e);
+          },
+          [this](TracyRecorder::StackFramesEvent<false> const &e) {
+            mSymbolizer.addStack(e);
+          },
+          [this](TracyRecorder::StackEvent<false> const &e) {
+            mStack = e.stackId;
+          },
+          [&thread,
+           adjustedTime](TracyRecorder::CategoryEvent<false> const &e) {
+            thread.message(std::format("Category '{}' {}", e.name,
+                                       e.enabled ? "enabled" : "disabled"),
+                           0, adjustedTime);
+          },
+          [&thread](TracyRecorder::ZoneTextEvent<false> const &e) {
+            thread.zoneText(e.text);
+          },
+          [&thread](TracyRecorder::ZoneValueEvent<false> const &e) {
+            thread.zoneValue(e.value);
+          },
+          [&thread](TracyRecorder::ZoneColorEvent<false> const &e) {
+            thread.zoneColor(e.color);
+          },
+          [&thread](TracyRecorder::ThreadNameEvent<false> const &e) {
+            thread.name(e.name);
           },
-          [adjustedTime, &nameSetExplicitly,
-           &processInfo](TracyRecorder::ThreadNameEvent<false> const &e) {
-            auto newName =
-                std::format("{}: {}_{}_{}", e.name, processInfo.hostName,
-                            processInfo.processId, e.threadId);
-            SetThreadNameWithHint(
-                newName.c_str(),
-                getThreadGroupAllocator().allocate(processInfo));
-            nameSetExplicitly = true;
+          [&thread,
+           adjustedTime](TracyRecorder::FrameMarkEvent<false> const &e) {
+            thread.frameMark(e, adjustedTime);
           }},
       event.event);
+}
 
-  return nameSetExplicitly;
+template <PlaybackSink Sink>
+auto PlaybackThread<Sink>::countersAt(uint64_t time) const
+    -> std::optional<Counters> {
+  if (!mCounters || mCounters->time != time) {
+    return std::nullopt;
+  }
+  return mCounters;
 }
 
-void PlaybackThread::threadFunc(std::stop_token stopToken,
-                                ProcessInfo processInfo, uint64_t threadId) {
-  bool nameSetExplicitly = false;
+template <PlaybackSink Sink>
+std::optional<std::string> PlaybackThread<Sink>::takeStack() {
+  if (!mStack) {
+    return std::nullopt;
+  }
+  auto &frames = mSymbolizer.frames(*mStack);
+  mStack.reset();
+  if (frames.empty()) {
+    return std::nullopt;
+  }
+  std::string text = "Called from:";
+  for (auto &frame : frames) {
+    text += "\n  " + frame;
+  }
+  return text;
+}
+
+template <PlaybackSink Sink>
+void PlaybackThread<Sink>::threadFunc(std::stop_token stopToken,
+                                      ProcessInfo processInfo,
+                                      uint64_t threadId) {
+  typename Sink::Thread thread(mSink, processInfo, threadId);
 
   while (!stopToken.stop_requested()) {
     std::unique_lock<std::mutex> lock(mMutexRecieveNextEvent);
@@ -102,24 +219,18 @@ void PlaybackThread::threadFunc(std::stop_token stopToken,
       auto [event, adjustedTime] = *mNextEvent;
       mNextEvent.reset();
 
-      nameSetExplicitly |= handleEvent(processInfo, event, adjustedTime);
+      handleEvent(thread, event, adjustedTime);
 
       std::unique_lock<std::mutex> lock(mMutexProcessedNextEvent);
       mProcessedNextEvent += 1;
       mCondProcessedNextEvent.notify_one();
     }
   }
-
-  if (!nameSetExplicitly) {
-    auto newName = std::format("{}_{}_{}", processInfo.hostName,
-                               processInfo.processId, threadId);
-    tracy::SetThreadNameWithHint(
-        newName.c_str(), getThreadGroupAllocator().allocate(processInfo));
-  }
 }
 
-void PlaybackThread::submitEvent(TracyRecorder::Event<false> event,
-                                 uint64_t adjustedTime) {
+template <PlaybackSink Sink>
+void PlaybackThread<Sink>::submitEvent(TracyRecorder::Event<false> event,
+                                       uint64_t adjustedTime) {
   std::unique_lock<std::mutex> lock(mMutexProcessedNextEvent);
   uint64_t myEvent = mProcessedNextEvent + 1;
   {
@@ -132,4 +243,7 @@ void PlaybackThread::submitEvent(TracyRecorder::Event<false> event,
       lock, [this, myEvent] { return mProcessedNextEvent >= myEvent; });
 }
 
+template class PlaybackThread<TracySink>;
+template class PlaybackThread<NullSink>;
+template class PlaybackThread<RecordingSink>;
 } // namespace TracyPlayback
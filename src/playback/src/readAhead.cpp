@@ -0,0 +1,374 @@
+#include "readAhead.h"
+
+#include "blockFormat.h"
+#include "eventReader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <streambuf>
+
+namespace TracyPlayback {
+namespace {
+// Events decoded per turn, before the thread moves on to the next stream. The
+// first batches are smaller, most streams are only peeked at first.
+constexpr size_t firstBatchEvents = 16;
+constexpr size_t batchEvents = 256;
+// A stream of blocks has its first one this close to its start
+constexpr uint64_t firstBlockBytes = 64 * 1024;
+// Bytes a part reads from its stream at a time
+constexpr size_t partReadBytes = 64 * 1024;
+
+// Stream shared by the parts it is split into
+struct SplitSource {
+  std::mutex mutex;
+  std::unique_ptr<std::istream> stream;
+  uint64_t size;
+};
+
+// Reads a split stream at the part's own position, in chunks
+class PartBuffer : public std::streambuf {
+public:
+  explicit PartBuffer(std::shared_ptr<SplitSource> source)
+      : mSource(std::move(source)), mData(partReadBytes) {
+    setg(mData.data(), mData.data(), mData.data());
+  }
+
+protected:
+  int_type underflow() override {
+    mStart += egptr() - eback();
+    size_t read = 0;
+    {
+      std::scoped_lock lock(mSource->mutex);
+      auto &in = *mSource->stream;
+      in.clear();
+      if (in.seekg(mStart)) {
+        in.read(mData.data(), mData.size());
+        read = size_t(in.gcount());
+      }
+    }
+    setg(mData.data(), mData.data(), mData.data() + read);
+    return read == 0 ? traits_type::eof() : traits_type::to_int_type(mData[0]);
+  }
+
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    uint64_t base = mSource->size;
+    if (dir == std::ios_base::beg) {
+      base = 0;
+    } else if (dir == std::ios_base::cur) {
+      base = mStart + (gptr() - eback());
+    }
+    return seekpos(pos_type(off_type(base) + offset), which);
+  }
+
+  pos_type seekpos(pos_type position, std::ios_base::openmode) override {
+    if (off_type(position) < 0) {
+      return pos_type(off_type(-1));
+    }
+    auto target = uint64_t(off_type(position));
+    if (target >= mStart && target <= mStart + (egptr() - eback())) {
+      setg(eback(), eback() + (target - mStart), egptr());
+    } else {
+      mStart = target;
+      setg(mData.data(), mData.data(), mData.data());
+    }
+    return position;
+  }
+
+private:
+  std::shared_ptr<SplitSource> mSource;
+  std::vector<char> mData;
+  // Offset of the buffered data in the stream
+  uint64_t mStart = 0;
+};
+
+struct PartStream : std::istream {
+  explicit PartStream(std::shared_ptr<SplitSource> source)
+      : std::istream(nullptr), buffer(std::move(source)) {
+    rdbuf(&buffer);
+  }
+
+  PartBuffer buffer;
+};
+} // namespace
+
+struct ReadAheadQueue {
+  // Only touched by the thread decoding the current batch
+  std::unique_ptr<std::istream> stream;
+  std::optional<TracyRecorder::EventReader> reader;
+  // Start of a part after the first, the first batch syncs the reader to it
+  std::optional<uint64_t> syncTo;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<TracyRecorder::Event<false>> events;
+  bool finished = false;
+  // Waiting in the pool's work list or being decoded
+  bool scheduled = false;
+  bool suspended = false;
+  bool cancelled = false;
+  size_t batchLimit = firstBatchEvents;
+};
+
+ReadAheadStream::ReadAheadStream(
+    std::shared_ptr<ReadAheadPool> pool,
+    std::deque<std::shared_ptr<ReadAheadQueue>> parts)
+    : mPool(std::move(pool)), mQueue(std::move(parts.front())) {
+  parts.pop_front();
+  mParts = std::move(parts);
+}
+
+ReadAheadStream &ReadAheadStream::operator=(ReadAheadStream &&other) {
+  cancel();
+  mPool = std::move(other.mPool);
+  mQueue = std::move(other.mQueue);
+  mParts = std::move(other.mParts);
+  return *this;
+}
+
+ReadAheadStream::~ReadAheadStream() { cancel(); }
+
+void ReadAheadStream::cancel() {
+  if (mQueue) {
+    std::scoped_lock lock(mQueue->mutex);
+    mQueue->cancelled = true;
+  }
+  for (auto &part : mParts) {
+    std::scoped_lock lock(part->mutex);
+    part->cancelled = true;
+  }
+}
+
+std::optional<TracyRecorder::Event<false>> ReadAheadStream::pop() {
+  while (true) {
+    auto &queue = *mQueue;
+    std::unique_lock lock(queue.mutex);
+    if (queue.suspended) {
+      // Taking events resumes decoding, otherwise this could wait forever
+      lock.unlock();
+      resume();
+      lock.lock();
+    }
+    queue.cond.wait(
+        lock, [&queue] { return !queue.events.empty() || queue.finished; });
+    if (queue.events.empty()) {
+      if (mParts.empty()) {
+        return std::nullopt;
+      }
+      // On to the next part, which brings another one into decoding
+      lock.unlock();
+      mQueue = std::move(mParts.front());
+      mParts.pop_front();
+      resume();
+      continue;
+    }
+    auto event = std::move(queue.events.front());
+    queue.events.pop_front();
+
+    if (!queue.scheduled && !queue.finished && !queue.suspended &&
+        queue.events.size() <= mPool->mOptions.queuedEvents / 2) {
+      queue.scheduled = true;
+      lock.unlock();
+      mPool->schedule(mQueue);
+    }
+    return event;
+  }
+}
+
+void ReadAheadStream::suspend() {
+  if (mQueue) {
+    std::scoped_lock lock(mQueue->mutex);
+    mQueue->suspended = true;
+  }
+  for (auto &part : mParts) {
+    std::scoped_lock lock(part->mutex);
+    part->suspended = true;
+  }
+}
+
+void ReadAheadStream::resume() {
+  if (!mQueue) {
+    return;
+  }
+  resume(mQueue);
+  // Decode as many parts ahead as there are threads
+  auto ahead = std::min(mParts.size(), mPool->mThreads.size());
+  for (size_t i = 0; i < ahead; ++i) {
+    resume(mParts[i]);
+  }
+}
+
+void ReadAheadStream::resume(std::shared_ptr<ReadAheadQueue> const &queue) {
+  std::unique_lock lock(queue->mutex);
+  queue->suspended = false;
+  if (!queue->scheduled && !queue->finished &&
+      queue->events.size() < mPool->mOptions.queuedEvents) {
+    queue->scheduled = true;
+    lock.unlock();
+    mPool->schedule(queue);
+  }
+}
+
+std::shared_ptr<ReadAheadPool>
+ReadAheadPool::create(ReadAheadOptions const &options) {
+  return std::shared_ptr<ReadAheadPool>(new ReadAheadPool(options));
+}
+
+ReadAheadPool::ReadAheadPool(ReadAheadOptions const &options)
+    : mOptions(options) {
+  mOptions.queuedEvents = std::max<size_t>(mOptions.queuedEvents, 1);
+  auto threads = mOptions.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    mThreads.emplace_back(&ReadAheadPool::decodeThreadFunc, this);
+  }
+}
+
+ReadAheadPool::~ReadAheadPool() {
+  for (auto &thread : mThreads) {
+    thread.request_stop();
+  }
+}
+
+ReadAheadStream ReadAheadPool::open(std::unique_ptr<std::istream> stream) {
+  std::deque<std::shared_ptr<ReadAheadQueue>> parts;
+  auto offsets = splitOffsets(*stream);
+  if (offsets.empty()) {
+    auto queue = std::make_shared<ReadAheadQueue>();
+    queue->stream = std::move(stream);
+    queue->reader.emplace(*queue->stream);
+    parts.push_back(std::move(queue));
+  } else {
+    auto source = std::make_shared<SplitSource>();
+    source->stream = std::move(stream);
+    source->size = offsets.back();
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+      auto queue = std::make_shared<ReadAheadQueue>();
+      queue->stream = std::make_unique<PartStream>(source);
+      queue->stream->seekg(offsets[i]);
+      queue->reader.emplace(*queue->stream, offsets[i + 1]);
+      if (i > 0) {
+        queue->syncTo = offsets[i];
+      }
+      parts.push_back(std::move(queue));
+    }
+  }
+
+  ReadAheadStream result(shared_from_this(), std::move(parts));
+  result.resume();
+  return result;
+}
+
+std::vector<uint64_t> ReadAheadPool::splitOffsets(std::istream &in) const {
+  auto start = in.tellg();
+  in.seekg(0, std::ios::end);
+  auto size = in.tellg();
+  in.clear();
+  in.seekg(start);
+  if (mOptions.partBytes == 0 || start < 0 || size < 0 ||
+      uint64_t(size - start) <= mOptions.partBytes) {
+    return {};
+  }
+
+  // Events before the first block are only decoded by the first part, so the
+  // parts are measured from the first block. Streams without blocks near
+  // their start stay whole.
+  uint64_t first;
+  std::array<char, TracyRecorder::blockMarker.size()> marker;
+  {
+    TracyRecorder::EventReader probe(in, uint64_t(start) + firstBlockBytes);
+    probe.syncTo(uint64_t(start));
+    first = uint64_t(in.tellg());
+    in.read(marker.data(), marker.size());
+  }
+  bool framed = size_t(in.gcount()) == marker.size() &&
+                std::memcmp(marker.data(), TracyRecorder::blockMarker.data(),
+                            marker.size()) == 0;
+  in.clear();
+  in.seekg(start);
+  if (!framed) {
+    return {};
+  }
+
+  std::vector<uint64_t> offsets{uint64_t(start)};
+  for (auto offset = first + mOptions.partBytes; offset < uint64_t(size);
+       offset += mOptions.partBytes) {
+    offsets.push_back(offset);
+  }
+  offsets.push_back(uint64_t(size));
+  if (offsets.size() < 3) {
+    return {};
+  }
+  return offsets;
+}
+
+void ReadAheadPool::schedule(std::shared_ptr<ReadAheadQueue> queue) {
+  std::scoped_lock lock(mMutexWork);
+  mWork.push_back(std::move(queue));
+  mCondWork.notify_one();
+}
+
+void ReadAheadPool::decodeThreadFunc(std::stop_token stopToken) {
+  while (!stopToken.stop_requested()) {
+    std::shared_ptr<ReadAheadQueue> queue;
+    {
+      std::unique_lock lock(mMutexWork);
+      if (!mCondWork.wait(lock, stopToken, [this] { return !mWork.empty(); })) {
+        return;
+      }
+      queue = std::move(mWork.front());
+      mWork.pop_front();
+    }
+    decodeBatch(queue);
+  }
+}
+
+void ReadAheadPool::decodeBatch(std::shared_ptr<ReadAheadQueue> const &queue) {
+  size_t room = 0;
+  {
+    std::scoped_lock lock(queue->mutex);
+    if (queue->cancelled || queue->suspended) {
+      queue->scheduled = false;
+      return;
+    }
+    room = mOptions.queuedEvents - std::min(mOptions.queuedEvents,
+                                            queue->events.size());
+    room = std::min(room, queue->batchLimit);
+    queue->batchLimit = std::min(queue->batchLimit * 2, batchEvents);
+  }
+
+  // Decode without holding the lock, the consumer keeps popping meanwhile
+  if (queue->syncTo) {
+    queue->reader->syncTo(*queue->syncTo);
+    queue->syncTo.reset();
+  }
+  std::vector<TracyRecorder::Event<false>> batch;
+  bool finished = false;
+  while (batch.size() < room) {
+    auto event = queue->reader->next();
+    if (!event) {
+      finished = true;
+      break;
+    }
+    batch.push_back(std::move(*event));
+  }
+
+  bool reschedule = false;
+  {
+    std::scoped_lock lock(queue->mutex);
+    std::move(batch.begin(), batch.end(), std::back_inserter(queue->events));
+    queue->finished = finished;
+    // A full queue is rescheduled by its consumer
+    reschedule = !finished && !queue->cancelled && !queue->suspended &&
+                 queue->events.size() < mOptions.queuedEvents;
+    queue->scheduled = reschedule;
+    queue->cond.notify_all();
+  }
+  if (reschedule) {
+    schedule(queue);
+  }
+}
+} // namespace TracyPlayback
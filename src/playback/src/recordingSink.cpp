@@ -0,0 +1,68 @@
+#include "recordingSink.h"
+
+namespace TracyPlayback {
+void RecordingSink::Thread::name(std::string_view name) {
+  add(Kind::ThreadName, name);
+}
+
+void RecordingSink::Thread::zoneBegin(
+    TracyRecorder::StartZoneEvent<false> const &zone, uint64_t time) {
+  add(Kind::ZoneBegin, zone.name.empty() ? zone.function : zone.name,
+      zone.color, time);
+}
+
+void RecordingSink::Thread::zoneEnd(uint64_t time) {
+  add(Kind::ZoneEnd, {}, 0, time);
+}
+
+void RecordingSink::Thread::zoneText(std::string_view text) {
+  add(Kind::ZoneText, text);
+}
+
+void RecordingSink::Thread::zoneValue(uint64_t value) {
+  add(Kind::ZoneValue, {}, int64_t(value));
+}
+
+void RecordingSink::Thread::zoneColor(uint32_t color) {
+  add(Kind::ZoneColor, {}, color);
+}
+
+void RecordingSink::Thread::message(std::string_view message, uint32_t color,
+                                    uint64_t time) {
+  add(Kind::Message, message, color, time);
+}
+
+void RecordingSink::Thread::frameMark(
+    TracyRecorder::FrameMarkEvent<false> const &frameMark, uint64_t time) {
+  add(Kind::FrameMark, frameMark.name, int64_t(frameMark.kind), time);
+}
+
+void RecordingSink::Thread::fiberEnter(
+    TracyRecorder::FiberEnterEvent<false> const &fiber, uint64_t time) {
+  add(Kind::FiberEnter, fiber.name, int64_t(fiber.fiberId), time);
+}
+
+void RecordingSink::Thread::fiberLeave(uint64_t time) {
+  add(Kind::FiberLeave, {}, 0, time);
+}
+
+void RecordingSink::Thread::add(Kind kind, std::string_view text,
+                                int64_t value, uint64_t time) {
+  mSink.add({kind, mProcess, mThreadId, std::string(text), value, time});
+}
+
+void RecordingSink::plot(ProcessInfo const &process, std::string_view name,
+                         int64_t value, uint64_t time) {
+  add({Kind::Plot, process, 0, std::string(name), value, time});
+}
+
+std::vector<RecordingSink::Record> RecordingSink::records() const {
+  std::scoped_lock lock(mMutex);
+  return mRecords;
+}
+
+void RecordingSink::add(Record record) {
+  std::scoped_lock lock(mMutex);
+  mRecords.push_back(std::move(record));
+}
+} // namespace TracyPlayback
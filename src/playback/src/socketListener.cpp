@@ -0,0 +1,165 @@
+#include "socketListener.h"
+
+#include "socketAddress.h"
+
+#include <array>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace TracyPlayback {
+namespace {
+constexpr std::string_view playbackHeader{"TRCYPLAY\1\0\0\0", 12};
+// Connections with this much data waiting for the merge aren't read from until
+// it catches up. TCP flow control then pushes back on the producer.
+constexpr size_t maxQueuedBytes = 64 * 1024 * 1024;
+// Upper bound of what one connection may read per poll round, for fairness
+constexpr size_t maxReadPerRound = 1024 * 1024;
+} // namespace
+
+SocketListener::SocketListener(Playback &playback, std::string_view address)
+    : mPlayback(playback), mAddress(address) {
+  auto socketAddress = TracyRecorder::parseSocketAddress(address);
+  if (!socketAddress) {
+    throw std::runtime_error(std::format("Invalid address '{}'", address));
+  }
+
+  mSocket = socket(socketAddress->address.ss_family,
+                   SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (mSocket < 0) {
+    throw std::runtime_error(
+        std::format("Can't create socket for '{}'", address));
+  }
+
+  mUnixPath = socketAddress->path;
+  if (!mUnixPath.empty()) {
+    unlink(mUnixPath.c_str());
+  } else {
+    int reuse = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
+
+  if (bind(mSocket, reinterpret_cast<sockaddr *>(&socketAddress->address),
+           socketAddress->length) != 0 ||
+      listen(mSocket, SOMAXCONN) != 0) {
+    close(mSocket);
+    throw std::runtime_error(std::format("Can't listen on '{}'", address));
+  }
+
+  mIoThread = std::jthread(&SocketListener::ioThreadFunc, this);
+}
+
+SocketListener::~SocketListener() { stop(); }
+
+void SocketListener::stop() {
+  if (mIoThread.joinable()) {
+    mIoThread.request_stop();
+    mIoThread.join();
+  }
+  for (auto &connection : mConnections) {
+    close(connection.socket);
+    if (connection.buffer) {
+      connection.buffer->close();
+    }
+  }
+  mConnections.clear();
+  if (mSocket >= 0) {
+    close(mSocket);
+    mSocket = -1;
+    if (!mUnixPath.empty()) {
+      unlink(mUnixPath.c_str());
+    }
+  }
+}
+
+void SocketListener::ioThreadFunc(std::stop_token stopToken) {
+  std::vector<pollfd> pollFds;
+  while (!stopToken.stop_requested()) {
+    pollFds.clear();
+    pollFds.push_back(pollfd{mSocket, POLLIN, 0});
+    for (auto &connection : mConnections) {
+      bool full = connection.buffer &&
+                  connection.buffer->queuedBytes() > maxQueuedBytes;
+      pollFds.push_back(pollfd{connection.socket, short(full ? 0 : POLLIN), 0});
+    }
+
+    if (poll(pollFds.data(), pollFds.size(), 100) <= 0) {
+      continue;
+    }
+
+    if (pollFds[0].revents & POLLIN) {
+      accept();
+    }
+
+    // pollFds[i + 1] matches mConnections[i], accept() only appends
+    size_t index = 1;
+    std::erase_if(mConnections, [&](Connection &connection) {
+      auto revents = index < pollFds.size() ? pollFds[index].revents : 0;
+      ++index;
+      if (!(revents & (POLLIN | POLLHUP | POLLERR)) || receive(connection)) {
+        return false;
+      }
+      std::cout << std::format("Connection '{}' closed\n", connection.name);
+      close(connection.socket);
+      if (connection.buffer) {
+        connection.buffer->close();
+      }
+      return true;
+    });
+  }
+}
+
+void SocketListener::accept() {
+  while (true) {
+    int socket = accept4(mSocket, nullptr, nullptr,
+                         SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (socket < 0) {
+      return;
+    }
+    auto name = std::format("{}#{}", mAddress, ++mConnectionCount);
+    std::cout << std::format("Accepted connection '{}'\n", name);
+    mConnections.push_back(Connection{socket, std::move(name), {}, nullptr});
+  }
+}
+
+bool SocketListener::receive(Connection &connection) {
+  std::array<char, 64 * 1024> data;
+  size_t total = 0;
+  while (total < maxReadPerRound) {
+    auto received = recv(connection.socket, data.data(), data.size(), 0);
+    if (received == 0) {
+      return false;
+    }
+    if (received < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    total += received;
+
+    std::span<char const> payload(data.data(), received);
+    if (!connection.buffer) {
+      // The header is checked here, the playback only gets the events
+      auto missing = playbackHeader.size() - connection.header.size();
+      auto headerPart = payload.first(std::min(missing, payload.size()));
+      connection.header.append(headerPart.begin(), headerPart.end());
+      payload = payload.subspan(headerPart.size());
+      if (connection.header.size() < playbackHeader.size()) {
+        continue;
+      }
+      if (connection.header != playbackHeader) {
+        std::cout << std::format("Connection '{}' is not a playback stream\n",
+                                 connection.name);
+        return false;
+      }
+      connection.buffer = std::make_shared<LiveStreamBuffer>();
+      mPlayback.addStream(Playback::StreamInfo{
+          std::make_unique<LiveStream>(connection.buffer), connection.name});
+    }
+    connection.buffer->append(payload);
+  }
+  return true;
+}
+} // namespace TracyPlayback
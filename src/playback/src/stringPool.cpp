@@ -0,0 +1,8 @@
+#include "stringPool.h"
+
+namespace TracyPlayback {
+char const *StringPool::intern(std::string_view string) {
+  std::lock_guard lock(mMutex);
+  return mStrings.emplace(string).first->c_str();
+}
+} // namespace TracyPlayback
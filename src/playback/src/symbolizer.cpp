@@ -0,0 +1,193 @@
+#include "symbolizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <cxxabi.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#if __has_include(<elf.h>)
+#include <elf.h>
+#endif
+
+namespace TracyPlayback {
+namespace {
+std::string demangle(char const *name) {
+  int status = 0;
+  std::unique_ptr<char, decltype(&std::free)> demangled(
+      abi::__cxa_demangle(name, nullptr, nullptr, &status), &std::free);
+  return status == 0 && demangled ? demangled.get() : name;
+}
+
+// Function symbols of an ELF file, by address. Empty when the file can't be
+// read.
+class ElfSymbols {
+public:
+  explicit ElfSymbols(std::string const &path) {
+#if __has_include(<elf.h>)
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return;
+    }
+    file.seekg(0, std::ios::end);
+    mFileSize = file.tellg();
+    Elf64_Ehdr header;
+    if (!readAt(file, 0, &header, sizeof(header)) ||
+        std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+        header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_shentsize != sizeof(Elf64_Shdr)) {
+      return;
+    }
+    std::vector<Elf64_Shdr> sections(header.e_shnum);
+    if (!readAt(file, header.e_shoff, sections.data(),
+                sections.size() * sizeof(Elf64_Shdr))) {
+      return;
+    }
+    // The full table unless the file is stripped, the dynamic one otherwise
+    for (Elf64_Word type :
+         std::array<Elf64_Word, 2>{SHT_SYMTAB, SHT_DYNSYM}) {
+      for (auto &section : sections) {
+        if (section.sh_type == type && section.sh_link < sections.size() &&
+            section.sh_entsize == sizeof(Elf64_Sym)) {
+          addSymbols(file, section, sections[section.sh_link]);
+        }
+      }
+      if (!mSymbols.empty()) {
+        break;
+      }
+    }
+    std::ranges::sort(mSymbols, {}, &Symbol::address);
+#endif
+  }
+
+  // Demangled name of the function containing the address
+  std::optional<std::string> find(uint64_t address) const {
+    auto it = std::ranges::upper_bound(mSymbols, address, {}, &Symbol::address);
+    if (it == mSymbols.begin()) {
+      return std::nullopt;
+    }
+    --it;
+    if (it->size != 0 && address - it->address >= it->size) {
+      return std::nullopt;
+    }
+    return demangle(mNames.c_str() + it->name);
+  }
+
+private:
+  struct Symbol {
+    uint64_t address;
+    uint64_t size;
+    // Offset in mNames
+    size_t name;
+  };
+
+  bool readAt(std::ifstream &file, uint64_t offset, void *data,
+              uint64_t size) const {
+    if (offset > mFileSize || size > mFileSize - offset) {
+      return false;
+    }
+    file.clear();
+    file.seekg(offset);
+    file.read(static_cast<char *>(data), size);
+    return file.gcount() == std::streamsize(size);
+  }
+
+#if __has_include(<elf.h>)
+  void addSymbols(std::ifstream &file, Elf64_Shdr const &table,
+                  Elf64_Shdr const &strings) {
+    std::vector<Elf64_Sym> symbols(
+        std::min(table.sh_size, mFileSize) / sizeof(Elf64_Sym));
+    std::string names(std::min(strings.sh_size, mFileSize), '\0');
+    if (!readAt(file, table.sh_offset, symbols.data(),
+                symbols.size() * sizeof(Elf64_Sym)) ||
+        !readAt(file, strings.sh_offset, names.data(), names.size())) {
+      return;
+    }
+    // Names are looked up by offset, the table must end in a terminator
+    names += '\0';
+    auto namesStart = mNames.size();
+    mNames += names;
+    for (auto &symbol : symbols) {
+      if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_value != 0 &&
+          symbol.st_name < names.size()) {
+        mSymbols.push_back(
+            {symbol.st_value, symbol.st_size, namesStart + symbol.st_name});
+      }
+    }
+  }
+#endif
+
+  uint64_t mFileSize = 0;
+  std::vector<Symbol> mSymbols;
+  std::string mNames;
+};
+
+// Shared by all symbolizers, each file is only read once
+std::shared_ptr<ElfSymbols const> loadSymbols(std::string const &path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::shared_ptr<ElfSymbols const>>
+      cache;
+  std::scoped_lock lock(mutex);
+  auto &symbols = cache[path];
+  if (!symbols) {
+    symbols = std::make_shared<ElfSymbols const>(path);
+  }
+  return symbols;
+}
+} // namespace
+
+void Symbolizer::addModule(TracyRecorder::ModuleEvent<false> const &module) {
+  // Each thread records the modules it needs
+  auto known = [&module](auto const &other) {
+    return other.path == module.path && other.base == module.base &&
+           other.start == module.start && other.size == module.size;
+  };
+  if (std::ranges::none_of(mModules, known)) {
+    mModules.push_back(module);
+  }
+}
+
+void Symbolizer::addStack(TracyRecorder::StackFramesEvent<false> const &stack) {
+  mStacks[stack.stackId] = stack.frames;
+}
+
+std::vector<std::string> const &Symbolizer::frames(uint32_t stackId) {
+  if (auto resolved = mResolved.find(stackId); resolved != mResolved.end()) {
+    return resolved->second;
+  }
+  auto stack = mStacks.find(stackId);
+  if (stack == mStacks.end()) {
+    static std::vector<std::string> const undefined;
+    return undefined;
+  }
+  auto &resolved = mResolved[stackId];
+  for (auto address : stack->second) {
+    resolved.push_back(symbolize(address));
+  }
+  return resolved;
+}
+
+std::string Symbolizer::symbolize(uint64_t address) const {
+  // A module loaded later at the same addresses replaced the earlier one
+  auto module = std::ranges::find_if(
+      mModules.rbegin(), mModules.rend(), [address](auto const &module) {
+        return address - module.start < module.size;
+      });
+  if (module == mModules.rend()) {
+    return std::format("{:#x}", address);
+  }
+  auto name = std::filesystem::path(module->path).filename().string();
+  // Return addresses point past the call, which may end the function
+  if (auto function = loadSymbols(module->path)->find(address - 1 -
+                                                      module->base)) {
+    return std::format("{} ({})", *function, name);
+  }
+  return std::format("{}+{:#x}", name, address - module->base);
+}
+} // namespace TracyPlayback
@@ -0,0 +1,491 @@
+#include "traceExport.h"
+
+#include "eventStream.h"
+#include "symbolizer.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace TracyPlayback {
+namespace {
+// Hands encoded chunks from the encoders to the writing thread. Encoders
+// block while the queue is full.
+class ChunkQueue {
+public:
+  ChunkQueue(size_t maxBytes, unsigned producers)
+      : mMaxBytes(maxBytes), mProducers(producers) {}
+
+  void push(std::string &&chunk) {
+    if (chunk.empty()) {
+      return;
+    }
+    std::unique_lock lock(mMutex);
+    mCond.wait(lock, [this] { return mQueuedBytes < mMaxBytes; });
+    mQueuedBytes += chunk.size();
+    mQueue.push_back(std::move(chunk));
+    mCond.notify_all();
+  }
+
+  void producerDone() {
+    std::scoped_lock lock(mMutex);
+    --mProducers;
+    mCond.notify_all();
+  }
+
+  // Empty once all producers are done and the queue is drained
+  std::optional<std::string> pop() {
+    std::unique_lock lock(mMutex);
+    mCond.wait(lock, [this] { return !mQueue.empty() || mProducers == 0; });
+    if (mQueue.empty()) {
+      return std::nullopt;
+    }
+    auto chunk = std::move(mQueue.front());
+    mQueue.pop_front();
+    mQueuedBytes -= chunk.size();
+    mCond.notify_all();
+    return chunk;
+  }
+
+private:
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  std::deque<std::string> mQueue;
+  size_t mQueuedBytes = 0;
+  size_t const mMaxBytes;
+  unsigned mProducers;
+};
+
+std::string processName(Recording const &recording) {
+  return std::format("{} PID {}", recording.host, recording.processId);
+}
+
+std::string frameName(TracyRecorder::FrameMarkEvent<false> const &frame) {
+  std::string name = frame.name.empty() ? "Frame" : frame.name;
+  switch (frame.kind) {
+  case TracyRecorder::FrameMarkKind::Start:
+    return name + " start";
+  case TracyRecorder::FrameMarkKind::End:
+    return name + " end";
+  default:
+    return name;
+  }
+}
+
+// Recordings become processes numbered from one, PIDs of different hosts
+// would clash otherwise
+class ChromeJsonEncoder {
+public:
+  ChromeJsonEncoder(Recording const &recording, uint32_t index,
+                    uint64_t origin)
+      : mPid(index + 1), mOrigin(origin) {
+    event(std::format(R"("name":"process_name","ph":"M","pid":{},)"
+                      R"("args":{{"name":{}}})",
+                      mPid, quote(processName(recording))));
+  }
+
+  void zoneBegin(TracyRecorder::StartZoneEvent<false> const &zone,
+                 uint64_t time, std::span<std::string const> stack) {
+    event(std::format(
+        R"("name":{},"cat":"zone","ph":"B","ts":{},"pid":{},"tid":{},)"
+        R"("args":{{"function":{},"file":{},"line":{}{}}})",
+        quote(zone.name.empty() ? zone.function : zone.name),
+        timestamp(time), mPid, zone.threadId, quote(zone.function),
+        quote(zone.file), zone.line,
+        stack.empty() ? "" : "," + stackArgument(stack)));
+  }
+
+  void zoneEnd(uint64_t threadId, uint64_t time) {
+    event(std::format(R"("ph":"E","ts":{},"pid":{},"tid":{})",
+                      timestamp(time), mPid, threadId));
+  }
+
+  void instant(std::string_view name, uint64_t threadId, uint64_t time,
+               std::span<std::string const> stack) {
+    event(std::format(
+        R"("name":{},"ph":"i","s":"t","ts":{},"pid":{},"tid":{}{})",
+        quote(name), timestamp(time), mPid, threadId,
+        stack.empty() ? "" : R"(,"args":{)" + stackArgument(stack) + "}"));
+  }
+
+  void threadName(uint64_t threadId, std::string_view name) {
+    event(std::format(R"("name":"thread_name","ph":"M","pid":{},"tid":{},)"
+                      R"("args":{{"name":{}}})",
+                      mPid, threadId, quote(name)));
+  }
+
+  std::string &buffer() { return mOut; }
+
+private:
+  // Each event is preceded by a separator, the writer drops the first one
+  void event(std::string_view body) {
+    mOut += ",\n{";
+    mOut += body;
+    mOut += '}';
+  }
+
+  // Microseconds since the earliest recording, doubles lose the nanoseconds
+  // of absolute times
+  std::string timestamp(uint64_t time) const {
+    auto relative = time > mOrigin ? time - mOrigin : 0;
+    return std::format("{}.{:03}", relative / 1000, relative % 1000);
+  }
+
+  // Frames innermost first, viewers show arguments as they are
+  static std::string stackArgument(std::span<std::string const> stack) {
+    std::string argument = R"("stack":[)";
+    for (auto &frame : stack) {
+      argument += quote(frame);
+      argument += ',';
+    }
+    argument.back() = ']';
+    return argument;
+  }
+
+  static std::string quote(std::string_view text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (c < 0x20) {
+        quoted += std::format("\\u{:04x}", c);
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + '"';
+  }
+
+  uint32_t mPid;
+  uint64_t mOrigin;
+  std::string mOut;
+};
+
+// Minimal protobuf writer for the few TracePacket fields needed
+class ProtoMessage {
+public:
+  ProtoMessage &varint(uint32_t field, uint64_t value) {
+    writeVarint(uint64_t(field) << 3);
+    writeVarint(value);
+    return *this;
+  }
+
+  ProtoMessage &bytes(uint32_t field, std::string_view value) {
+    writeVarint(uint64_t(field) << 3 | 2);
+    writeVarint(value.size());
+    mData += value;
+    return *this;
+  }
+
+  ProtoMessage &message(uint32_t field, ProtoMessage const &value) {
+    return bytes(field, value.mData);
+  }
+
+  std::string const &data() const { return mData; }
+
+private:
+  void writeVarint(uint64_t value) {
+    while (value >= 0x80) {
+      mData += char(value | 0x80);
+      value >>= 7;
+    }
+    mData += char(value);
+  }
+
+  std::string mData;
+};
+
+// Field numbers from perfetto/trace/trace_packet.proto and friends
+namespace Proto {
+constexpr uint32_t tracePacket = 1;
+constexpr uint32_t packetTimestamp = 8;
+constexpr uint32_t packetSequenceId = 10;
+constexpr uint32_t packetTrackEvent = 11;
+constexpr uint32_t packetTrackDescriptor = 60;
+constexpr uint32_t trackEventType = 9;
+constexpr uint32_t trackEventTrackUuid = 11;
+constexpr uint32_t trackEventName = 23;
+constexpr uint32_t trackUuid = 1;
+constexpr uint32_t trackProcess = 3;
+constexpr uint32_t trackThread = 4;
+constexpr uint32_t processPid = 1;
+constexpr uint32_t processName = 6;
+constexpr uint32_t threadPid = 1;
+constexpr uint32_t threadTid = 2;
+constexpr uint32_t threadName = 5;
+constexpr uint64_t sliceBegin = 1;
+constexpr uint64_t sliceEnd = 2;
+constexpr uint64_t instant = 3;
+} // namespace Proto
+
+// Each recording is its own packet sequence and process. Thread IDs are too
+// wide for Perfetto, threads are numbered in order of appearance instead.
+class PerfettoEncoder {
+public:
+  PerfettoEncoder(Recording const &recording, uint32_t index, uint64_t)
+      : mPid(index + 1), mProcessUuid(uint64_t(index + 1) << 32) {
+    packet(ProtoMessage().message(
+        Proto::packetTrackDescriptor,
+        ProtoMessage()
+            .varint(Proto::trackUuid, mProcessUuid)
+            .message(Proto::trackProcess,
+                     ProtoMessage()
+                         .varint(Proto::processPid, mPid)
+                         .bytes(Proto::processName, processName(recording)))));
+  }
+
+  // Stacks would need interned callstacks, they are left out
+  void zoneBegin(TracyRecorder::StartZoneEvent<false> const &zone,
+                 uint64_t time, std::span<std::string const>) {
+    trackEvent(time, ProtoMessage()
+                         .varint(Proto::trackEventType, Proto::sliceBegin)
+                         .varint(Proto::trackEventTrackUuid,
+                                 threadTrack(zone.threadId))
+                         .bytes(Proto::trackEventName,
+                                zone.name.empty() ? zone.function : zone.name));
+  }
+
+  void zoneEnd(uint64_t threadId, uint64_t time) {
+    trackEvent(time,
+               ProtoMessage()
+                   .varint(Proto::trackEventType, Proto::sliceEnd)
+                   .varint(Proto::trackEventTrackUuid, threadTrack(threadId)));
+  }
+
+  void instant(std::string_view name, uint64_t threadId, uint64_t time,
+               std::span<std::string const>) {
+    trackEvent(time,
+               ProtoMessage()
+                   .varint(Proto::trackEventType, Proto::instant)
+                   .varint(Proto::trackEventTrackUuid, threadTrack(threadId))
+                   .bytes(Proto::trackEventName, name));
+  }
+
+  // A later descriptor for the same track updates its name
+  void threadName(uint64_t threadId, std::string_view name) {
+    threadDescriptor(threadTrack(threadId), name);
+  }
+
+  std::string &buffer() { return mOut; }
+
+private:
+  uint64_t threadTrack(uint64_t threadId) {
+    auto [it, added] = mThreads.try_emplace(
+        threadId, mProcessUuid | uint64_t(mThreads.size() + 1));
+    if (added) {
+      threadDescriptor(it->second,
+                       std::format("Thread {}", mThreads.size()));
+    }
+    return it->second;
+  }
+
+  void threadDescriptor(uint64_t uuid, std::string_view name) {
+    packet(ProtoMessage().message(
+        Proto::packetTrackDescriptor,
+        ProtoMessage()
+            .varint(Proto::trackUuid, uuid)
+            .message(Proto::trackThread,
+                     ProtoMessage()
+                         .varint(Proto::threadPid, mPid)
+                         .varint(Proto::threadTid, uuid & 0xFFFFFFFF)
+                         .bytes(Proto::threadName, name))));
+  }
+
+  void trackEvent(uint64_t time, ProtoMessage const &event) {
+    packet(ProtoMessage()
+               .varint(Proto::packetTimestamp, time)
+               .message(Proto::packetTrackEvent, event));
+  }
+
+  void packet(ProtoMessage packet) {
+    packet.varint(Proto::packetSequenceId, mPid);
+    mOut += ProtoMessage().message(Proto::tracePacket, packet).data();
+  }
+
+  uint32_t mPid;
+  uint64_t mProcessUuid;
+  std::unordered_map<uint64_t, uint64_t> mThreads;
+  std::string mOut;
+};
+
+template <class Encoder>
+void encodeRecording(Recording &recording, uint32_t index, uint64_t origin,
+                     ExportOptions const &options, ChunkQueue &queue) {
+  Encoder encoder(recording, index, origin);
+  auto inWindow = [&options](uint64_t time) {
+    return time >= options.beginTime && time < options.endTime;
+  };
+
+  // Per thread, whether each open zone was written
+  std::unordered_map<uint64_t, std::vector<bool>> openZones;
+  auto closeZones = [&](uint64_t threadId, uint64_t time) {
+    if (auto it = openZones.find(threadId); it != openZones.end()) {
+      for (auto &stack = it->second; !stack.empty(); stack.pop_back()) {
+        if (stack.back()) {
+          encoder.zoneEnd(threadId, time);
+        }
+      }
+      openZones.erase(it);
+    }
+  };
+  // Fibers get a track of their own, their zones may span threads. Recorded
+  // thread IDs never use the top bit.
+  constexpr uint64_t fiberTrack = uint64_t(1) << 63;
+  std::unordered_map<uint64_t, uint64_t> runningFibers;
+  std::unordered_set<uint64_t> namedFibers;
+  auto track = [&](uint64_t threadId) {
+    auto fiber = runningFibers.find(threadId);
+    return fiber != runningFibers.end() ? fiber->second : threadId;
+  };
+  // Stacks recorded for the next zone start or message of each thread
+  Symbolizer symbolizer;
+  std::unordered_map<uint64_t, uint32_t> pendingStacks;
+  auto takeStack = [&](uint64_t threadId) -> std::span<std::string const> {
+    auto node = pendingStacks.extract(threadId);
+    return node ? symbolizer.frames(node.mapped())
+                : std::span<std::string const>();
+  };
+  uint64_t lastTime = 0;
+  auto &events = recording.events;
+  while (events.state() == EventStream::State::Ready) {
+    auto time = events.getNanosecondsSincePosix();
+    lastTime = std::max(lastTime, time);
+    auto event = events.pop();
+    if (!event) {
+      break;
+    }
+    std::visit(
+        overloads{
+            [&](TracyRecorder::StartZoneEvent<false> &zone) {
+              auto stack = takeStack(zone.threadId);
+              zone.threadId = track(zone.threadId);
+              openZones[zone.threadId].push_back(inWindow(time));
+              if (inWindow(time)) {
+                encoder.zoneBegin(zone, time, stack);
+              }
+            },
+            [&](TracyRecorder::EndZoneEvent<false> const &zone) {
+              auto trackId = track(zone.threadId);
+              auto &stack = openZones[trackId];
+              if (stack.empty()) {
+                return;
+              }
+              if (stack.back()) {
+                encoder.zoneEnd(trackId, std::min(time, options.endTime));
+              }
+              stack.pop_back();
+            },
+            [&](TracyRecorder::FiberEnterEvent<false> const &fiber) {
+              auto trackId = fiber.fiberId | fiberTrack;
+              runningFibers[fiber.threadId] = trackId;
+              if (namedFibers.insert(trackId).second) {
+                encoder.threadName(trackId, fiber.name);
+              }
+            },
+            [&](TracyRecorder::FiberLeaveEvent<false> const &fiber) {
+              runningFibers.erase(fiber.threadId);
+            },
+            [&](TracyRecorder::MessageEvent<false> const &message) {
+              auto stack = takeStack(message.threadId);
+              if (inWindow(time)) {
+                encoder.instant(message.message, message.threadId, time,
+                                stack);
+              }
+            },
+            [&](TracyRecorder::FrameMarkEvent<false> const &frame) {
+              if (inWindow(time)) {
+                encoder.instant(frameName(frame), frame.threadId, time, {});
+              }
+            },
+            [&](TracyRecorder::ModuleEvent<false> const &module) {
+              symbolizer.addModule(module);
+            },
+            [&](TracyRecorder::StackFramesEvent<false> const &stack) {
+              symbolizer.addStack(stack);
+            },
+            [&](TracyRecorder::StackEvent<false> const &stack) {
+              pendingStacks[stack.threadId] = stack.stackId;
+            },
+            [&](TracyRecorder::ThreadNameEvent<false> const &thread) {
+              encoder.threadName(thread.threadId, thread.name);
+            },
+            [&](TracyRecorder::ThreadExitEvent<false> const &thread) {
+              closeZones(thread.threadId, std::min(time, options.endTime));
+              runningFibers.erase(thread.threadId);
+            },
+            [](auto const &) {}},
+        event->event);
+
+    if (encoder.buffer().size() >= options.chunkBytes) {
+      queue.push(std::move(encoder.buffer()));
+      encoder.buffer().clear();
+    }
+  }
+
+  // Zones the recording never closed end with it
+  while (!openZones.empty()) {
+    closeZones(openZones.begin()->first, std::min(lastTime, options.endTime));
+  }
+  queue.push(std::move(encoder.buffer()));
+}
+} // namespace
+
+void exportTrace(std::vector<StreamInfo> streams, std::ostream &out,
+                 ExportOptions const &options) {
+  auto recordings = openRecordings(std::move(streams));
+  uint64_t origin = std::numeric_limits<uint64_t>::max();
+  for (auto &recording : recordings) {
+    origin = std::min(origin, recording.events.getStartPosixTime());
+  }
+
+  auto threads = options.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min<size_t>(threads, std::max<size_t>(recordings.size(), 1));
+
+  ChunkQueue queue(options.maxQueuedBytes, threads);
+  std::atomic<size_t> next = 0;
+  std::vector<std::jthread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      for (size_t index = next++; index < recordings.size(); index = next++) {
+        if (options.format == ExportFormat::ChromeJson) {
+          encodeRecording<ChromeJsonEncoder>(recordings[index], index, origin,
+                                             options, queue);
+        } else {
+          encodeRecording<PerfettoEncoder>(recordings[index], index, origin,
+                                           options, queue);
+        }
+      }
+      queue.producerDone();
+    });
+  }
+
+  bool chrome = options.format == ExportFormat::ChromeJson;
+  bool first = true;
+  if (chrome) {
+    out << "{\"traceEvents\":[";
+  }
+  while (auto chunk = queue.pop()) {
+    // Drop the separator in front of the very first event
+    auto offset = chrome && first ? 1 : 0;
+    out.write(chunk->data() + offset, chunk->size() - offset);
+    first = false;
+  }
+  if (chrome) {
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  }
+}
+} // namespace TracyPlayback
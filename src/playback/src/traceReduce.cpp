@@ -0,0 +1,517 @@
+#include "traceReduce.h"
+
+#include "blockFormat.h"
+#include "eventReader.h"
+#include "rawEntries.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace TracyPlayback {
+namespace {
+constexpr std::string_view recordingHeader{"TRCYPLAY\1\0\0\0", 12};
+
+// Encoded events are written in blocks of about this size
+constexpr size_t writeChunkBytes = 64 * 1024;
+
+using StartZone = TracyRecorder::StartZoneEvent<false>;
+
+bool sameCallsite(StartZone const &a, StartZone const &b) {
+  return a.line == b.line && a.color == b.color && a.name == b.name &&
+         a.function == b.function && a.file == b.file;
+}
+
+// Short zones of one callsite that ended back to back in the same parent
+struct Run {
+  StartZone first;
+  uint64_t end = 0;
+  uint64_t count = 0;
+};
+
+struct Frame {
+  StartZone start;
+  // Recorded for the start, written right before it
+  std::optional<TracyRecorder::Event<false>> stack;
+  // Beyond the depth limit or starting past the window, dropped with its
+  // contents
+  bool dropped = false;
+  // Started before the window, only kept if still open once it begins
+  bool beforeWindow = false;
+  // The start is written and the zone kept. Always set on the root frame.
+  bool committed = false;
+  // Events inside the zone, held back until it is known to be kept
+  std::vector<TracyRecorder::Event<false>> pending;
+  Run run;
+};
+
+// Open zones of a thread, or of a fiber. Frame 0 stands for the thread or
+// fiber itself.
+struct Track {
+  std::vector<Frame> frames;
+
+  Track() { frames.emplace_back().committed = true; }
+};
+
+class Reducer {
+public:
+  Reducer(std::ostream &out, ReduceOptions const &options)
+      : mOut(out), mOptions(options) {}
+
+  void add(TracyRecorder::Event<false> &&event) {
+    ++mResult.eventsRead;
+    if (auto [threadId, time] = threadAndTime(event); time != 0) {
+      mTime = time;
+      mLatestTime = std::max(mLatestTime, time);
+    }
+    std::visit(
+        overloads{
+            [this](TracyRecorder::StartEvent<false> &start) {
+              mSyncTime = 0;
+              mSyncUnixTime = start.unixTime;
+            },
+            [this](TracyRecorder::ClockSyncEvent<false> &sync) {
+              mSyncTime = sync.time;
+              mSyncUnixTime = sync.unixTime;
+            },
+            [](auto &) {}},
+        event.event);
+
+    switch (event.type()) {
+    case TracyRecorder::EventType::StartZone: {
+      auto &start = std::get<StartZone>(event.event);
+      auto &track = trackOf(start.threadId);
+      commitExpired(track, start.time);
+      auto depth = track.frames.size();
+      auto &frame = track.frames.emplace_back();
+      frame.dropped = track.frames[depth - 1].dropped ||
+                      (mOptions.maxDepth != 0 && depth > mOptions.maxDepth) ||
+                      pastWindow(start.time);
+      frame.beforeWindow = unixTime(start.time) < mOptions.beginTime;
+      frame.start = std::move(start);
+      frame.stack = takeStack(frame.start.threadId);
+      if (frame.dropped) {
+        ++mResult.zonesDropped;
+      }
+      break;
+    }
+    case TracyRecorder::EventType::EndZone: {
+      auto &end = std::get<TracyRecorder::EndZoneEvent<false>>(event.event);
+      auto &track = trackOf(end.threadId);
+      commitExpired(track, end.time);
+      endZone(track, std::move(event));
+      break;
+    }
+    case TracyRecorder::EventType::Stack: {
+      // Goes wherever the thread's next zone start or message goes
+      auto [threadId, time] = threadAndTime(event);
+      mPendingStacks.insert_or_assign(threadId, std::move(event));
+      break;
+    }
+    case TracyRecorder::EventType::Message: {
+      auto [threadId, time] = threadAndTime(event);
+      auto &track = trackOf(threadId);
+      commitExpired(track, time);
+      auto stack = takeStack(threadId);
+      if (inWindow(time)) {
+        if (stack) {
+          emit(track, track.frames.size() - 1, std::move(*stack));
+        }
+        emit(track, track.frames.size() - 1, std::move(event));
+      }
+      break;
+    }
+    case TracyRecorder::EventType::ZoneText:
+    case TracyRecorder::EventType::ZoneValue:
+    case TracyRecorder::EventType::ZoneColor: {
+      auto [threadId, time] = threadAndTime(event);
+      auto &track = trackOf(threadId);
+      commitExpired(track, time);
+      if (inWindow(time)) {
+        emit(track, track.frames.size() - 1, std::move(event));
+      }
+      break;
+    }
+    case TracyRecorder::EventType::FrameMark: {
+      auto [threadId, time] = threadAndTime(event);
+      if (inWindow(time)) {
+        write(event);
+      }
+      break;
+    }
+    case TracyRecorder::EventType::ThreadExit:
+    case TracyRecorder::EventType::FiberEnter:
+    case TracyRecorder::EventType::FiberLeave: {
+      // The thread stops running its track, decide on everything it holds
+      // so events of another track don't overtake it
+      auto [threadId, time] = threadAndTime(event);
+      settle(trackOf(threadId), time);
+      switchTrack(threadId, event);
+      if (event.type() == TracyRecorder::EventType::ThreadExit) {
+        mPendingStacks.erase(threadId);
+      }
+      write(event);
+      break;
+    }
+    default:
+      write(event);
+    }
+  }
+
+  // Commits all zones still open
+  void finish() {
+    for (auto &[id, track] : mThreads) {
+      settle(track, mLatestTime);
+    }
+    for (auto &[id, track] : mFibers) {
+      settle(track, mLatestTime);
+    }
+    flushBuffer();
+  }
+
+  // Past the window with no kept zone left to end
+  bool done() const {
+    if (mSyncUnixTime == 0 || !pastWindow(mTime)) {
+      return false;
+    }
+    auto open = [](auto const &tracks) {
+      return std::ranges::any_of(tracks, [](auto const &entry) {
+        return entry.second.frames.size() > 1 &&
+               !entry.second.frames[1].dropped;
+      });
+    };
+    return !open(mThreads) && !open(mFibers);
+  }
+
+  ReduceResult const &result() const { return mResult; }
+
+private:
+  static std::pair<uint64_t, uint64_t>
+  threadAndTime(TracyRecorder::Event<false> const &event) {
+    return std::visit(
+        [](auto const &e) -> std::pair<uint64_t, uint64_t> {
+          if constexpr (requires { e.threadId; }) {
+            return {e.threadId, e.time};
+          } else {
+            return {0, 0};
+          }
+        },
+        event.event);
+  }
+
+  uint64_t unixTime(uint64_t time) const {
+    return mSyncUnixTime + time - mSyncTime;
+  }
+  bool inWindow(uint64_t time) const {
+    auto posixTime = unixTime(time);
+    return posixTime >= mOptions.beginTime && posixTime < mOptions.endTime;
+  }
+  bool pastWindow(uint64_t time) const {
+    return unixTime(time) >= mOptions.endTime;
+  }
+  // The zone overlaps the window if it is still open at this time
+  bool reachedWindow(Frame const &frame, uint64_t time) const {
+    return !frame.beforeWindow || unixTime(time) >= mOptions.beginTime;
+  }
+
+  Track &trackOf(uint64_t threadId) {
+    auto fiber = mRunningFibers.find(threadId);
+    if (fiber != mRunningFibers.end()) {
+      return mFibers[fiber->second];
+    }
+    return mThreads[threadId];
+  }
+
+  std::optional<TracyRecorder::Event<false>> takeStack(uint64_t threadId) {
+    auto node = mPendingStacks.extract(threadId);
+    if (!node) {
+      return std::nullopt;
+    }
+    return std::move(node.mapped());
+  }
+
+  void switchTrack(uint64_t threadId,
+                   TracyRecorder::Event<false> const &event) {
+    if (auto enter =
+            std::get_if<TracyRecorder::FiberEnterEvent<false>>(&event.event)) {
+      mRunningFibers[threadId] = enter->fiberId;
+      return;
+    }
+    mRunningFibers.erase(threadId);
+    if (event.type() == TracyRecorder::EventType::ThreadExit) {
+      mThreads.erase(threadId);
+    }
+  }
+
+  void write(TracyRecorder::Event<false> const &event) {
+    ++mResult.eventsWritten;
+    if (event.type() == TracyRecorder::EventType::Start) {
+      // Stays outside of blocks like the recorder's, discovery reads it
+      flushBuffer();
+      event.view().serialize(mBuffer);
+      mOut.write(reinterpret_cast<char const *>(mBuffer.data()),
+                 mBuffer.size());
+      mBuffer.clear();
+      return;
+    }
+    if (mBuffer.empty()) {
+      TracyRecorder::beginBlock(mBuffer);
+    }
+    event.view().serialize(mBuffer);
+    if (mBuffer.size() >= writeChunkBytes) {
+      flushBuffer();
+    }
+  }
+
+  void flushBuffer() {
+    if (mBuffer.empty()) {
+      return;
+    }
+    TracyRecorder::endBlock(mBuffer, 0);
+    mOut.write(reinterpret_cast<char const *>(mBuffer.data()),
+               mBuffer.size());
+    mBuffer.clear();
+  }
+
+  // Adds an event to the frame, written right away once the frame is kept
+  void emit(Track &track, size_t index, TracyRecorder::Event<false> &&event,
+            bool endRun = true) {
+    if (track.frames[index].dropped) {
+      return;
+    }
+    if (endRun) {
+      flushRun(track, index);
+    }
+    auto &frame = track.frames[index];
+    if (frame.committed) {
+      write(event);
+      return;
+    }
+    frame.pending.push_back(std::move(event));
+    if (frame.pending.size() > mOptions.maxPendingEvents) {
+      commit(track, index);
+    }
+  }
+
+  // Keeps the frame and its ancestors, writing what they held back
+  void commit(Track &track, size_t index) {
+    for (size_t i = 1; i <= index; ++i) {
+      if (track.frames[i].committed) {
+        continue;
+      }
+      flushRun(track, i - 1);
+      auto &frame = track.frames[i];
+      frame.committed = true;
+      if (frame.stack) {
+        write(*frame.stack);
+      }
+      write(frame.start);
+      for (auto &event : frame.pending) {
+        write(event);
+      }
+      frame.pending.clear();
+      frame.pending.shrink_to_fit();
+    }
+  }
+
+  // Zones open for at least the threshold are kept whatever happens next
+  void commitExpired(Track &track, uint64_t time) {
+    for (size_t i = track.frames.size() - 1; i > 0; --i) {
+      auto &frame = track.frames[i];
+      if (frame.committed) {
+        return;
+      }
+      if (!frame.dropped && reachedWindow(frame, time) &&
+          frame.start.time + mOptions.minDuration <= time) {
+        commit(track, i);
+        return;
+      }
+    }
+  }
+
+  void settle(Track &track, uint64_t time) {
+    for (size_t i = track.frames.size() - 1; i > 0; --i) {
+      if (!track.frames[i].dropped && reachedWindow(track.frames[i], time)) {
+        commit(track, i);
+        break;
+      }
+    }
+    for (size_t i = 0; i < track.frames.size(); ++i) {
+      flushRun(track, i);
+    }
+  }
+
+  // Writes the run of short zones in the frame as a single zone, valued with
+  // the number of zones. A lone short zone is dropped.
+  void flushRun(Track &track, size_t index) {
+    auto run = std::move(track.frames[index].run);
+    track.frames[index].run = Run{};
+    if (run.count == 0) {
+      return;
+    }
+    if (run.count == 1) {
+      ++mResult.zonesDropped;
+      return;
+    }
+    ++mResult.summaries;
+    mResult.zonesSummarized += run.count;
+    auto threadId = run.first.threadId;
+    auto time = run.first.time;
+    emit(track, index, TracyRecorder::Event<false>(std::move(run.first)),
+         false);
+    emit(track, index,
+         TracyRecorder::Event<false>(
+             TracyRecorder::ZoneValueEvent<false>(run.count, threadId, time)),
+         false);
+    emit(track, index,
+         TracyRecorder::Event<false>(
+             TracyRecorder::EndZoneEvent<false>(threadId, run.end)),
+         false);
+  }
+
+  void endZone(Track &track, TracyRecorder::Event<false> &&event) {
+    auto index = track.frames.size() - 1;
+    if (index == 0) {
+      // Closes a zone of an earlier segment
+      flushRun(track, 0);
+      write(event);
+      return;
+    }
+    auto time = std::get<TracyRecorder::EndZoneEvent<false>>(event.event).time;
+    auto &frame = track.frames[index];
+    if (frame.dropped) {
+      track.frames.pop_back();
+      return;
+    }
+    if (frame.committed) {
+      flushRun(track, index);
+      write(event);
+      track.frames.pop_back();
+      return;
+    }
+    if (!reachedWindow(frame, time)) {
+      ++mResult.zonesDropped;
+      track.frames.pop_back();
+      return;
+    }
+
+    auto start = std::move(frame.start);
+    track.frames.pop_back();
+    auto &run = track.frames.back().run;
+    if (run.count == 0 || !sameCallsite(run.first, start)) {
+      flushRun(track, index - 1);
+      run.first = std::move(start);
+      run.count = 0;
+    }
+    ++run.count;
+    run.end = time;
+  }
+
+  std::ostream &mOut;
+  ReduceOptions const &mOptions;
+  ReduceResult mResult;
+  std::vector<std::byte> mBuffer;
+
+  // Latest clock sync point, mapping recorded time to Unix time
+  uint64_t mSyncTime = 0;
+  uint64_t mSyncUnixTime = 0;
+  // Of the event being reduced, and the latest of any event so far
+  uint64_t mTime = 0;
+  uint64_t mLatestTime = 0;
+
+  std::unordered_map<uint64_t, Track> mThreads;
+  std::unordered_map<uint64_t, Track> mFibers;
+  std::unordered_map<uint64_t, uint64_t> mRunningFibers;
+  std::unordered_map<uint64_t, TracyRecorder::Event<false>> mPendingStacks;
+};
+
+// Output names matching the streams' file names, numbered when two streams
+// share a name
+std::vector<std::filesystem::path>
+outputPaths(std::vector<StreamInfo> const &streams,
+            std::filesystem::path const &outputDirectory) {
+  std::vector<std::filesystem::path> paths;
+  std::set<std::filesystem::path> taken;
+  for (size_t i = 0; i < streams.size(); ++i) {
+    auto name = std::filesystem::path(streams[i].second).filename();
+    auto path = outputDirectory / name;
+    for (size_t n = 1; !taken.insert(path).second; ++n) {
+      path = outputDirectory / name;
+      path += "." + std::to_string(n);
+    }
+    paths.push_back(std::move(path));
+  }
+  return paths;
+}
+} // namespace
+
+ReduceResult &ReduceResult::operator+=(ReduceResult const &other) {
+  eventsRead += other.eventsRead;
+  eventsWritten += other.eventsWritten;
+  zonesDropped += other.zonesDropped;
+  zonesSummarized += other.zonesSummarized;
+  summaries += other.summaries;
+  failed.insert(failed.end(), other.failed.begin(), other.failed.end());
+  return *this;
+}
+
+ReduceResult reduceTrace(std::istream &in, std::ostream &out,
+                         ReduceOptions const &options) {
+  out.write(recordingHeader.data(), recordingHeader.size());
+  Reducer reducer(out, options);
+  TracyRecorder::EventReader reader(in);
+  while (auto event = reader.next()) {
+    reducer.add(std::move(*event));
+    if (reducer.done()) {
+      break;
+    }
+  }
+  reducer.finish();
+  return reducer.result();
+}
+
+ReduceResult reduceTraces(std::vector<StreamInfo> streams,
+                          std::filesystem::path const &outputDirectory,
+                          ReduceOptions const &options) {
+  auto paths = outputPaths(streams, outputDirectory);
+
+  auto threads = options.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min<size_t>(threads, std::max<size_t>(streams.size(), 1));
+
+  ReduceResult total;
+  std::mutex totalMutex;
+  std::atomic<size_t> next = 0;
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+      workers.emplace_back([&] {
+        for (size_t index = next++; index < streams.size(); index = next++) {
+          ReduceResult result;
+          std::ofstream out(paths[index], std::ios::binary);
+          if (out) {
+            result = reduceTrace(*streams[index].first, out, options);
+          }
+          if (!out) {
+            result.failed.push_back(paths[index]);
+          }
+          // Release the input, it may hold a pooled file open
+          streams[index].first.reset();
+          std::scoped_lock lock(totalMutex);
+          total += result;
+        }
+      });
+    }
+  }
+  return total;
+}
+} // namespace TracyPlayback
@@ -0,0 +1,227 @@
+#include "tracySink.h"
+
+#include "stringPool.h"
+#include "threadGroupAllocator.h"
+
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <thread>
+#include <tracy/Tracy.hpp>
+
+namespace TracyPlayback {
+namespace {
+ThreadGroupAllocator &getThreadGroupAllocator() {
+  static ThreadGroupAllocator allocator;
+  return allocator;
+}
+
+StringPool &getStringPool() {
+  static StringPool pool;
+  return pool;
+}
+
+tracy::QueueType frameMarkQueueType(TracyRecorder::FrameMarkKind kind) {
+  switch (kind) {
+  case TracyRecorder::FrameMarkKind::Start:
+    return tracy::QueueType::FrameMarkMsgStart;
+  case TracyRecorder::FrameMarkKind::End:
+    return tracy::QueueType::FrameMarkMsgEnd;
+  case TracyRecorder::FrameMarkKind::Continuous:
+    break;
+  }
+  return tracy::QueueType::FrameMarkMsg;
+}
+
+#ifndef TRACY_FIBERS
+void warnFibersDisabled() {
+  static std::once_flag warned;
+  std::call_once(warned, [] {
+    std::cout << "Tracy was built without TRACY_FIBERS, fiber zones are "
+                 "shown on the threads running them\n";
+  });
+}
+#endif
+
+void queueZoneText(std::string_view text) {
+  using namespace tracy;
+  if (text.size() >= std::numeric_limits<uint16_t>::max()) {
+    std::cout << std::format("Zone text too long: {}\n", text);
+    return;
+  }
+
+  auto ptr = (char *)tracy_malloc(text.size());
+  memcpy(ptr, text.data(), text.size());
+
+  TracyQueuePrepare(QueueType::ZoneText);
+  MemWrite(&item->zoneTextFat.text, (uint64_t)ptr);
+  MemWrite(&item->zoneTextFat.size, (uint16_t)text.size());
+  TracyQueueCommit(zoneTextFatThread);
+}
+
+void queueMessage(std::string_view message, uint32_t color, uint64_t time) {
+  using namespace tracy;
+  auto ptr = (char *)tracy_malloc(message.size());
+  memcpy(ptr, message.data(), message.size());
+
+  if (message.size() > std::numeric_limits<uint16_t>::max()) {
+    std::cout << std::format("Message too long: {}\n", message);
+    return;
+  }
+
+  if (color == 0) {
+    TracyQueuePrepare(QueueType::Message);
+    MemWrite(&item->messageFat.time, time);
+    MemWrite(&item->messageFat.text, (uint64_t)ptr);
+    MemWrite(&item->messageFat.size, (uint16_t)message.size());
+    TracyQueueCommit(messageFatThread);
+  } else {
+    TracyQueuePrepare(QueueType::MessageColor);
+    MemWrite(&item->messageColorFat.time, time);
+    MemWrite(&item->messageColorFat.text, (uint64_t)ptr);
+    MemWrite(&item->messageColorFat.b, uint8_t((color) & 0xFF));
+    MemWrite(&item->messageColorFat.g, uint8_t((color >> 8) & 0xFF));
+    MemWrite(&item->messageColorFat.r, uint8_t((color >> 16) & 0xFF));
+    MemWrite(&item->messageColorFat.size, (uint16_t)message.size());
+    TracyQueueCommit(messageColorFatThread);
+  }
+}
+} // namespace
+
+TracySink::Thread::Thread(TracySink &, ProcessInfo const &process,
+                          uint64_t threadId)
+    : mProcess(process), mThreadId(threadId) {}
+
+TracySink::Thread::~Thread() {
+  if (!mNamed) {
+    auto newName = std::format("{}_{}_{}", mProcess.hostName,
+                               mProcess.processId, mThreadId);
+    tracy::SetThreadNameWithHint(
+        newName.c_str(), getThreadGroupAllocator().allocate(mProcess));
+  }
+}
+
+void TracySink::Thread::name(std::string_view name) {
+  auto newName = std::format("{}: {}_{}_{}", name, mProcess.hostName,
+                             mProcess.processId, mThreadId);
+  tracy::SetThreadNameWithHint(newName.c_str(),
+                               getThreadGroupAllocator().allocate(mProcess));
+  mNamed = true;
+}
+
+void TracySink::Thread::zoneBegin(
+    TracyRecorder::StartZoneEvent<false> const &zone, uint64_t time) {
+  using namespace tracy;
+  TracyQueuePrepare(QueueType::ZoneBeginAllocSrcLoc);
+  auto srcLocation = tracy::Profiler::AllocSourceLocation(
+      zone.line, zone.file.data(), zone.file.size(), zone.function.data(),
+      zone.function.size(), zone.name.data(), zone.name.size(), zone.color);
+  MemWrite(&item->zoneBegin.time, time);
+  MemWrite(&item->zoneBegin.srcloc, srcLocation);
+  TracyQueueCommit(zoneBeginThread);
+}
+
+void TracySink::Thread::zoneEnd(uint64_t time) {
+  using namespace tracy;
+  TracyQueuePrepare(QueueType::ZoneEnd);
+  MemWrite(&item->zoneEnd.time, time);
+  TracyQueueCommit(zoneEndThread);
+}
+
+void TracySink::Thread::zoneText(std::string_view text) {
+  queueZoneText(text);
+}
+
+void TracySink::Thread::zoneValue(uint64_t value) {
+  using namespace tracy;
+  TracyQueuePrepare(QueueType::ZoneValue);
+  MemWrite(&item->zoneValue.value, value);
+  TracyQueueCommit(zoneValueThread);
+}
+
+void TracySink::Thread::zoneColor(uint32_t color) {
+  using namespace tracy;
+  TracyQueuePrepare(QueueType::ZoneColor);
+  MemWrite(&item->zoneColor.b, uint8_t((color) & 0xFF));
+  MemWrite(&item->zoneColor.g, uint8_t((color >> 8) & 0xFF));
+  MemWrite(&item->zoneColor.r, uint8_t((color >> 16) & 0xFF));
+  TracyQueueCommit(zoneColorThread);
+}
+
+void TracySink::Thread::message(std::string_view message, uint32_t color,
+                                uint64_t time) {
+  queueMessage(message, color, time);
+}
+
+void TracySink::Thread::frameMark(
+    TracyRecorder::FrameMarkEvent<false> const &frameMark, uint64_t time) {
+  using namespace tracy;
+  // Frame sets are per process, so the same batch name recorded on several
+  // hosts shows up side by side in the frame graph.
+  auto name = getStringPool().intern(std::format(
+      "{}: {}_{}", frameMark.name.empty() ? "Frame" : frameMark.name,
+      mProcess.hostName, mProcess.processId));
+
+  // Frame marks travel through the serial queue, not the per-thread one, so
+  // they can't use TracyQueuePrepare.
+  auto item = Profiler::QueueSerial();
+  MemWrite(&item->hdr.type, frameMarkQueueType(frameMark.kind));
+  MemWrite(&item->frameMark.time, time);
+  MemWrite(&item->frameMark.name, uint64_t(name));
+  Profiler::QueueSerialFinish();
+}
+
+void TracySink::Thread::fiberEnter(
+    TracyRecorder::FiberEnterEvent<false> const &fiber, uint64_t time) {
+#ifdef TRACY_FIBERS
+  using namespace tracy;
+  // Tracy tells fibers apart by the address of their name
+  auto name = getStringPool().intern(
+      std::format("{} {}: {}_{}", fiber.name, fiber.fiberId,
+                  mProcess.hostName, mProcess.processId));
+  TracyQueuePrepare(QueueType::FiberEnter);
+  MemWrite(&item->fiberEnter.time, time);
+  MemWrite(&item->fiberEnter.fiber, uint64_t(name));
+  MemWrite(&item->fiberEnter.groupHint,
+           int32_t(getThreadGroupAllocator().allocate(mProcess)));
+  TracyQueueCommit(fiberEnter);
+#else
+  warnFibersDisabled();
+#endif
+}
+
+void TracySink::Thread::fiberLeave(uint64_t time) {
+#ifdef TRACY_FIBERS
+  using namespace tracy;
+  TracyQueuePrepare(QueueType::FiberLeave);
+  MemWrite(&item->fiberLeave.time, time);
+  TracyQueueCommit(fiberLeave);
+#endif
+}
+
+uint64_t TracySink::now() const { return tracy::Profiler::GetTime(); }
+
+long double TracySink::nanosecondScale() const {
+  static const long double scale = [] {
+    uint64_t const startTime = tracy::Profiler::GetTime();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t const endTime = tracy::Profiler::GetTime();
+    return (endTime - startTime) / static_cast<long double>(1e9);
+  }();
+  return scale;
+}
+
+// Self-reports of a recorder are plotted per process, they belong to no
+// thread
+void TracySink::plot(ProcessInfo const &process, std::string_view name,
+                     int64_t value, uint64_t time) {
+  using namespace tracy;
+  auto plotName = getStringPool().intern(
+      std::format("{} ({}:{})", name, process.hostName, process.processId));
+  TracyLfqPrepare(QueueType::PlotDataInt);
+  MemWrite(&item->plotDataInt.name, uint64_t(plotName));
+  MemWrite(&item->plotDataInt.time, int64_t(time));
+  MemWrite(&item->plotDataInt.val, value);
+  TracyLfqCommit;
+}
+} // namespace TracyPlayback
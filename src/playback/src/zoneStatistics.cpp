@@ -0,0 +1,369 @@
+#include "zoneStatistics.h"
+
+#include "eventStream.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <map>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+namespace TracyPlayback {
+namespace {
+// 32 linear sub-buckets per power of two, exact below 32ns
+constexpr unsigned subBucketBits = 5;
+constexpr uint64_t subBuckets = 1 << subBucketBits;
+
+size_t bucketIndex(uint64_t value) {
+  if (value < subBuckets) {
+    return value;
+  }
+  unsigned shift = std::bit_width(value) - subBucketBits - 1;
+  return (shift + 1) * subBuckets + ((value >> shift) & (subBuckets - 1));
+}
+
+uint64_t bucketValue(size_t index) {
+  if (index < subBuckets) {
+    return index;
+  }
+  unsigned shift = index / subBuckets - 1;
+  uint64_t lower = (subBuckets + index % subBuckets) << shift;
+  return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+struct Accumulator {
+  uint64_t count = 0;
+  uint64_t totalTime = 0;
+  uint64_t selfTime = 0;
+  uint64_t maxTime = 0;
+  uint64_t migrations = 0;
+  uint64_t countedZones = 0;
+  uint64_t countedTime = 0;
+  uint8_t counters = 0;
+  TracyRecorder::CounterValues counterTotals{};
+  std::vector<uint64_t> histogram;
+
+  void add(uint64_t duration, uint64_t self, bool migrated) {
+    ++count;
+    migrations += migrated;
+    totalTime += duration;
+    selfTime += self;
+    maxTime = std::max(maxTime, duration);
+    auto index = bucketIndex(duration);
+    if (index >= histogram.size()) {
+      histogram.resize(index + 1);
+    }
+    ++histogram[index];
+  }
+
+  void addCounters(uint64_t duration, uint8_t available,
+                   TracyRecorder::CounterValues const &deltas) {
+    ++countedZones;
+    countedTime += duration;
+    counters |= available;
+    for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+      counterTotals[i] += deltas[i];
+    }
+  }
+
+  std::optional<uint64_t> counterTotal(TracyRecorder::Counter counter) const {
+    if (!(counters & TracyRecorder::counterBit(counter))) {
+      return std::nullopt;
+    }
+    return counterTotals[size_t(counter)];
+  }
+
+  void merge(Accumulator const &other) {
+    count += other.count;
+    totalTime += other.totalTime;
+    selfTime += other.selfTime;
+    maxTime = std::max(maxTime, other.maxTime);
+    migrations += other.migrations;
+    countedZones += other.countedZones;
+    countedTime += other.countedTime;
+    counters |= other.counters;
+    for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+      counterTotals[i] += other.counterTotals[i];
+    }
+    if (other.histogram.size() > histogram.size()) {
+      histogram.resize(other.histogram.size());
+    }
+    for (size_t i = 0; i < other.histogram.size(); ++i) {
+      histogram[i] += other.histogram[i];
+    }
+  }
+
+  // Nearest rank, the smallest duration covering the fraction of zones
+  uint64_t percentile(double fraction) const {
+    auto rank = uint64_t(std::ceil(fraction * count));
+    rank = rank > 0 ? rank - 1 : 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i) {
+      seen += histogram[i];
+      if (seen > rank) {
+        return std::min(bucketValue(i), maxTime);
+      }
+    }
+    return maxTime;
+  }
+};
+
+// Name, function, file, line
+using CallSite = std::tuple<std::string, std::string, std::string, uint32_t>;
+using Accumulators = std::map<CallSite, Accumulator>;
+
+// CPU of a thread before any was recorded
+constexpr uint32_t unknownCpu = std::numeric_limits<uint32_t>::max();
+
+// Running totals of a thread's performance counters
+struct ThreadCounters {
+  TracyRecorder::CounterValues totals{};
+  uint8_t available = 0;
+  // Of the latest CountersEvent, which shares it with the zone event it
+  // was read for
+  uint64_t time = 0;
+};
+
+struct OpenZone {
+  Accumulator *accumulator;
+  uint64_t start;
+  uint64_t childTime;
+  uint32_t cpu;
+  // Counters read when the zone started on the thread
+  uint64_t threadId;
+  std::optional<ThreadCounters> counters;
+};
+
+void accumulate(EventStream &events, Accumulators &accumulators) {
+  std::unordered_map<uint64_t, std::vector<OpenZone>> threads;
+  // Zones in a fiber nest on the fiber, whichever thread runs it
+  std::unordered_map<uint64_t, std::vector<OpenZone>> fibers;
+  std::unordered_map<uint64_t, uint64_t> runningFibers;
+  std::unordered_map<uint64_t, uint32_t> cpus;
+  auto cpuOf = [&](uint64_t threadId) {
+    auto cpu = cpus.find(threadId);
+    return cpu != cpus.end() ? cpu->second : unknownCpu;
+  };
+  std::unordered_map<uint64_t, ThreadCounters> counters;
+  // Only counters read for the zone event itself belong to the zone
+  auto countersAt = [&](uint64_t threadId,
+                        uint64_t time) -> std::optional<ThreadCounters> {
+    auto thread = counters.find(threadId);
+    if (thread == counters.end() || thread->second.time != time) {
+      return std::nullopt;
+    }
+    return thread->second;
+  };
+  auto stackOf = [&](uint64_t threadId) -> std::vector<OpenZone> & {
+    auto fiber = runningFibers.find(threadId);
+    return fiber != runningFibers.end() ? fibers[fiber->second]
+                                        : threads[threadId];
+  };
+  while (auto event = events.pop()) {
+    std::visit(
+        overloads{
+            [&](TracyRecorder::StartZoneEvent<false> &zone) {
+              auto &accumulator = accumulators[CallSite{
+                  std::move(zone.name), std::move(zone.function),
+                  std::move(zone.file), zone.line}];
+              stackOf(zone.threadId)
+                  .push_back({&accumulator, zone.time, 0, cpuOf(zone.threadId),
+                              zone.threadId,
+                              countersAt(zone.threadId, zone.time)});
+            },
+            [&](TracyRecorder::EndZoneEvent<false> const &zone) {
+              auto &stack = stackOf(zone.threadId);
+              if (stack.empty()) {
+                return;
+              }
+              auto open = stack.back();
+              stack.pop_back();
+              auto duration = zone.time > open.start ? zone.time - open.start
+                                                     : 0;
+              auto cpu = cpuOf(zone.threadId);
+              open.accumulator->add(
+                  duration, duration - std::min(duration, open.childTime),
+                  open.cpu != unknownCpu && cpu != open.cpu);
+              // Fiber zones that moved threads aren't measured
+              auto end = countersAt(zone.threadId, zone.time);
+              if (open.counters && end && open.threadId == zone.threadId) {
+                TracyRecorder::CounterValues deltas;
+                for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+                  deltas[i] = end->totals[i] - open.counters->totals[i];
+                }
+                open.accumulator->addCounters(
+                    duration, open.counters->available & end->available,
+                    deltas);
+              }
+              if (!stack.empty()) {
+                stack.back().childTime += duration;
+              }
+            },
+            [&](TracyRecorder::CpuEvent<false> const &cpu) {
+              cpus[cpu.threadId] = cpu.cpu;
+            },
+            [&](TracyRecorder::CountersEvent<false> const &event) {
+              auto &thread = counters[event.threadId];
+              for (size_t i = 0; i < TracyRecorder::counterCount; ++i) {
+                thread.totals[i] += event.deltas[i];
+              }
+              thread.available = event.available;
+              thread.time = event.time;
+            },
+            [&](TracyRecorder::FiberEnterEvent<false> const &fiber) {
+              runningFibers[fiber.threadId] = fiber.fiberId;
+            },
+            [&](TracyRecorder::FiberLeaveEvent<false> const &fiber) {
+              runningFibers.erase(fiber.threadId);
+            },
+            [&](TracyRecorder::ThreadExitEvent<false> const &thread) {
+              threads.erase(thread.threadId);
+              cpus.erase(thread.threadId);
+              counters.erase(thread.threadId);
+              runningFibers.erase(thread.threadId);
+            },
+            [](auto const &) {}},
+        event->event);
+  }
+}
+} // namespace
+
+std::vector<ZoneStatistics>
+computeZoneStatistics(std::vector<StreamInfo> streams, unsigned threads) {
+  // Zones may span the segments of a rotated recording
+  auto recordings = openRecordings(std::move(streams));
+  std::vector<EventStream *> work;
+  for (auto &recording : recordings) {
+    work.push_back(&recording.events);
+  }
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min<size_t>(threads, std::max<size_t>(work.size(), 1));
+
+  std::vector<Accumulators> results(threads);
+  std::atomic<size_t> next = 0;
+  {
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+      workers.emplace_back([&work, &next, &accumulators = results[i]] {
+        for (size_t index = next++; index < work.size(); index = next++) {
+          accumulate(*work[index], accumulators);
+        }
+      });
+    }
+  }
+
+  for (size_t i = 1; i < results.size(); ++i) {
+    for (auto &[callSite, accumulator] : results[i]) {
+      results[0][callSite].merge(accumulator);
+    }
+  }
+
+  using TracyRecorder::Counter;
+  std::vector<ZoneStatistics> statistics;
+  for (auto &[callSite, accumulator] : results[0]) {
+    if (accumulator.count == 0) {
+      continue;
+    }
+    auto &[name, function, file, line] = callSite;
+    statistics.push_back({name, function, file, line, accumulator.count,
+                          accumulator.totalTime, accumulator.selfTime,
+                          accumulator.percentile(0.5),
+                          accumulator.percentile(0.99), accumulator.maxTime,
+                          accumulator.migrations, accumulator.countedZones,
+                          accumulator.countedTime,
+                          accumulator.counterTotal(Counter::Instructions),
+                          accumulator.counterTotal(Counter::Cycles),
+                          accumulator.counterTotal(Counter::CacheMisses),
+                          accumulator.counterTotal(Counter::ContextSwitches),
+                          accumulator.counterTotal(Counter::TaskClock)});
+  }
+  std::sort(statistics.begin(), statistics.end(),
+            [](ZoneStatistics const &a, ZoneStatistics const &b) {
+              return a.totalTime > b.totalTime;
+            });
+  return statistics;
+}
+
+void writeZoneStatisticsText(std::ostream &out,
+                             std::vector<ZoneStatistics> const &statistics) {
+  auto milliseconds = [](uint64_t nanoseconds) {
+    return std::format("{:.3f}", nanoseconds / 1e6);
+  };
+  // Dashes for counters no recording thread could read
+  auto perCall = [](ZoneStatistics const &zone,
+                    std::optional<uint64_t> total) {
+    if (!total) {
+      return std::string("-");
+    }
+    return std::format("{:.1f}", double(*total) / zone.countedZones);
+  };
+  auto ipc = [](ZoneStatistics const &zone) {
+    if (!zone.instructions || !zone.cycles || *zone.cycles == 0) {
+      return std::string("-");
+    }
+    return std::format("{:.2f}", double(*zone.instructions) / *zone.cycles);
+  };
+  auto onCpu = [](ZoneStatistics const &zone) {
+    if (!zone.taskClockTime || zone.countedTime == 0) {
+      return std::string("-");
+    }
+    return std::format("{:.0f}%",
+                       100.0 * *zone.taskClockTime / zone.countedTime);
+  };
+  out << std::format("{:<32} {:>10} {:>12} {:>12} {:>10} {:>10} {:>10} "
+                     "{:>10} {:>10} {:>6} {:>12} {:>10} {:>7}  {}\n",
+                     "Zone", "Count", "Total ms", "Self ms", "Mean ms",
+                     "P50 ms", "P99 ms", "Max ms", "Migrated", "IPC",
+                     "Misses/call", "CS/call", "On CPU", "Location");
+  for (auto &zone : statistics) {
+    out << std::format(
+        "{:<32} {:>10} {:>12} {:>12} {:>10} {:>10} {:>10} {:>10} {:>10} "
+        "{:>6} {:>12} {:>10} {:>7}  {}:{} {}\n",
+        zone.name.empty() ? zone.function : zone.name, zone.count,
+        milliseconds(zone.totalTime), milliseconds(zone.selfTime),
+        milliseconds(zone.meanTime()), milliseconds(zone.p50),
+        milliseconds(zone.p99), milliseconds(zone.maxTime), zone.migrations,
+        ipc(zone), perCall(zone, zone.cacheMisses),
+        perCall(zone, zone.contextSwitches), onCpu(zone), zone.file,
+        zone.line, zone.function);
+  }
+}
+
+void writeZoneStatisticsCsv(std::ostream &out,
+                            std::vector<ZoneStatistics> const &statistics) {
+  auto quote = [](std::string_view text) {
+    std::string quoted = "\"";
+    for (auto c : text) {
+      quoted += c == '"' ? "\"\"" : std::string(1, c);
+    }
+    return quoted + "\"";
+  };
+  // Counter totals cover the counted zones only, and are empty when no
+  // recording thread could read them
+  auto counter = [](std::optional<uint64_t> total) {
+    return total ? std::to_string(*total) : std::string();
+  };
+  out << "name,function,file,line,count,total_ns,self_ns,mean_ns,p50_ns,"
+         "p99_ns,max_ns,migrations,counted_zones,counted_ns,instructions,"
+         "cycles,cache_misses,context_switches,task_clock_ns\n";
+  for (auto &zone : statistics) {
+    out << std::format(
+        "{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{}\n",
+        quote(zone.name), quote(zone.function), quote(zone.file), zone.line,
+        zone.count, zone.totalTime, zone.selfTime, zone.meanTime(), zone.p50,
+        zone.p99, zone.maxTime, zone.migrations, zone.countedZones,
+        zone.countedTime, counter(zone.instructions), counter(zone.cycles),
+        counter(zone.cacheMisses), counter(zone.contextSwitches),
+        counter(zone.taskClockTime));
+  }
+}
+} // namespace TracyPlayback
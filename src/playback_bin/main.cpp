@@ -1,57 +1,233 @@
+#include "captureDiscovery.h"
+#include "filePool.h"
+#include "nullSink.h"
 #include "playback.h"
+#include "socketListener.h"
+#include "utilities.h"
+#include "zoneStatistics.h"
+#include <atomic>
+#include <csignal>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
 
-bool isPlaybackFile(std::ifstream &file) {
-  std::string_view header = "TRCYPLAY\1\0\0\0";
-  char magic[13] = {0};
-  file.read(magic, 12);
-  return file && std::string(magic, 12) == header;
+std::atomic<bool> stopListening = false;
+
+std::optional<std::chrono::milliseconds> parseMilliseconds(char const *text) {
+  auto milliseconds = parseNumber<uint64_t>(text);
+  if (!milliseconds) {
+    return std::nullopt;
+  }
+  return std::chrono::milliseconds(*milliseconds);
+}
+
+// One '<host> <offset ns>' pair per line, '#' starts a comment
+bool loadClockOffsets(TracyPlayback::Playback &playback,
+                      std::filesystem::path const &path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Failed to open clock offsets: " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line.substr(0, line.find('#')));
+    std::string host;
+    int64_t offset = 0;
+    if (!(fields >> host)) {
+      continue;
+    }
+    if (!(fields >> offset)) {
+      std::cerr << "Invalid clock offset line: " << line << std::endl;
+      return false;
+    }
+    playback.setHostClockOffset(host, offset);
+  }
+  return true;
 }
 
 int main(int argc, char **argv) {
   TracyPlayback::Playback playback;
 
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <trace file/dir>" << std::endl;
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " [--follow] [--max-latency-ms <ms>] [--idle-timeout-ms <ms>]"
+                 " [--listen unix:<path>|tcp:<host>:<port>]..."
+                 " [--clock-offsets <file>] [--read-ahead-threads <n>]"
+                 " [--max-open-files <n>] [--include <glob>]..."
+                 " [--exclude <glob>]... [--scan-threads <n>]"
+                 " [--progress-ms <ms>] [--progress-json] [--plots]"
+                 " [--log-events] [--null-sink]"
+                 " [--stats [--csv]]"
+                 " <trace file/dir>..."
+              << std::endl;
     return 1;
-  }
+  };
 
-  auto addFile = [&](std::filesystem::path const &path) {
-    auto file = std::make_unique<std::ifstream>(path, std::ios::binary);
-    if (!*file) {
-      std::cerr << "Failed to open file: " << path << std::endl;
-      return 1;
+  std::optional<TracyPlayback::FollowOptions> follow;
+  std::vector<std::filesystem::path> traceFiles;
+  std::vector<std::string> listenAddresses;
+  TracyPlayback::DiscoveryOptions discovery;
+  TracyPlayback::ProgressOptions progress;
+  bool stats = false;
+  bool csv = false;
+  bool nullSink = false;
+  unsigned maxOpenFiles = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view argument = argv[i];
+    if (argument == "--follow") {
+      follow = follow.value_or(TracyPlayback::FollowOptions{});
+    } else if (argument == "--max-latency-ms" ||
+               argument == "--idle-timeout-ms") {
+      auto value = i + 1 < argc ? parseMilliseconds(argv[++i]) : std::nullopt;
+      if (!value) {
+        return usage();
+      }
+      follow = follow.value_or(TracyPlayback::FollowOptions{});
+      (argument == "--max-latency-ms" ? follow->maxLatency
+                                      : follow->idleTimeout) = *value;
+    } else if (argument == "--listen") {
+      if (i + 1 >= argc) {
+        return usage();
+      }
+      listenAddresses.emplace_back(argv[++i]);
+      // Connections are always live
+      follow = follow.value_or(TracyPlayback::FollowOptions{});
+    } else if (argument == "--progress-ms") {
+      // Zero only reports once playback is done
+      auto value = i + 1 < argc ? parseMilliseconds(argv[++i]) : std::nullopt;
+      if (!value) {
+        return usage();
+      }
+      progress.interval = *value;
+    } else if (argument == "--progress-json") {
+      progress.format = TracyPlayback::ProgressFormat::Json;
+    } else if (argument == "--plots") {
+      progress.plots = true;
+    } else if (argument == "--log-events") {
+      progress.logEvents = true;
+    } else if (argument == "--null-sink") {
+      // Replays without sending anything, to measure playback on its own
+      nullSink = true;
+    } else if (argument == "--stats") {
+      stats = true;
+    } else if (argument == "--csv") {
+      csv = true;
+    } else if (argument == "--read-ahead-threads") {
+      // Zero decodes on the merge thread
+      auto value =
+          i + 1 < argc ? parseNumber<unsigned>(argv[++i]) : std::nullopt;
+      if (!value) {
+        return usage();
+      }
+      playback.setReadAhead(
+          *value ? std::optional(TracyPlayback::ReadAheadOptions{*value})
+                 : std::nullopt);
+    } else if (argument == "--include" || argument == "--exclude") {
+      if (i + 1 >= argc) {
+        return usage();
+      }
+      (argument == "--include" ? discovery.include : discovery.exclude)
+          .emplace_back(argv[++i]);
+    } else if (argument == "--scan-threads") {
+      auto value =
+          i + 1 < argc ? parseNumber<unsigned>(argv[++i]) : std::nullopt;
+      if (!value) {
+        return usage();
+      }
+      discovery.threads = *value;
+    } else if (argument == "--max-open-files") {
+      auto value =
+          i + 1 < argc ? parseNumber<unsigned>(argv[++i]) : std::nullopt;
+      if (!value) {
+        return usage();
+      }
+      maxOpenFiles = *value;
+    } else if (argument == "--clock-offsets") {
+      if (i + 1 >= argc || !loadClockOffsets(playback, argv[++i])) {
+        return usage();
+      }
+    } else {
+      traceFiles.emplace_back(argument);
     }
+  }
 
-    if (!isPlaybackFile(*file)) { // Skip non-playback files
-      return 0;
-    }
+  if (traceFiles.empty() && listenAddresses.empty()) {
+    return usage();
+  }
+  // Statistics are computed offline from complete files
+  if (stats && (follow || !listenAddresses.empty())) {
+    return usage();
+  }
 
-    std::cout << "Adding trace file: " << path << std::endl;
-    playback.addStream(
-        TracyPlayback::Playback::StreamInfo{std::move(file), path.string()});
+  if (follow) {
+    playback.setFollowMode(*follow);
+  }
+
+  // Capture directories can hold more files than may be open at once. Files
+  // are only kept open while they are read, within the budget.
+  auto files = TracyPlayback::FilePool::create(maxOpenFiles);
+  // Files being followed may not have their StartEvent written yet
+  discovery.requireStartEvent = !follow;
+  auto [streams, failed] =
+      TracyPlayback::discoverCaptures(traceFiles, discovery, *files);
+  for (auto &path : failed) {
+    std::cerr << "Failed to read capture: " << path << std::endl;
+  }
+  // Statistics go to stdout, keep it clean for them
+  (stats ? std::cerr : std::cout)
+      << "Found " << streams.size() << " captures" << std::endl;
+
+  if (stats) {
+    auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams));
+    if (csv) {
+      TracyPlayback::writeZoneStatisticsCsv(std::cout, statistics);
+    } else {
+      TracyPlayback::writeZoneStatisticsText(std::cout, statistics);
+    }
     return 0;
-  };
+  }
 
-  for (int i = 1; i < argc; ++i) {
-    std::string traceFile = argv[i];
-    if (std::filesystem::is_directory(traceFile)) {
-      for (auto &entry : std::filesystem::directory_iterator(traceFile)) {
-        if (entry.is_regular_file()) {
-          if (auto errCode = addFile(entry.path())) {
-            return errCode;
-          }
-        }
+  playback.addStreams(std::move(streams));
+
+  std::vector<std::unique_ptr<TracyPlayback::SocketListener>> listeners;
+  for (auto &address : listenAddresses) {
+    try {
+      listeners.push_back(
+          std::make_unique<TracyPlayback::SocketListener>(playback, address));
+      std::cout << "Listening on: " << address << std::endl;
+    } catch (std::runtime_error const &error) {
+      std::cerr << error.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // Listening runs until interrupted, then the open connections are closed
+  // and whatever they already sent is replayed
+  std::jthread listenerStopper;
+  if (!listeners.empty()) {
+    playback.setAcceptingStreams(true);
+    std::signal(SIGINT, [](int) { stopListening = true; });
+    std::signal(SIGTERM, [](int) { stopListening = true; });
+    listenerStopper = std::jthread([&](std::stop_token stopToken) {
+      while (!stopToken.stop_requested() && !stopListening) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
       }
-      continue;
-    } else {
-      if (auto errCode = addFile(std::filesystem::path(traceFile))) {
-        return errCode;
+      for (auto &listener : listeners) {
+        listener->stop();
       }
-    }
+      playback.setAcceptingStreams(false);
+    });
   }
 
-  playback.play(true);
-}
\ No newline at end of file
+  if (nullSink) {
+    TracyPlayback::NullSink sink;
+    playback.play(sink, progress);
+  } else {
+    playback.play(progress);
+  }
+}
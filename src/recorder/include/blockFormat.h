@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace TracyRecorder {
+// Past the recording header, each flush batch is framed as a block: a marker
+// that no event starts with, the payload size, a CRC32C of the payload and
+// one of the header itself. Readers check blocks before decoding them and
+// find the next block from any offset by searching for the marker.
+inline constexpr std::array<std::byte, 8> blockMarker = {
+    std::byte{0xff}, std::byte{'T'}, std::byte{'R'}, std::byte{'C'},
+    std::byte{'Y'},  std::byte{'B'}, std::byte{'L'}, std::byte{'K'}};
+constexpr size_t blockHeaderSize = blockMarker.size() + 3 * sizeof(uint32_t);
+
+// CRC-32C (Castagnoli), continuing from a previous result
+uint32_t crc32c(std::span<std::byte const> data, uint32_t crc = 0);
+
+// Reserves a block header at the end of the buffer and returns its offset.
+// Everything appended until endBlock is the payload.
+size_t beginBlock(std::vector<std::byte> &out);
+void endBlock(std::vector<std::byte> &out, size_t block);
+
+struct BlockHeader {
+  uint32_t size;
+  uint32_t checksum;
+};
+
+// Checks the marker and the header checksum
+std::optional<BlockHeader> parseBlockHeader(std::span<std::byte const> header);
+} // namespace TracyRecorder
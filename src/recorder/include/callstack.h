@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace TracyRecorder {
+// Walks the frame pointer chain of the calling thread and fills in return
+// addresses, innermost first. The first is the return address into the
+// caller, skip leaves out that many of the innermost frames. Returns how many
+// frames were filled in. The walk ends at the first frame built without a
+// frame pointer (-fno-omit-frame-pointer) or outside of the thread's stack,
+// so fibers running on stacks of their own capture nothing.
+size_t captureStack(std::span<uint64_t> frames, size_t skip);
+
+struct LoadedModule {
+  std::string path;
+  // Load bias, added to the addresses of the file's symbols
+  uint64_t base;
+  // Executable range
+  uint64_t start;
+  uint64_t size;
+};
+
+// Modules mapped into the process right now, the executable included
+std::vector<LoadedModule> loadedModules();
+} // namespace TracyRecorder
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace TracyRecorder {
+// Environment variable holding the initial category switches, in the syntax
+// of setCategories
+constexpr char const *categoriesVariable = "TRACY_RECORDER_CATEGORIES";
+
+// Named group of callsites switched on and off together at runtime. Meant to
+// be a function-local static at the callsite. Categories of the same name
+// share their switch, all switches sit together on a few cache lines.
+class Category {
+public:
+  // The default is overridden by the environment and by setCategories
+  explicit Category(std::string_view name, bool enabledByDefault = true);
+
+  bool enabled() const { return mEnabled->load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<bool> const *mEnabled;
+};
+
+// Switches the categories matching the pattern, including those registered
+// later. A pattern is a name or a name prefix followed by '*'. The switch goes
+// into the stream with the next flushed batch.
+void setCategoryEnabled(std::string_view pattern, bool enabled);
+
+// Comma separated patterns applied in order, enabling the category unless
+// prefixed with '-'. "-*,network,storage*" only enables network and the
+// storage categories.
+void setCategories(std::string_view switches);
+
+// Registered categories and whether they are enabled, sorted by name
+std::vector<std::pair<std::string, bool>> categories();
+} // namespace TracyRecorder
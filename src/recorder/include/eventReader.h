@@ -0,0 +1,63 @@
+#pragma once
+
+#include "rawEntries.h"
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <optional>
+
+namespace TracyRecorder {
+// Decodes the events of a recording stream positioned past its header.
+// Blocks (see blockFormat.h) are checked before any of their events are
+// returned, damaged ones are skipped by searching for the next marker.
+// Streams written before blocks existed decode event by event as before,
+// up to the first damage. The stream must be seekable.
+class EventReader {
+public:
+  // Stops at the first block starting at or past the end offset
+  explicit EventReader(std::istream &in,
+                       uint64_t end = std::numeric_limits<uint64_t>::max());
+  EventReader(EventReader &&) noexcept;
+  EventReader &operator=(EventReader &&) noexcept;
+  ~EventReader();
+
+  // Continues with the first block starting at or past the offset. Readers
+  // synced to offsets that split a file into ranges decode each block
+  // exactly once, so the parts can be decoded in parallel, see ReadAheadPool.
+  void syncTo(uint64_t offset);
+
+  // nullopt at the end of the stream or range. A block or event that is cut
+  // short is left unread, see incomplete().
+  std::optional<Event<false>> next();
+
+  // The last next() stopped at a block or event that was cut short, like the
+  // torn tail of a crashed recorder or a write still in progress. Calling
+  // next() again retries it.
+  bool incomplete() const { return mIncomplete; }
+
+  // Blocks failing their checksum, and bytes passed over while resyncing
+  uint64_t damagedBlocks() const { return mDamagedBlocks; }
+  uint64_t skippedBytes() const { return mSkippedBytes; }
+
+private:
+  struct Block;
+  enum class BlockState { Read, Incomplete, Damaged };
+
+  BlockState readBlock();
+  // Moves to the next marker at or past the offset, or to the end of the
+  // range. False when the data ended first.
+  bool resync(uint64_t from);
+
+  std::istream *mIn;
+  uint64_t mEnd;
+  // Events outside of blocks are only decoded before the first block and
+  // before any damage, after that the reader only trusts blocks
+  bool mUnframed = true;
+  bool mIncomplete = false;
+  uint64_t mDamagedBlocks = 0;
+  uint64_t mSkippedBytes = 0;
+  std::unique_ptr<Block> mBlock;
+};
+} // namespace TracyRecorder
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace TracyRecorder {
+struct FileSinkOptions {
+  // Segments are written next to it as <stem>.<index><extension>, e.g.
+  // trace.trcy becomes trace.000000.trcy, trace.000001.trcy, ...
+  std::filesystem::path path;
+  // Start a new segment once the current one would grow past this size or
+  // has been open this long. Zero disables the limit.
+  uint64_t maxSegmentBytes = 0;
+  std::chrono::seconds maxSegmentAge{0};
+  // Disk space is reserved in chunks of this size ahead of the writes
+  uint64_t preallocateBytes = 64 * 1024 * 1024;
+  // fdatasync period, zero leaves it to the kernel
+  std::chrono::milliseconds syncInterval{0};
+  // Batches arriving while this much data is still queued are dropped
+  size_t maxQueuedBytes = 256 * 1024 * 1024;
+};
+
+// Builds a flush callback that writes the recording to disk. The flush
+// thread only queues its batch, a background thread coalesces the queue into
+// pwritev calls. Every segment starts with the recording header, so each one
+// is a valid stream and playback chains them back together. Playback in
+// follow mode doesn't see segments opened after it started. Failing file
+// operations are reported on stderr, and the events of batches that couldn't
+// be written count as dropped in the recorder's metrics.
+std::function<void(std::vector<std::byte> const &)>
+makeFileSink(FileSinkOptions const &options);
+} // namespace TracyRecorder
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace TracyRecorder {
+struct MappedBufferOptions {
+  // Created or truncated, left in place after the process exits
+  std::filesystem::path path;
+  // Ring size of each recording thread
+  uint32_t ringBytes = 1024 * 1024;
+  // Threads beyond this many keep buffering in memory
+  uint32_t maxThreads = 64;
+};
+
+// File layout, shared with the playback recovery. The header page holds the
+// serialized StartEvent of the recording, the rings follow it, each behind a
+// small header with its positions. Positions count bytes since the ring was
+// created, the ring offset is the position modulo ringBytes.
+constexpr std::string_view mappedBufferMagic{"TRCYMMAP\1\0\0\0", 12};
+constexpr size_t mappedBufferHeaderBytes = 4096;
+constexpr size_t mappedRingHeaderBytes = 64;
+
+struct MappedBufferHeader {
+  char magic[12];
+  uint32_t ringBytes;
+  uint32_t ringCount;
+  uint32_t startEventBytes;
+};
+
+struct MappedRingHeader {
+  // Everything before committed holds complete events
+  uint64_t committed;
+  // Everything before consumed was handed to the flush callback
+  uint64_t consumed;
+};
+
+// Per-thread rings in a file-backed shared mapping. The kernel keeps
+// committed events in the page cache when the process dies, so playback can
+// recover the events that were recorded but not yet flushed.
+class MappedBuffer {
+public:
+  // Throws std::runtime_error when the file can't be created or mapped
+  MappedBuffer(MappedBufferOptions const &options,
+               std::span<std::byte const> startEvent);
+  ~MappedBuffer();
+  MappedBuffer(MappedBuffer const &) = delete;
+  MappedBuffer &operator=(MappedBuffer const &) = delete;
+
+  std::optional<uint32_t> acquireRing();
+  void releaseRing(uint32_t ring);
+  uint32_t ringBytes() const { return mRingBytes; }
+
+  // Only the thread owning the ring writes. Returns false while the ring is
+  // too full for the event.
+  bool write(uint32_t ring, std::span<std::byte const> event);
+  uint64_t committed(uint32_t ring) const;
+  uint64_t consumed(uint32_t ring) const;
+
+  // Flush thread only. Appends all committed events to out and returns the
+  // positions to pass to release once out has been handed over.
+  std::vector<uint64_t> drain(std::vector<std::byte> &out) const;
+  void release(std::vector<uint64_t> const &positions);
+
+private:
+  MappedRingHeader &ringHeader(uint32_t ring) const;
+  std::byte *ringData(uint32_t ring) const;
+
+  std::byte *mMapping = nullptr;
+  size_t mMappingBytes = 0;
+  uint32_t mRingBytes;
+  uint32_t mRingCount;
+
+  std::mutex mMutexFreeRings;
+  std::vector<uint32_t> mFreeRings;
+};
+} // namespace TracyRecorder
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "rawEntries.h"
+
+#include <array>
+#include <cstdint>
+
+namespace TracyRecorder {
+// Performance counters of the calling thread through perf_event, opened as
+// one group and read with a single syscall. Hardware counters need a PMU and
+// perf_event_paranoid allowing them, the software ones are counted either
+// way. Holds a descriptor per counter until destroyed.
+class PerfCounters {
+public:
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(PerfCounters const &) = delete;
+  PerfCounters &operator=(PerfCounters const &) = delete;
+
+  // Mask of the counters that could be opened, see counterBit
+  uint8_t available() const { return mAvailable; }
+
+  // Values since opening, zero for counters not available. False when the
+  // group couldn't be read.
+  bool read(CounterValues &values) const;
+
+private:
+  int mGroup = -1;
+  uint8_t mAvailable = 0;
+  // Counters in the order the group reports them
+  std::array<Counter, counterCount> mOrder{};
+  std::array<int, counterCount> mDescriptors;
+  size_t mOpened = 0;
+};
+} // namespace TracyRecorder
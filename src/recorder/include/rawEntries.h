@@ -1,9 +1,16 @@
 #pragma once
 
+#include "recorderMetrics.h"
+
+#include <algorithm>
+#include <array>
+#include <compare>
 #include <cstdint>
 #include <istream>
 #include <optional>
+#include <span>
 #include <string_view>
+#include <tuple>
 #include <variant>
 #include <vector>
 
@@ -19,6 +26,28 @@ enum class EventType {
   EndZone = 2,
   Message = 3,
   ThreadName = 4,
+  FrameMark = 5,
+  ZoneText = 6,
+  ZoneValue = 7,
+  ZoneColor = 8,
+  ClockSync = 9,
+  ThreadStart = 10,
+  ThreadExit = 11,
+  RecorderMetrics = 12,
+  Category = 13,
+  FiberEnter = 14,
+  FiberLeave = 15,
+  Cpu = 16,
+  Module = 17,
+  StackFrames = 18,
+  Stack = 19,
+  Counters = 20,
+};
+
+enum class FrameMarkKind : uint8_t {
+  Continuous = 0,
+  Start = 1,
+  End = 2,
 };
 
 template <EventType eventType, class Event, bool isOut> struct EventHeader;
@@ -175,10 +204,420 @@ struct ThreadNameEvent
   OutInString<isOut> name;
 };
 
+template <bool isOut>
+struct FrameMarkEvent
+    : public ThreadEvent<EventType::FrameMark, FrameMarkEvent<isOut>, isOut> {
+  FrameMarkEvent() = default;
+  FrameMarkEvent(OutInString<isOut> name, FrameMarkKind kind, uint64_t threadId,
+                 uint64_t time)
+      : ThreadEvent<EventType::FrameMark, FrameMarkEvent<isOut>, isOut>(
+            threadId, time),
+        name{name}, kind{kind} {}
+  FrameMarkEvent(FrameMarkEvent &&) = default;
+  FrameMarkEvent(FrameMarkEvent const &) = default;
+  FrameMarkEvent &operator=(FrameMarkEvent const &) = default;
+  FrameMarkEvent &operator=(FrameMarkEvent &&) = default;
+
+  bool operator==(FrameMarkEvent const &other) const = default;
+  auto operator<=>(FrameMarkEvent const &other) const = default;
+
+  OutInString<isOut> name;
+  FrameMarkKind kind;
+};
+
+template <bool isOut>
+struct ZoneTextEvent
+    : public ThreadEvent<EventType::ZoneText, ZoneTextEvent<isOut>, isOut> {
+  ZoneTextEvent() = default;
+  ZoneTextEvent(OutInString<isOut> text, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::ZoneText, ZoneTextEvent<isOut>, isOut>(threadId,
+                                                                      time),
+        text{text} {}
+  ZoneTextEvent(ZoneTextEvent &&) = default;
+  ZoneTextEvent(ZoneTextEvent const &) = default;
+  ZoneTextEvent &operator=(ZoneTextEvent const &) = default;
+  ZoneTextEvent &operator=(ZoneTextEvent &&) = default;
+
+  bool operator==(ZoneTextEvent const &other) const = default;
+  auto operator<=>(ZoneTextEvent const &other) const = default;
+
+  OutInString<isOut> text;
+};
+
+// The value is stored as a LEB128 varint, small numbers take a single byte.
+template <bool isOut>
+struct ZoneValueEvent
+    : public ThreadEvent<EventType::ZoneValue, ZoneValueEvent<isOut>, isOut> {
+  ZoneValueEvent() = default;
+  ZoneValueEvent(uint64_t value, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::ZoneValue, ZoneValueEvent<isOut>, isOut>(
+            threadId, time),
+        value{value} {}
+  ZoneValueEvent(ZoneValueEvent &&) = default;
+  ZoneValueEvent(ZoneValueEvent const &) = default;
+  ZoneValueEvent &operator=(ZoneValueEvent const &) = default;
+  ZoneValueEvent &operator=(ZoneValueEvent &&) = default;
+
+  bool operator==(ZoneValueEvent const &other) const = default;
+  auto operator<=>(ZoneValueEvent const &other) const = default;
+
+  uint64_t value;
+};
+
+template <bool isOut>
+struct ZoneColorEvent
+    : public ThreadEvent<EventType::ZoneColor, ZoneColorEvent<isOut>, isOut> {
+  ZoneColorEvent() = default;
+  ZoneColorEvent(uint32_t color, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::ZoneColor, ZoneColorEvent<isOut>, isOut>(
+            threadId, time),
+        color{color} {}
+  ZoneColorEvent(ZoneColorEvent &&) = default;
+  ZoneColorEvent(ZoneColorEvent const &) = default;
+  ZoneColorEvent &operator=(ZoneColorEvent const &) = default;
+  ZoneColorEvent &operator=(ZoneColorEvent &&) = default;
+
+  bool operator==(ZoneColorEvent const &other) const = default;
+  auto operator<=>(ZoneColorEvent const &other) const = default;
+
+  uint32_t color;
+};
+
+// Pairs the recording clock with the wall clock at one instant, so playback can
+// correct the drift between the two over long recordings
+template <bool isOut>
+struct ClockSyncEvent
+    : public EventHeader<EventType::ClockSync, ClockSyncEvent<isOut>, isOut> {
+  ClockSyncEvent() = default;
+  ClockSyncEvent(uint64_t time, uint64_t unixTime)
+      : time{time}, unixTime{unixTime} {}
+  ClockSyncEvent(ClockSyncEvent &&) = default;
+  ClockSyncEvent(ClockSyncEvent const &) = default;
+  ClockSyncEvent &operator=(ClockSyncEvent const &) = default;
+  ClockSyncEvent &operator=(ClockSyncEvent &&) = default;
+
+  bool operator==(ClockSyncEvent const &other) const = default;
+  auto operator<=>(ClockSyncEvent const &other) const = default;
+
+  uint64_t time;
+  uint64_t unixTime;
+};
+
+// First and last event of a recorded thread. Thread IDs are never reused,
+// playback releases the thread's state on exit.
+template <bool isOut>
+struct ThreadStartEvent
+    : public ThreadEvent<EventType::ThreadStart, ThreadStartEvent<isOut>,
+                         isOut> {
+  ThreadStartEvent() = default;
+  ThreadStartEvent(uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::ThreadStart, ThreadStartEvent<isOut>, isOut>(
+            threadId, time) {}
+  ThreadStartEvent(ThreadStartEvent &&) = default;
+  ThreadStartEvent(ThreadStartEvent const &) = default;
+  ThreadStartEvent &operator=(ThreadStartEvent const &) = default;
+  ThreadStartEvent &operator=(ThreadStartEvent &&) = default;
+
+  bool operator==(ThreadStartEvent const &other) const = default;
+  auto operator<=>(ThreadStartEvent const &other) const = default;
+};
+
+template <bool isOut>
+struct ThreadExitEvent
+    : public ThreadEvent<EventType::ThreadExit, ThreadExitEvent<isOut>, isOut> {
+  ThreadExitEvent() = default;
+  ThreadExitEvent(uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::ThreadExit, ThreadExitEvent<isOut>, isOut>(
+            threadId, time) {}
+  ThreadExitEvent(ThreadExitEvent &&) = default;
+  ThreadExitEvent(ThreadExitEvent const &) = default;
+  ThreadExitEvent &operator=(ThreadExitEvent const &) = default;
+  ThreadExitEvent &operator=(ThreadExitEvent &&) = default;
+
+  bool operator==(ThreadExitEvent const &other) const = default;
+  auto operator<=>(ThreadExitEvent const &other) const = default;
+};
+
+// Self-report of the recorder, written by a flush worker when enabled. The
+// gauges are sampled when the batch is written, the rest are totals.
+template <bool isOut>
+struct RecorderMetricsEvent
+    : public EventHeader<EventType::RecorderMetrics,
+                         RecorderMetricsEvent<isOut>, isOut> {
+  RecorderMetricsEvent() = default;
+  RecorderMetricsEvent(uint64_t time, RecorderMetrics const &metrics)
+      : time{time}, bufferedEvents{metrics.bufferedEvents},
+        bufferedBytes{metrics.bufferedBytes},
+        queuedEvents{metrics.queuedEvents},
+        flushedEvents{metrics.flushedEvents},
+        flushedBytes{metrics.flushedBytes}, flushBatches{metrics.flushBatches},
+        flushWaitNanoseconds{metrics.flushWaitNanoseconds},
+        outputNanoseconds{metrics.outputNanoseconds},
+        droppedEvents{metrics.droppedEvents},
+        largestBatchBytes{metrics.largestBatchBytes},
+        outputLatency{metrics.outputLatency}, flushWaits{metrics.flushWaits},
+        mappedFallbacks{metrics.mappedFallbacks} {}
+  RecorderMetricsEvent(RecorderMetricsEvent &&) = default;
+  RecorderMetricsEvent(RecorderMetricsEvent const &) = default;
+  RecorderMetricsEvent &operator=(RecorderMetricsEvent const &) = default;
+  RecorderMetricsEvent &operator=(RecorderMetricsEvent &&) = default;
+
+  bool operator==(RecorderMetricsEvent const &other) const = default;
+  auto operator<=>(RecorderMetricsEvent const &other) const = default;
+
+  uint64_t time;
+  uint64_t bufferedEvents;
+  uint64_t bufferedBytes;
+  uint64_t queuedEvents;
+  uint64_t flushedEvents;
+  uint64_t flushedBytes;
+  uint64_t flushBatches;
+  uint64_t flushWaitNanoseconds;
+  uint64_t outputNanoseconds;
+  uint64_t droppedEvents;
+  uint64_t largestBatchBytes;
+  std::array<uint64_t, outputLatencyBuckets> outputLatency;
+  uint64_t flushWaits;
+  uint64_t mappedFallbacks;
+};
+
+// State of an instrumentation category, written by a flush worker ahead of its
+// batch: every category at the start of a stream, then each registration and
+// switch. They belong to no recording thread, the thread ID is zero.
+template <bool isOut>
+struct CategoryEvent
+    : public ThreadEvent<EventType::Category, CategoryEvent<isOut>, isOut> {
+  CategoryEvent() = default;
+  CategoryEvent(OutInString<isOut> name, bool enabled, uint64_t threadId,
+                uint64_t time)
+      : ThreadEvent<EventType::Category, CategoryEvent<isOut>, isOut>(threadId,
+                                                                      time),
+        name{name}, enabled{enabled} {}
+  CategoryEvent(CategoryEvent &&) = default;
+  CategoryEvent(CategoryEvent const &) = default;
+  CategoryEvent &operator=(CategoryEvent const &) = default;
+  CategoryEvent &operator=(CategoryEvent &&) = default;
+
+  bool operator==(CategoryEvent const &other) const = default;
+  auto operator<=>(CategoryEvent const &other) const = default;
+
+  OutInString<isOut> name;
+  bool enabled;
+};
+
+// Until the matching leave, the thread runs the fiber and its zones belong to
+// the fiber. Fiber IDs are chosen by the application.
+//
+// A fiber left with zones open is handed over under an ID unique to the
+// recording, carried by the leave, or by the enter that switched away from
+// it, and by the enter continuing it. The threads' batches may be written in
+// either order, readers hold the continuing thread back until the handover.
+template <bool isOut>
+struct FiberEnterEvent
+    : public ThreadEvent<EventType::FiberEnter, FiberEnterEvent<isOut>, isOut> {
+  FiberEnterEvent() = default;
+  FiberEnterEvent(uint64_t fiberId, OutInString<isOut> name, uint64_t handover,
+                  uint64_t continues, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::FiberEnter, FiberEnterEvent<isOut>, isOut>(
+            threadId, time),
+        fiberId{fiberId}, name{name}, handover{handover},
+        continues{continues} {}
+  FiberEnterEvent(FiberEnterEvent &&) = default;
+  FiberEnterEvent(FiberEnterEvent const &) = default;
+  FiberEnterEvent &operator=(FiberEnterEvent const &) = default;
+  FiberEnterEvent &operator=(FiberEnterEvent &&) = default;
+
+  bool operator==(FiberEnterEvent const &other) const = default;
+  auto operator<=>(FiberEnterEvent const &other) const = default;
+
+  uint64_t fiberId;
+  OutInString<isOut> name;
+  // Of the fiber switched away from, zero if none was handed over
+  uint64_t handover;
+  // Of this fiber, zero if it had no zones open
+  uint64_t continues;
+};
+
+template <bool isOut>
+struct FiberLeaveEvent
+    : public ThreadEvent<EventType::FiberLeave, FiberLeaveEvent<isOut>, isOut> {
+  FiberLeaveEvent() = default;
+  FiberLeaveEvent(uint64_t handover, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::FiberLeave, FiberLeaveEvent<isOut>, isOut>(
+            threadId, time),
+        handover{handover} {}
+  FiberLeaveEvent(FiberLeaveEvent &&) = default;
+  FiberLeaveEvent(FiberLeaveEvent const &) = default;
+  FiberLeaveEvent &operator=(FiberLeaveEvent const &) = default;
+  FiberLeaveEvent &operator=(FiberLeaveEvent &&) = default;
+
+  bool operator==(FiberLeaveEvent const &other) const = default;
+  auto operator<=>(FiberLeaveEvent const &other) const = default;
+
+  // Zero if the fiber had no zones open
+  uint64_t handover;
+};
+
+// The CPU the thread runs on, recorded next to zone starts and ends when it
+// differs from the last one recorded for the thread
+template <bool isOut>
+struct CpuEvent : public ThreadEvent<EventType::Cpu, CpuEvent<isOut>, isOut> {
+  CpuEvent() = default;
+  CpuEvent(uint32_t cpu, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::Cpu, CpuEvent<isOut>, isOut>(threadId, time),
+        cpu{cpu} {}
+  CpuEvent(CpuEvent &&) = default;
+  CpuEvent(CpuEvent const &) = default;
+  CpuEvent &operator=(CpuEvent const &) = default;
+  CpuEvent &operator=(CpuEvent &&) = default;
+
+  bool operator==(CpuEvent const &other) const = default;
+  auto operator<=>(CpuEvent const &other) const = default;
+
+  uint32_t cpu;
+};
+
+// A module loaded into the recording process, for symbolizing stack frames
+// offline. Addresses from start to start + size belong to it, the symbols of
+// the file are offset by base.
+template <bool isOut>
+struct ModuleEvent
+    : public ThreadEvent<EventType::Module, ModuleEvent<isOut>, isOut> {
+  ModuleEvent() = default;
+  ModuleEvent(OutInString<isOut> path, uint64_t base, uint64_t start,
+              uint64_t size, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::Module, ModuleEvent<isOut>, isOut>(threadId,
+                                                                  time),
+        path{path}, base{base}, start{start}, size{size} {}
+  ModuleEvent(ModuleEvent &&) = default;
+  ModuleEvent(ModuleEvent const &) = default;
+  ModuleEvent &operator=(ModuleEvent const &) = default;
+  ModuleEvent &operator=(ModuleEvent &&) = default;
+
+  bool operator==(ModuleEvent const &other) const = default;
+  auto operator<=>(ModuleEvent const &other) const = default;
+
+  OutInString<isOut> path;
+  uint64_t base;
+  uint64_t start;
+  uint64_t size;
+};
+
+// Deepest stack recorded, frames past it are cut off
+constexpr size_t maxStackFrames = 64;
+
+template <bool isOut>
+using OutInFrames = std::conditional_t<isOut, std::span<uint64_t const>,
+                                       std::vector<uint64_t>>;
+
+// Defines an interned stack, by return addresses innermost first. A thread
+// defines each stack it uses once, before its first StackEvent, after the
+// ModuleEvents covering the frames.
+template <bool isOut>
+struct StackFramesEvent
+    : public ThreadEvent<EventType::StackFrames, StackFramesEvent<isOut>,
+                         isOut> {
+  StackFramesEvent() = default;
+  StackFramesEvent(uint32_t stackId, OutInFrames<isOut> frames,
+                   uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::StackFrames, StackFramesEvent<isOut>, isOut>(
+            threadId, time),
+        stackId{stackId}, frames{frames} {}
+  StackFramesEvent(StackFramesEvent &&) = default;
+  StackFramesEvent(StackFramesEvent const &) = default;
+  StackFramesEvent &operator=(StackFramesEvent const &) = default;
+  StackFramesEvent &operator=(StackFramesEvent &&) = default;
+
+  // Spans don't compare, the frames are compared by value
+  bool operator==(StackFramesEvent const &other) const {
+    return this->threadId == other.threadId && this->time == other.time &&
+           stackId == other.stackId && std::ranges::equal(frames, other.frames);
+  }
+  std::strong_ordering operator<=>(StackFramesEvent const &other) const {
+    auto order = std::tie(this->threadId, this->time, stackId) <=>
+                 std::tie(other.threadId, other.time, other.stackId);
+    if (order != 0) {
+      return order;
+    }
+    return std::lexicographical_compare_three_way(
+        frames.begin(), frames.end(), other.frames.begin(), other.frames.end());
+  }
+
+  uint32_t stackId;
+  OutInFrames<isOut> frames;
+};
+
+// Stack of the thread's next zone start or message
+template <bool isOut>
+struct StackEvent
+    : public ThreadEvent<EventType::Stack, StackEvent<isOut>, isOut> {
+  StackEvent() = default;
+  StackEvent(uint32_t stackId, uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::Stack, StackEvent<isOut>, isOut>(threadId, time),
+        stackId{stackId} {}
+  StackEvent(StackEvent &&) = default;
+  StackEvent(StackEvent const &) = default;
+  StackEvent &operator=(StackEvent const &) = default;
+  StackEvent &operator=(StackEvent &&) = default;
+
+  bool operator==(StackEvent const &other) const = default;
+  auto operator<=>(StackEvent const &other) const = default;
+
+  uint32_t stackId;
+};
+
+// Performance counters of a thread, bit positions in CountersEvent masks
+enum class Counter : uint8_t {
+  Instructions = 0,
+  Cycles = 1,
+  CacheMisses = 2,
+  ContextSwitches = 3,
+  // Nanoseconds on the CPU
+  TaskClock = 4,
+};
+constexpr size_t counterCount = 5;
+using CounterValues = std::array<uint64_t, counterCount>;
+
+constexpr uint8_t counterBit(Counter counter) {
+  return uint8_t(1) << uint8_t(counter);
+}
+
+// Increase of the thread's counters since its previous CountersEvent,
+// recorded next to zone starts and ends with the same time. Only the
+// counters in the mask could be opened, the others stay zero.
+template <bool isOut>
+struct CountersEvent
+    : public ThreadEvent<EventType::Counters, CountersEvent<isOut>, isOut> {
+  CountersEvent() = default;
+  CountersEvent(uint8_t available, CounterValues const &deltas,
+                uint64_t threadId, uint64_t time)
+      : ThreadEvent<EventType::Counters, CountersEvent<isOut>, isOut>(threadId,
+                                                                      time),
+        available{available}, deltas{deltas} {}
+  CountersEvent(CountersEvent &&) = default;
+  CountersEvent(CountersEvent const &) = default;
+  CountersEvent &operator=(CountersEvent const &) = default;
+  CountersEvent &operator=(CountersEvent &&) = default;
+
+  bool operator==(CountersEvent const &other) const = default;
+  auto operator<=>(CountersEvent const &other) const = default;
+
+  uint8_t available;
+  CounterValues deltas;
+};
+
 template <bool isOut>
 using AllEvents =
     std::variant<StartEvent<isOut>, StartZoneEvent<isOut>, EndZoneEvent<isOut>,
-                 MessageEvent<isOut>, ThreadNameEvent<isOut>>;
+                 MessageEvent<isOut>, ThreadNameEvent<isOut>,
+                 FrameMarkEvent<isOut>, ZoneTextEvent<isOut>,
+                 ZoneValueEvent<isOut>, ZoneColorEvent<isOut>,
+                 ClockSyncEvent<isOut>, ThreadStartEvent<isOut>,
+                 ThreadExitEvent<isOut>, RecorderMetricsEvent<isOut>,
+                 CategoryEvent<isOut>, FiberEnterEvent<isOut>,
+                 FiberLeaveEvent<isOut>, CpuEvent<isOut>, ModuleEvent<isOut>,
+                 StackFramesEvent<isOut>, StackEvent<isOut>,
+                 CountersEvent<isOut>>;
 
 template <bool isOut> struct EventCommon {
   AllEvents<isOut> event;
@@ -229,6 +668,10 @@ template <> struct Event<false> : EventCommon<false> {
   auto operator<=>(Event const &other) const = default;
 
   static std::optional<Event> deserialize(std::istream &data);
+
+  // Refers to the strings of this event, which must outlive the result. Used
+  // to write decoded events out again.
+  Event<true> view() const;
 };
 
 template <bool isOut, template <bool> class SpecificEvent>
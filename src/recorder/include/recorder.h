@@ -1,7 +1,13 @@
 #pragma once
 
+#include "categories.h"
+#include "mappedBuffer.h"
+#include "recorderMetrics.h"
+
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <optional>
 #include <string_view>
 #include <vector>
 
@@ -11,11 +17,124 @@ void setFlushCallback(
 
 void flush();
 
+// Number of flush workers, each serializing the events of the threads started
+// on its share of the CPUs. Threads sharing a CPU with several workers are
+// dealt out among them. A thread keeps its worker until the next
+// setFlushCallback, which this takes effect with. Zero picks one per 16 cores,
+// the default.
+void setFlushShards(unsigned shards);
+
+// Records into per-thread rings of a file-backed shared mapping instead of
+// memory, so the events not flushed yet survive a crash of the process. The
+// flush callback still receives everything. Pass nullopt to stop using the
+// mapping. Throws std::runtime_error when the mapping can't be created.
+void setMappedBuffer(std::optional<MappedBufferOptions> const &options);
+
+// How often the flush thread records a clock sync point, one second by
+// default
+void setClockSyncInterval(std::chrono::milliseconds interval);
+
+// Snapshot of the recorder's own counters, cheap enough to poll. Neither
+// reading them nor the recording threads updating them take locks.
+RecorderMetrics metrics();
+
+// Buffer occupancy and flush shard of the calling thread
+ThreadMetrics threadMetrics();
+
+// For flush callbacks that discard events they were handed, such as a sink
+// falling behind, so they show up in the metrics' droppedEvents
+void countDroppedEvents(uint64_t count);
+
+// How often a flush worker records the metrics into the stream, disabled (the
+// default) with zero
+void setMetricsInterval(std::chrono::milliseconds interval);
+
+// Records the CPU a thread runs on at zone starts and ends, whenever it
+// changed since the thread's last record, so migrations in the middle of a
+// zone can be found. Off by default. While on, each zone start and end pays
+// for a sched_getcpu, which glibc answers from rseq without a syscall.
+void setCpuTracking(bool enabled);
+
+// Reads the thread's performance counters at zone starts and ends and records
+// how much they grew, so playback can tell cache-miss bound zones from
+// descheduled ones. Off by default. Threads open their counters on their first
+// zone boundary with this on and keep them open, hardware counters the system
+// doesn't allow are left out while the software ones are still counted. The
+// first boundary after turning it on records no growth, nothing counted while
+// off is attributed to a zone. While on, each zone start and end pays for a
+// read syscall.
+void setPerfCounters(bool enabled);
+
+// ID of the calling thread in recorded events, stable for the thread's
+// lifetime and never reused by another thread of the process
+uint64_t threadId();
+
+// Thread names, zone text and messages are copied when recorded, the caller
+// may release them right after the call. The copies are kept in a per-thread
+// arena until the thread flushes.
 void nameThread(std::string_view name);
 
 void zoneStart(uint32_t line, std::string_view file, std::string_view function,
                std::string_view name, uint32_t color);
 void zoneEnd();
 
+// Zones recorded between fiberEnter and fiberLeave belong to the fiber, a
+// logical task such as a coroutine that may resume on any thread, instead of
+// the thread. A zone started in a fiber may end on another thread running
+// it. The application picks the fiber IDs, the name labels the fiber and is
+// referenced until flushed. Entering another fiber switches to it.
+void fiberEnter(uint64_t fiberId, std::string_view name);
+void fiberLeave();
+
+// Annotate the innermost open zone of the calling thread. Calls made outside
+// of a zone are dropped.
+void zoneText(std::string_view text);
+void zoneValue(uint64_t value);
+void zoneColor(uint32_t color);
+
 void message(std::string_view message, uint32_t color);
+// Skips the copy, for text that outlives the next flush such as a string
+// literal
+void messageLiteral(std::string_view message, uint32_t color);
+
+// Variants recording the caller's stack as well, for callsites whose callers
+// matter. Stacks are walked through frame pointers, code built without them
+// cuts the stack short. A thread stores each unique stack in the stream once,
+// later captures of it only cost an ID. Playback symbolizes the frames from
+// the modules on disk.
+void zoneStartWithStack(uint32_t line, std::string_view file,
+                        std::string_view function, std::string_view name,
+                        uint32_t color);
+void messageWithStack(std::string_view message, uint32_t color);
+
+// Frame marks are grouped by name. An empty name marks the default frame set.
+void frameMark(std::string_view name);
+// Discontinuous frames, for work that does not run back to back.
+void frameMarkStart(std::string_view name);
+void frameMarkEnd(std::string_view name);
+
+// Variants of a category, recording nothing while it is disabled. The zone is
+// only closed when it was started, so switching the category in between
+// leaves the thread's zones balanced.
+inline bool zoneStart(Category const &category, uint32_t line,
+                      std::string_view file, std::string_view function,
+                      std::string_view name, uint32_t color) {
+  if (!category.enabled()) {
+    return false;
+  }
+  zoneStart(line, file, function, name, color);
+  return true;
+}
+inline void zoneEnd(bool started) {
+  if (started) {
+    zoneEnd();
+  }
+}
+
+inline void message(Category const &category, std::string_view text,
+                    uint32_t color) {
+  if (category.enabled()) {
+    message(text, color);
+  }
+}
 } // namespace TracyRecorder
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TracyRecorder {
+// Bucket i counts flush callbacks that took less than 2^i microseconds, the
+// last bucket everything slower
+constexpr size_t outputLatencyBuckets = 16;
+
+struct ThreadMetrics {
+  uint64_t threadId = 0;
+  // Recorded by the thread but not handed to a flush worker yet
+  uint64_t bufferedEvents = 0;
+  // Memory held by the buffered events and the text copied for them, plus the
+  // unconsumed part of the thread's mapped ring
+  uint64_t bufferedBytes = 0;
+  // Flush worker taking the thread's events, see setFlushShards
+  unsigned shard = 0;
+};
+
+// Counters of the recorder itself. Buffered and queued counts are a snapshot,
+// everything else is a total since the process started.
+struct RecorderMetrics {
+  uint64_t bufferedEvents = 0;
+  uint64_t bufferedBytes = 0;
+  // Handed to the flush workers but not written to the callback yet
+  uint64_t queuedEvents = 0;
+
+  uint64_t flushedEvents = 0;
+  uint64_t flushedBytes = 0;
+  uint64_t flushBatches = 0;
+  uint64_t largestBatchBytes = 0;
+  uint64_t outputNanoseconds = 0;
+  std::array<uint64_t, outputLatencyBuckets> outputLatency{};
+
+  // Threads blocked in flush() or on a full mapped ring, and for how long
+  uint64_t flushWaits = 0;
+  uint64_t flushWaitNanoseconds = 0;
+
+  // Events buffered in memory because their mapped ring couldn't take them
+  uint64_t mappedFallbacks = 0;
+  // Zone annotations recorded outside of a zone, stacks past the stack
+  // table's limit and events discarded by the flush callback
+  uint64_t droppedEvents = 0;
+
+  std::vector<ThreadMetrics> threads;
+};
+} // namespace TracyRecorder
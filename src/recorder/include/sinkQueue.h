@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace TracyRecorder {
+// Hands the batches of the flush workers to the writer thread of a sink. The
+// first batch is the recording header, kept apart since every segment or
+// connection starts with it. Batches arriving while the queue holds its limit
+// are dropped, their events counted in the recorder's droppedEvents.
+class SinkQueue {
+public:
+  using Batch = std::vector<std::vector<std::byte>>;
+
+  explicit SinkQueue(size_t maxQueuedBytes)
+      : mMaxQueuedBytes(maxQueuedBytes) {}
+
+  void push(std::vector<std::byte> const &data);
+
+  // Empty until the first push
+  std::vector<std::byte> header() const;
+  // False when stopped before the header arrived
+  bool waitForHeader(std::stop_token stopToken);
+
+  // Moves everything queued to the batch, waiting until there is something,
+  // the timeout passes or a stop is requested. False when nothing was queued.
+  bool pop(Batch &batch, std::stop_token stopToken,
+           std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+  bool empty() const;
+
+  // Waits for the interval unless a stop is requested first
+  void pause(std::stop_token stopToken, std::chrono::milliseconds interval);
+
+private:
+  size_t mMaxQueuedBytes;
+  mutable std::mutex mMutex;
+  std::condition_variable_any mCondQueue;
+  std::vector<std::byte> mHeader;
+  std::deque<std::vector<std::byte>> mQueue;
+  size_t mQueuedBytes = 0;
+};
+
+// Events in a batch of the flush workers, for counting what a sink loses
+uint64_t countEvents(std::vector<std::byte> const &data);
+
+// Writes the buffers in as few calls as possible, resuming after partial
+// writes. write gets the iovecs still to go and returns the bytes it took, or
+// -1 with errno set. A failed call is repeated while retry(errno) holds.
+// False when a write failed for good.
+bool writeBuffers(std::span<std::vector<std::byte> const> buffers,
+                  std::function<ssize_t(std::span<iovec const>)> const &write,
+                  std::function<bool(int)> const &retry);
+} // namespace TracyRecorder
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+namespace TracyRecorder {
+struct SocketAddress {
+  sockaddr_storage address;
+  socklen_t length;
+  std::string path; // Unix sockets only
+};
+
+// Accepts "unix:<path>" and "tcp:<host>:<port>"
+std::optional<SocketAddress> parseSocketAddress(std::string_view address);
+} // namespace TracyRecorder
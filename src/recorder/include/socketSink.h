@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace TracyRecorder {
+struct SocketSinkOptions {
+  // "unix:<path>" or "tcp:<host>:<port>", see parseSocketAddress
+  std::string address;
+  std::chrono::milliseconds reconnectInterval{500};
+  // Longest a connection attempt may take before it counts as failed
+  std::chrono::milliseconds connectTimeout{1000};
+  // Batches arriving while this much data is still queued are dropped
+  size_t maxQueuedBytes = 64 * 1024 * 1024;
+};
+
+// Builds a flush callback that streams the recording to tracy_playback_bin
+// --listen. Writes happen on a background thread, so the flush thread never
+// waits on the connection. Every (re)connection starts a fresh stream with the
+// recording header, and a batch cut short by a broken connection is sent again
+// in full.
+std::function<void(std::vector<std::byte> const &)>
+makeSocketSink(SocketSinkOptions const &options);
+} // namespace TracyRecorder
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace TracyRecorder {
+// Bump allocator for the text a thread records, released all at once when
+// the events referencing it have been flushed. Blocks are kept for reuse
+// after a reset, text longer than a block gets one of its own that is freed
+// on reset.
+class StringArena {
+public:
+  explicit StringArena(size_t blockSize = 16 * 1024)
+      : mBlockSize(blockSize) {}
+
+  // Valid until the next reset
+  std::string_view copy(std::string_view text) {
+    if (text.empty()) {
+      return {};
+    }
+    if (text.size() > mFree) {
+      return copyToNewBlock(text);
+    }
+    auto data = mNext;
+    std::memcpy(data, text.data(), text.size());
+    mNext += text.size();
+    mFree -= text.size();
+    return {data, text.size()};
+  }
+
+  void reset();
+
+  // Held by the arena, copied text or not
+  size_t capacity() const;
+
+private:
+  std::string_view copyToNewBlock(std::string_view text);
+
+  size_t mBlockSize;
+  std::vector<std::unique_ptr<char[]>> mBlocks;
+  std::vector<std::pair<std::unique_ptr<char[]>, size_t>> mLarge;
+  // The block being filled and the rest of it, none before the first copy
+  size_t mBlock = 0;
+  char *mNext = nullptr;
+  size_t mFree = 0;
+};
+} // namespace TracyRecorder
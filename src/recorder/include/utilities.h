@@ -1,6 +1,22 @@
 #pragma once
 
+#include <charconv>
+#include <optional>
+#include <string_view>
+
 template <class... Ts> struct overloads : Ts... {
   using Ts::operator()...;
 };
-template <typename... Func> overloads(Func...) -> overloads<Func...>;
\ No newline at end of file
+template <typename... Func> overloads(Func...) -> overloads<Func...>;
+
+// The whole text as a number, nothing if it isn't one or doesn't fit
+template <class Number>
+std::optional<Number> parseNumber(std::string_view text) {
+  Number number = 0;
+  auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), number);
+  if (error != std::errc() || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return number;
+}
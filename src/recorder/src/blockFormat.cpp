@@ -0,0 +1,99 @@
+#include "blockFormat.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace TracyRecorder {
+namespace {
+// Tables for slicing by 8, table[k][b] is the CRC of byte b followed by k
+// zero bytes
+constexpr auto crcTables = [] {
+  std::array<std::array<uint32_t, 256>, 8> tables{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+    }
+    tables[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (size_t k = 1; k < tables.size(); ++k) {
+      auto previous = tables[k - 1][i];
+      tables[k][i] = (previous >> 8) ^ tables[0][previous & 0xff];
+    }
+  }
+  return tables;
+}();
+
+uint32_t load32(std::byte const *data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+void store32(std::byte *data, uint32_t value) {
+  std::memcpy(data, &value, sizeof(value));
+}
+} // namespace
+
+uint32_t crc32c(std::span<std::byte const> data, uint32_t crc) {
+  crc = ~crc;
+  auto p = data.data();
+  auto end = p + data.size();
+#if defined(__SSE4_2__)
+  uint64_t wide = crc;
+  for (; end - p >= 8; p += 8) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = uint32_t(wide);
+#else
+  auto &t = crcTables;
+  for (; end - p >= 8; p += 8) {
+    auto low = load32(p) ^ crc;
+    auto high = load32(p + 4);
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+          t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^ t[3][high & 0xff] ^
+          t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^
+          t[0][high >> 24];
+  }
+#endif
+  for (; p != end; ++p) {
+    crc = (crc >> 8) ^ crcTables[0][(crc ^ uint32_t(*p)) & 0xff];
+  }
+  return ~crc;
+}
+
+size_t beginBlock(std::vector<std::byte> &out) {
+  auto block = out.size();
+  out.insert(out.end(), blockMarker.begin(), blockMarker.end());
+  out.resize(block + blockHeaderSize);
+  return block;
+}
+
+void endBlock(std::vector<std::byte> &out, size_t block) {
+  auto header = out.data() + block;
+  auto payload = std::span(out).subspan(block + blockHeaderSize);
+  store32(header + blockMarker.size(), uint32_t(payload.size()));
+  store32(header + blockMarker.size() + 4, crc32c(payload));
+  store32(header + blockMarker.size() + 8,
+          crc32c(std::span(header, blockMarker.size() + 8)));
+}
+
+std::optional<BlockHeader> parseBlockHeader(std::span<std::byte const> header) {
+  if (header.size() < blockHeaderSize ||
+      !std::equal(blockMarker.begin(), blockMarker.end(), header.begin())) {
+    return std::nullopt;
+  }
+  auto fields = header.data() + blockMarker.size();
+  if (load32(fields + 8) != crc32c(header.first(blockMarker.size() + 8))) {
+    return std::nullopt;
+  }
+  return BlockHeader{load32(fields), load32(fields + 4)};
+}
+} // namespace TracyRecorder
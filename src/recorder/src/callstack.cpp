@@ -0,0 +1,101 @@
+#include "callstack.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+
+#ifdef __linux__
+#include <link.h>
+#include <pthread.h>
+#endif
+
+namespace TracyRecorder {
+namespace {
+struct StackBounds {
+  uintptr_t low = 0;
+  uintptr_t high = 0;
+};
+
+StackBounds threadStackBounds() {
+  StackBounds bounds;
+#ifdef __linux__
+  pthread_attr_t attributes;
+  if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+    void *address;
+    size_t size;
+    if (pthread_attr_getstack(&attributes, &address, &size) == 0) {
+      bounds.low = reinterpret_cast<uintptr_t>(address);
+      bounds.high = bounds.low + size;
+    }
+    pthread_attr_destroy(&attributes);
+  }
+#endif
+  return bounds;
+}
+
+// Looked up once per thread, reading frames outside of it could fault
+thread_local StackBounds const stackBounds = threadStackBounds();
+} // namespace
+
+[[gnu::noinline]] size_t captureStack(std::span<uint64_t> frames,
+                                      size_t skip) {
+  size_t count = 0;
+#if defined(__GNUC__) && !defined(_WIN32)
+  auto [low, high] = stackBounds;
+  // Each frame starts with the caller's frame pointer and the return address
+  auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  while (count < frames.size() && frame >= low &&
+         frame + 2 * sizeof(uintptr_t) <= high &&
+         frame % alignof(uintptr_t) == 0) {
+    auto words = reinterpret_cast<uintptr_t const *>(frame);
+    auto returnAddress = words[1];
+    if (returnAddress == 0) {
+      break;
+    }
+    if (skip > 0) {
+      --skip;
+    } else {
+      frames[count++] = returnAddress;
+    }
+    // Callers' frames are further up the stack, anything else is garbage
+    if (words[0] <= frame) {
+      break;
+    }
+    frame = words[0];
+  }
+#endif
+  return count;
+}
+
+std::vector<LoadedModule> loadedModules() {
+  std::vector<LoadedModule> modules;
+#ifdef __linux__
+  auto addModule = [](dl_phdr_info *info, size_t, void *data) {
+    uint64_t start = std::numeric_limits<uint64_t>::max();
+    uint64_t end = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+      auto &segment = info->dlpi_phdr[i];
+      if (segment.p_type == PT_LOAD && (segment.p_flags & PF_X)) {
+        start = std::min<uint64_t>(start, info->dlpi_addr + segment.p_vaddr);
+        end = std::max<uint64_t>(end, info->dlpi_addr + segment.p_vaddr +
+                                          segment.p_memsz);
+      }
+    }
+    if (start >= end) {
+      return 0;
+    }
+    std::string path = info->dlpi_name;
+    // The executable is listed first, without a name
+    if (path.empty()) {
+      std::error_code error;
+      path = std::filesystem::read_symlink("/proc/self/exe", error).string();
+    }
+    static_cast<std::vector<LoadedModule> *>(data)->push_back(
+        {std::move(path), info->dlpi_addr, start, end - start});
+    return 0;
+  };
+  dl_iterate_phdr(addModule, &modules);
+#endif
+  return modules;
+}
+} // namespace TracyRecorder
@@ -0,0 +1,167 @@
+#include "eventReader.h"
+
+#include "blockFormat.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace TracyRecorder {
+namespace {
+// Bytes searched for a marker per read while resyncing
+constexpr size_t resyncWindowBytes = 64 * 1024;
+} // namespace
+
+// Payload of the current block, decoded from memory
+struct EventReader::Block : std::streambuf {
+  std::vector<char> data;
+  std::istream stream{this};
+  bool active = false;
+
+  void start() {
+    setg(data.data(), data.data(), data.data() + data.size());
+    stream.clear();
+    active = true;
+  }
+};
+
+EventReader::EventReader(std::istream &in, uint64_t end)
+    : mIn(&in), mEnd(end), mBlock(std::make_unique<Block>()) {}
+EventReader::EventReader(EventReader &&) noexcept = default;
+EventReader &EventReader::operator=(EventReader &&) noexcept = default;
+EventReader::~EventReader() = default;
+
+void EventReader::syncTo(uint64_t offset) {
+  mBlock->active = false;
+  mUnframed = false;
+  resync(offset);
+}
+
+std::optional<Event<false>> EventReader::next() {
+  mIncomplete = false;
+  while (true) {
+    if (mBlock->active) {
+      if (auto event = Event<false>::deserialize(mBlock->stream)) {
+        return event;
+      }
+      mBlock->active = false;
+    }
+
+    mIn->clear();
+    auto position = uint64_t(mIn->tellg());
+    if (position >= mEnd || mIn->peek() == std::char_traits<char>::eof()) {
+      return std::nullopt;
+    }
+
+    if (mIn->peek() == std::to_integer<int>(blockMarker[0])) {
+      auto state = readBlock();
+      if (state == BlockState::Read) {
+        mUnframed = false;
+        continue;
+      }
+      if (state == BlockState::Incomplete) {
+        mIn->clear();
+        mIn->seekg(position);
+        mIncomplete = true;
+        return std::nullopt;
+      }
+      ++mDamagedBlocks;
+    } else if (mUnframed) {
+      if (auto event = Event<false>::deserialize(*mIn)) {
+        return event;
+      }
+      if (mIn->eof()) {
+        mIn->clear();
+        mIn->seekg(position);
+        mIncomplete = true;
+        return std::nullopt;
+      }
+    }
+
+    // Only blocks are trusted from here on
+    mUnframed = false;
+    auto found = resync(position + 1);
+    mSkippedBytes += uint64_t(mIn->tellg()) - position;
+    if (!found) {
+      mIncomplete = true;
+      return std::nullopt;
+    }
+  }
+}
+
+EventReader::BlockState EventReader::readBlock() {
+  std::array<std::byte, blockHeaderSize> header;
+  mIn->read(reinterpret_cast<char *>(header.data()), header.size());
+  if (size_t(mIn->gcount()) != header.size()) {
+    return BlockState::Incomplete;
+  }
+  auto parsed = parseBlockHeader(header);
+  if (!parsed) {
+    return BlockState::Damaged;
+  }
+
+  auto &data = mBlock->data;
+  data.resize(parsed->size);
+  mIn->read(data.data(), data.size());
+  if (size_t(mIn->gcount()) != data.size()) {
+    return BlockState::Incomplete;
+  }
+  if (crc32c(std::as_bytes(std::span(data))) != parsed->checksum) {
+    return BlockState::Damaged;
+  }
+  mBlock->start();
+  return BlockState::Read;
+}
+
+bool EventReader::resync(uint64_t from) {
+  std::string_view marker(reinterpret_cast<char const *>(blockMarker.data()),
+                          blockMarker.size());
+  // A marker starting before the end may reach past it
+  auto limit = mEnd == std::numeric_limits<uint64_t>::max()
+                   ? mEnd
+                   : mEnd + marker.size() - 1;
+
+  mIn->clear();
+  mIn->seekg(from);
+  if (from >= mEnd) {
+    return true;
+  }
+
+  std::vector<char> window(resyncWindowBytes);
+  uint64_t windowStart = from;
+  size_t kept = 0;
+  while (true) {
+    auto wanted = std::min<uint64_t>(window.size() - kept,
+                                     limit - windowStart - kept);
+    mIn->read(window.data() + kept, wanted);
+    auto filled = kept + size_t(mIn->gcount());
+    std::string_view view(window.data(), filled);
+
+    uint64_t target;
+    bool found = true;
+    if (auto offset = view.find(marker); offset != view.npos) {
+      target = windowStart + offset;
+    } else if (windowStart + filled >= limit) {
+      target = mEnd;
+    } else if (filled == window.size()) {
+      // Keep the tail, a marker may continue in the next read
+      kept = marker.size() - 1;
+      std::memmove(window.data(), window.data() + filled - kept, kept);
+      windowStart += filled - kept;
+      continue;
+    } else {
+      // Out of data, stop before what may be the start of a marker
+      target = windowStart + filled - std::min(filled, marker.size() - 1);
+      target = std::max(target, from);
+      found = false;
+    }
+
+    mIn->clear();
+    mIn->seekg(target);
+    return found;
+  }
+}
+} // namespace TracyRecorder
@@ -0,0 +1,215 @@
+#include "fileSink.h"
+
+#include "recorder.h"
+#include "sinkQueue.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace TracyRecorder {
+namespace {
+// The recording keeps going without the sink, so failures are only reported
+void reportError(std::string_view action, std::filesystem::path const &path,
+                 int error) {
+  std::cerr << std::format("Tracy recorder file sink: {} {} failed: {}\n",
+                           action, path.string(), std::strerror(error));
+}
+
+class FileSink {
+public:
+  FileSink(FileSinkOptions const &options)
+      : mOptions(options), mQueue(options.maxQueuedBytes) {
+    mWriterThread = std::jthread(&FileSink::writerThreadFunc, this);
+  }
+
+  ~FileSink() {
+    mWriterThread.request_stop();
+    mWriterThread.join();
+    closeSegment();
+  }
+
+  // The first buffer is the recording header, every segment repeats it
+  void write(std::vector<std::byte> const &data) { mQueue.push(data); }
+
+private:
+  using Batch = SinkQueue::Batch;
+
+  void writerThreadFunc(std::stop_token stopToken) {
+    Batch batch;
+    auto lastSync = std::chrono::steady_clock::now();
+    auto wakeUp = mOptions.syncInterval.count() > 0
+                      ? mOptions.syncInterval
+                      : std::chrono::milliseconds(1000);
+
+    while (true) {
+      if (mQueue.pop(batch, stopToken, wakeUp)) {
+        writeBatch(batch);
+        batch.clear();
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (mFile >= 0 && mOptions.syncInterval.count() > 0 &&
+          now - lastSync >= mOptions.syncInterval) {
+        if (fdatasync(mFile) != 0) {
+          reportError("syncing", mSegmentPath, errno);
+        }
+        lastSync = now;
+      }
+
+      if (stopToken.stop_requested() && mQueue.empty()) {
+        return;
+      }
+    }
+  }
+
+  void writeBatch(Batch const &batch) {
+    if (mFile < 0 || (mOptions.maxSegmentAge.count() > 0 &&
+                      std::chrono::steady_clock::now() - mSegmentOpened >=
+                          mOptions.maxSegmentAge)) {
+      openSegment();
+    }
+
+    // Rotation only happens between buffers, each buffer holds whole events
+    size_t begin = 0;
+    uint64_t runBytes = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      bool segmentHasEvents = mOffset + runBytes > mHeaderSize;
+      if (mOptions.maxSegmentBytes > 0 && segmentHasEvents &&
+          mOffset + runBytes + batch[i].size() > mOptions.maxSegmentBytes) {
+        writeRun(std::span(batch).subspan(begin, i - begin), runBytes);
+        openSegment();
+        begin = i;
+        runBytes = 0;
+      }
+      runBytes += batch[i].size();
+    }
+    writeRun(std::span(batch).subspan(begin), runBytes);
+  }
+
+  void openSegment() {
+    closeSegment();
+
+    auto header = mQueue.header();
+
+    auto &path = mOptions.path;
+    mSegmentPath =
+        path.parent_path() /
+        std::format("{}.{:06}{}", path.stem().string(), mSegmentIndex++,
+                    path.extension().string());
+    mFile = open(mSegmentPath.c_str(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFile < 0) {
+      // Batches are dropped until a later one opens the next segment
+      reportError("opening", mSegmentPath, errno);
+      return;
+    }
+    mOffset = 0;
+    mAllocated = 0;
+    mPreallocate = mOptions.preallocateBytes > 0;
+    mHeaderSize = header.size();
+    mSegmentOpened = std::chrono::steady_clock::now();
+    if (!append(std::span(&header, 1), header.size())) {
+      closeSegment();
+    }
+  }
+
+  void closeSegment() {
+    if (mFile >= 0) {
+      if (mOptions.syncInterval.count() > 0 && fdatasync(mFile) != 0) {
+        reportError("syncing", mSegmentPath, errno);
+      }
+      if (close(mFile) != 0) {
+        reportError("closing", mSegmentPath, errno);
+      }
+      mFile = -1;
+    }
+  }
+
+  // Events of buffers that don't make it to disk count as dropped
+  void writeRun(std::span<std::vector<std::byte> const> buffers,
+                uint64_t bytes) {
+    if (bytes == 0) {
+      return;
+    }
+    if (mFile < 0 || !append(buffers, bytes)) {
+      for (auto &buffer : buffers) {
+        countDroppedEvents(countEvents(buffer));
+      }
+    }
+  }
+
+  // All or nothing, a failed write is cut off again so the segment ends with
+  // whole events
+  bool append(std::span<std::vector<std::byte> const> buffers,
+              uint64_t bytes) {
+#ifdef __linux__
+    // KEEP_SIZE so readers following the file only ever see written data.
+    // Only an optimization, the segment goes on without it after a failure.
+    while (mPreallocate && mOffset + bytes > mAllocated) {
+      if (fallocate(mFile, FALLOC_FL_KEEP_SIZE, mAllocated,
+                    mOptions.preallocateBytes) != 0) {
+        reportError("preallocating", mSegmentPath, errno);
+        mPreallocate = false;
+        break;
+      }
+      mAllocated += mOptions.preallocateBytes;
+    }
+#endif
+
+    auto start = mOffset;
+    // Short writes are resumed where they stopped
+    bool written = writeBuffers(
+        buffers,
+        [this](std::span<iovec const> iov) {
+          auto written = pwritev(mFile, iov.data(), iov.size(), mOffset);
+          if (written > 0) {
+            mOffset += written;
+          }
+          return written;
+        },
+        [](int error) { return error == EINTR; });
+    if (written) {
+      return true;
+    }
+    reportError("writing", mSegmentPath, errno);
+    if (mOffset > start && ftruncate(mFile, start) != 0) {
+      reportError("truncating", mSegmentPath, errno);
+    }
+    mOffset = start;
+    return false;
+  }
+
+  FileSinkOptions mOptions;
+
+  // Writer thread only
+  int mFile = -1;
+  std::filesystem::path mSegmentPath;
+  uint64_t mSegmentIndex = 0;
+  uint64_t mOffset = 0;
+  uint64_t mAllocated = 0;
+  bool mPreallocate = false;
+  uint64_t mHeaderSize = 0;
+  std::chrono::steady_clock::time_point mSegmentOpened;
+
+  SinkQueue mQueue;
+
+  // Keep last, we want to finish this thread before destroying the main object
+  std::jthread mWriterThread;
+};
+} // namespace
+
+std::function<void(std::vector<std::byte> const &)>
+makeFileSink(FileSinkOptions const &options) {
+  auto sink = std::make_shared<FileSink>(options);
+  return [sink](std::vector<std::byte> const &data) { sink->write(data); };
+}
+} // namespace TracyRecorder
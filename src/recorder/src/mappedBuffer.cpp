@@ -0,0 +1,146 @@
+#include "mappedBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace TracyRecorder {
+MappedBuffer::MappedBuffer(MappedBufferOptions const &options,
+                           std::span<std::byte const> startEvent)
+    // Whole cache lines keep every ring header aligned
+    : mRingBytes(std::max<uint32_t>((options.ringBytes + 63) / 64 * 64, 64)),
+      mRingCount(options.maxThreads) {
+  if (sizeof(MappedBufferHeader) + startEvent.size() >
+      mappedBufferHeaderBytes) {
+    throw std::runtime_error("StartEvent doesn't fit the mapped buffer header");
+  }
+
+  int fd = open(options.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("Failed to create mapped buffer '{}'",
+                                         options.path.string()));
+  }
+  mMappingBytes = mappedBufferHeaderBytes +
+                  size_t(mRingCount) * (mappedRingHeaderBytes + mRingBytes);
+  // The file stays sparse, pages are only allocated once a ring reaches them
+  if (ftruncate(fd, mMappingBytes) == 0) {
+    auto mapping = mmap(nullptr, mMappingBytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (mapping != MAP_FAILED) {
+      mMapping = static_cast<std::byte *>(mapping);
+    }
+  }
+  close(fd);
+  if (!mMapping) {
+    throw std::runtime_error(std::format("Failed to map mapped buffer '{}'",
+                                         options.path.string()));
+  }
+
+  MappedBufferHeader header{};
+  std::memcpy(header.magic, mappedBufferMagic.data(), sizeof(header.magic));
+  header.ringBytes = mRingBytes;
+  header.ringCount = mRingCount;
+  header.startEventBytes = startEvent.size();
+  std::memcpy(mMapping, &header, sizeof(header));
+  std::memcpy(mMapping + sizeof(header), startEvent.data(), startEvent.size());
+
+  for (uint32_t ring = mRingCount; ring > 0; --ring) {
+    mFreeRings.push_back(ring - 1);
+  }
+}
+
+MappedBuffer::~MappedBuffer() { munmap(mMapping, mMappingBytes); }
+
+std::optional<uint32_t> MappedBuffer::acquireRing() {
+  std::scoped_lock lock(mMutexFreeRings);
+  if (mFreeRings.empty()) {
+    return std::nullopt;
+  }
+  auto ring = mFreeRings.back();
+  mFreeRings.pop_back();
+  return ring;
+}
+
+// A released ring may still hold unflushed events. They are self-contained,
+// so the next owner simply appends after them.
+void MappedBuffer::releaseRing(uint32_t ring) {
+  std::scoped_lock lock(mMutexFreeRings);
+  mFreeRings.push_back(ring);
+}
+
+bool MappedBuffer::write(uint32_t ring, std::span<std::byte const> event) {
+  auto &header = ringHeader(ring);
+  auto committed =
+      std::atomic_ref(header.committed).load(std::memory_order_relaxed);
+  if (committed + event.size() - consumed(ring) > mRingBytes) {
+    return false;
+  }
+
+  auto data = ringData(ring);
+  auto offset = committed % mRingBytes;
+  auto first = std::min<size_t>(event.size(), mRingBytes - offset);
+  std::memcpy(data + offset, event.data(), first);
+  std::memcpy(data, event.data() + first, event.size() - first);
+
+  // Publishing the event also makes it part of what survives a crash
+  std::atomic_ref(header.committed)
+      .store(committed + event.size(), std::memory_order_release);
+  return true;
+}
+
+uint64_t MappedBuffer::committed(uint32_t ring) const {
+  return std::atomic_ref(ringHeader(ring).committed)
+      .load(std::memory_order_acquire);
+}
+
+uint64_t MappedBuffer::consumed(uint32_t ring) const {
+  return std::atomic_ref(ringHeader(ring).consumed)
+      .load(std::memory_order_acquire);
+}
+
+std::vector<uint64_t> MappedBuffer::drain(std::vector<std::byte> &out) const {
+  std::vector<uint64_t> positions(mRingCount);
+  for (uint32_t ring = 0; ring < mRingCount; ++ring) {
+    auto begin = consumed(ring);
+    auto end = committed(ring);
+    positions[ring] = end;
+    if (begin == end) {
+      continue;
+    }
+
+    auto data = ringData(ring);
+    auto offset = begin % mRingBytes;
+    auto size = end - begin;
+    auto first = std::min<size_t>(size, mRingBytes - offset);
+    out.insert(out.end(), data + offset, data + offset + first);
+    out.insert(out.end(), data, data + (size - first));
+  }
+  return positions;
+}
+
+// Consumed only moves once the events left the process, a crash in between
+// replays them rather than losing them
+void MappedBuffer::release(std::vector<uint64_t> const &positions) {
+  for (uint32_t ring = 0; ring < mRingCount; ++ring) {
+    std::atomic_ref(ringHeader(ring).consumed)
+        .store(positions[ring], std::memory_order_release);
+  }
+}
+
+MappedRingHeader &MappedBuffer::ringHeader(uint32_t ring) const {
+  return *reinterpret_cast<MappedRingHeader *>(
+      mMapping + mappedBufferHeaderBytes +
+      size_t(ring) * (mappedRingHeaderBytes + mRingBytes));
+}
+
+std::byte *MappedBuffer::ringData(uint32_t ring) const {
+  return reinterpret_cast<std::byte *>(&ringHeader(ring)) +
+         mappedRingHeaderBytes;
+}
+} // namespace TracyRecorder
@@ -0,0 +1,107 @@
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace TracyRecorder {
+namespace {
+#ifdef __linux__
+struct CounterConfig {
+  Counter counter;
+  uint32_t type;
+  uint64_t config;
+  // Counts something at all when limited to user space
+  bool countsInUserSpace;
+};
+
+// In opening order. The task clock leads the group, under other leaders some
+// kernels leave it at zero until the thread is next scheduled.
+constexpr std::array<CounterConfig, counterCount> counterConfigs{{
+    {Counter::TaskClock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, true},
+    {Counter::Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+     true},
+    {Counter::Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true},
+    {Counter::CacheMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+     true},
+    // Switches happen in the kernel, counting them needs its events
+    {Counter::ContextSwitches, PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CONTEXT_SWITCHES, false},
+}};
+
+int openCounter(CounterConfig const &config, int group) {
+  perf_event_attr attributes{};
+  attributes.size = sizeof(attributes);
+  attributes.type = config.type;
+  attributes.config = config.config;
+  attributes.read_format = PERF_FORMAT_GROUP;
+  attributes.exclude_hv = 1;
+  // Counting in the kernel as well needs a lower perf_event_paranoid
+  for (bool excludeKernel : {false, true}) {
+    if (excludeKernel && !config.countsInUserSpace) {
+      break;
+    }
+    attributes.exclude_kernel = excludeKernel;
+    auto descriptor = syscall(SYS_perf_event_open, &attributes, 0, -1, group,
+                              PERF_FLAG_FD_CLOEXEC);
+    if (descriptor >= 0) {
+      return int(descriptor);
+    }
+  }
+  return -1;
+}
+#endif
+} // namespace
+
+PerfCounters::PerfCounters() {
+  mDescriptors.fill(-1);
+#ifdef __linux__
+  // Hardware counters missing in VMs and containers are skipped, whatever
+  // opens first leads the group
+  for (auto &config : counterConfigs) {
+    auto descriptor = openCounter(config, mGroup);
+    if (descriptor < 0) {
+      continue;
+    }
+    if (mGroup < 0) {
+      mGroup = descriptor;
+    }
+    mDescriptors[mOpened] = descriptor;
+    mOrder[mOpened++] = config.counter;
+    mAvailable |= counterBit(config.counter);
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (size_t i = 0; i < mOpened; ++i) {
+    close(mDescriptors[i]);
+  }
+#endif
+}
+
+bool PerfCounters::read(CounterValues &values) const {
+  values = {};
+#ifdef __linux__
+  if (mGroup < 0) {
+    return false;
+  }
+  // The number of counters, then their values
+  std::array<uint64_t, counterCount + 1> buffer;
+  auto size = (mOpened + 1) * sizeof(uint64_t);
+  if (::read(mGroup, buffer.data(), size) != ssize_t(size) ||
+      buffer[0] != mOpened) {
+    return false;
+  }
+  for (size_t i = 0; i < mOpened; ++i) {
+    values[size_t(mOrder[i])] = buffer[i + 1];
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+} // namespace TracyRecorder
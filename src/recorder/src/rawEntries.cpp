@@ -1,5 +1,7 @@
 #include "rawEntries.h"
 
+#include "utilities.h"
+
 #include <cstring>
 namespace {
 template <class T>
@@ -20,6 +22,14 @@ void serializeRaw(std::vector<std::byte> &out, std::string_view rawData) {
   std::memcpy(out.data() + out.size() - dataSize, rawData.data(), dataSize);
 }
 
+void serializeVarInt(std::vector<std::byte> &out, uint64_t rawData) {
+  while (rawData >= 0x80) {
+    out.push_back(std::byte((rawData & 0x7F) | 0x80));
+    rawData >>= 7;
+  }
+  out.push_back(std::byte(rawData));
+}
+
 #define DESERIALIZE_RAW(localVariable)                                         \
   {                                                                            \
     auto opt = deserializeRaw<decltype(localVariable)>(data);                  \
@@ -55,6 +65,31 @@ std::optional<std::string> deserializeRaw<std::string>(std::istream &data) {
 
   return result;
 }
+
+std::optional<uint64_t> deserializeVarInt(std::istream &data) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    auto byte = data.get();
+    if (byte == std::istream::traits_type::eof()) {
+      return std::nullopt;
+    }
+    value |= uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+#define DESERIALIZE_VARINT(localVariable)                                      \
+  {                                                                            \
+    auto opt = deserializeVarInt(data);                                        \
+    if (!opt) {                                                                \
+      return std::nullopt;                                                     \
+    }                                                                          \
+    localVariable = *opt;                                                      \
+  }                                                                            \
+  static_cast<void>(0)
 } // namespace
 
 namespace TracyRecorder {
@@ -162,11 +197,469 @@ EventHeader<EventType::ThreadName, ThreadNameEvent<false>, false>::deserialize(
   return event;
 }
 
+template <>
+void EventHeader<EventType::FrameMark, FrameMarkEvent<true>, true>::serialize(
+    FrameMarkEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.name);
+  serializeRaw(out, self.kind);
+}
+
+template <>
+std::optional<FrameMarkEvent<false>>
+EventHeader<EventType::FrameMark, FrameMarkEvent<false>, false>::deserialize(
+    std::istream &data) {
+  FrameMarkEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.name);
+  DESERIALIZE_RAW(event.kind);
+  if (event.kind > FrameMarkKind::End) {
+    return std::nullopt;
+  }
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ZoneText, ZoneTextEvent<true>, true>::serialize(
+    ZoneTextEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.text);
+}
+
+template <>
+std::optional<ZoneTextEvent<false>>
+EventHeader<EventType::ZoneText, ZoneTextEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ZoneTextEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.text);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ZoneValue, ZoneValueEvent<true>, true>::serialize(
+    ZoneValueEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.value);
+}
+
+template <>
+std::optional<ZoneValueEvent<false>>
+EventHeader<EventType::ZoneValue, ZoneValueEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ZoneValueEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.value);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ZoneColor, ZoneColorEvent<true>, true>::serialize(
+    ZoneColorEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.color);
+}
+
+template <>
+std::optional<ZoneColorEvent<false>>
+EventHeader<EventType::ZoneColor, ZoneColorEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ZoneColorEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.color);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ClockSync, ClockSyncEvent<true>, true>::serialize(
+    ClockSyncEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.unixTime);
+}
+
+template <>
+std::optional<ClockSyncEvent<false>>
+EventHeader<EventType::ClockSync, ClockSyncEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ClockSyncEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.unixTime);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ThreadStart, ThreadStartEvent<true>,
+                 true>::serialize(ThreadStartEvent<true> const &self,
+                                  std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+}
+
+template <>
+std::optional<ThreadStartEvent<false>>
+EventHeader<EventType::ThreadStart, ThreadStartEvent<false>,
+            false>::deserialize(std::istream &data) {
+  ThreadStartEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::ThreadExit, ThreadExitEvent<true>, true>::serialize(
+    ThreadExitEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+}
+
+template <>
+std::optional<ThreadExitEvent<false>>
+EventHeader<EventType::ThreadExit, ThreadExitEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ThreadExitEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::RecorderMetrics, RecorderMetricsEvent<true>,
+                 true>::serialize(RecorderMetricsEvent<true> const &self,
+                                  std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeVarInt(out, self.bufferedEvents);
+  serializeVarInt(out, self.bufferedBytes);
+  serializeVarInt(out, self.queuedEvents);
+  serializeVarInt(out, self.flushedEvents);
+  serializeVarInt(out, self.flushedBytes);
+  serializeVarInt(out, self.flushBatches);
+  serializeVarInt(out, self.flushWaitNanoseconds);
+  serializeVarInt(out, self.outputNanoseconds);
+  serializeVarInt(out, self.droppedEvents);
+  serializeVarInt(out, self.largestBatchBytes);
+  for (auto count : self.outputLatency) {
+    serializeVarInt(out, count);
+  }
+  serializeVarInt(out, self.flushWaits);
+  serializeVarInt(out, self.mappedFallbacks);
+}
+
+template <>
+std::optional<RecorderMetricsEvent<false>>
+EventHeader<EventType::RecorderMetrics, RecorderMetricsEvent<false>,
+            false>::deserialize(std::istream &data) {
+  RecorderMetricsEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_VARINT(event.bufferedEvents);
+  DESERIALIZE_VARINT(event.bufferedBytes);
+  DESERIALIZE_VARINT(event.queuedEvents);
+  DESERIALIZE_VARINT(event.flushedEvents);
+  DESERIALIZE_VARINT(event.flushedBytes);
+  DESERIALIZE_VARINT(event.flushBatches);
+  DESERIALIZE_VARINT(event.flushWaitNanoseconds);
+  DESERIALIZE_VARINT(event.outputNanoseconds);
+  DESERIALIZE_VARINT(event.droppedEvents);
+  DESERIALIZE_VARINT(event.largestBatchBytes);
+  for (auto &count : event.outputLatency) {
+    DESERIALIZE_VARINT(count);
+  }
+  DESERIALIZE_VARINT(event.flushWaits);
+  DESERIALIZE_VARINT(event.mappedFallbacks);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::Category, CategoryEvent<true>, true>::serialize(
+    CategoryEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.name);
+  serializeRaw(out, self.enabled);
+}
+
+template <>
+std::optional<CategoryEvent<false>>
+EventHeader<EventType::Category, CategoryEvent<false>, false>::deserialize(
+    std::istream &data) {
+  CategoryEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.name);
+  DESERIALIZE_RAW(event.enabled);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::FiberEnter, FiberEnterEvent<true>, true>::serialize(
+    FiberEnterEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.fiberId);
+  serializeRaw(out, self.name);
+  serializeVarInt(out, self.handover);
+  serializeVarInt(out, self.continues);
+}
+
+template <>
+std::optional<FiberEnterEvent<false>>
+EventHeader<EventType::FiberEnter, FiberEnterEvent<false>, false>::deserialize(
+    std::istream &data) {
+  FiberEnterEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.fiberId);
+  DESERIALIZE_RAW(event.name);
+  DESERIALIZE_VARINT(event.handover);
+  DESERIALIZE_VARINT(event.continues);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::FiberLeave, FiberLeaveEvent<true>, true>::serialize(
+    FiberLeaveEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.handover);
+}
+
+template <>
+std::optional<FiberLeaveEvent<false>>
+EventHeader<EventType::FiberLeave, FiberLeaveEvent<false>, false>::deserialize(
+    std::istream &data) {
+  FiberLeaveEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.handover);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::Cpu, CpuEvent<true>, true>::serialize(
+    CpuEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.cpu);
+}
+
+template <>
+std::optional<CpuEvent<false>>
+EventHeader<EventType::Cpu, CpuEvent<false>, false>::deserialize(
+    std::istream &data) {
+  CpuEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.cpu);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::Module, ModuleEvent<true>, true>::serialize(
+    ModuleEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.path);
+  serializeVarInt(out, self.base);
+  serializeVarInt(out, self.start);
+  serializeVarInt(out, self.size);
+}
+
+template <>
+std::optional<ModuleEvent<false>>
+EventHeader<EventType::Module, ModuleEvent<false>, false>::deserialize(
+    std::istream &data) {
+  ModuleEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.path);
+  DESERIALIZE_VARINT(event.base);
+  DESERIALIZE_VARINT(event.start);
+  DESERIALIZE_VARINT(event.size);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::StackFrames, StackFramesEvent<true>, true>::
+    serialize(StackFramesEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.stackId);
+  serializeVarInt(out, self.frames.size());
+  for (auto frame : self.frames) {
+    serializeVarInt(out, frame);
+  }
+}
+
+template <>
+std::optional<StackFramesEvent<false>>
+EventHeader<EventType::StackFrames, StackFramesEvent<false>, false>::
+    deserialize(std::istream &data) {
+  StackFramesEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.stackId);
+  uint64_t count;
+  DESERIALIZE_VARINT(count);
+  if (count > maxStackFrames) {
+    return std::nullopt;
+  }
+  event.frames.resize(count);
+  for (auto &frame : event.frames) {
+    DESERIALIZE_VARINT(frame);
+  }
+  return event;
+}
+
+template <>
+void EventHeader<EventType::Stack, StackEvent<true>, true>::serialize(
+    StackEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeVarInt(out, self.stackId);
+}
+
+template <>
+std::optional<StackEvent<false>>
+EventHeader<EventType::Stack, StackEvent<false>, false>::deserialize(
+    std::istream &data) {
+  StackEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_VARINT(event.stackId);
+  return event;
+}
+
+template <>
+void EventHeader<EventType::Counters, CountersEvent<true>, true>::serialize(
+    CountersEvent<true> const &self, std::vector<std::byte> &out) {
+  serializeRaw(out, self.time);
+  serializeRaw(out, self.threadId);
+  serializeRaw(out, self.available);
+  for (size_t i = 0; i < counterCount; ++i) {
+    if (self.available & (1 << i)) {
+      serializeVarInt(out, self.deltas[i]);
+    }
+  }
+}
+
+template <>
+std::optional<CountersEvent<false>>
+EventHeader<EventType::Counters, CountersEvent<false>, false>::deserialize(
+    std::istream &data) {
+  CountersEvent<false> event;
+  DESERIALIZE_RAW(event.time);
+  DESERIALIZE_RAW(event.threadId);
+  DESERIALIZE_RAW(event.available);
+  event.deltas = {};
+  for (size_t i = 0; i < counterCount; ++i) {
+    if (event.available & (1 << i)) {
+      DESERIALIZE_VARINT(event.deltas[i]);
+    }
+  }
+  return event;
+}
+
 void Event<true>::serialize(std::vector<std::byte> &out) const {
   serializeRaw(out, type());
   std::visit([&out](auto const &event) { event.serialize(out); }, event);
 }
 
+Event<true> Event<false>::view() const {
+  return std::visit(
+      overloads{
+          [](StartEvent<false> const &e) -> Event<true> {
+            return StartEvent<true>(e.host, e.unixTime, e.processId);
+          },
+          [](StartZoneEvent<false> const &e) -> Event<true> {
+            return StartZoneEvent<true>(e.color, e.line, e.file, e.function,
+                                        e.name, e.threadId, e.time);
+          },
+          [](EndZoneEvent<false> const &e) -> Event<true> {
+            return EndZoneEvent<true>(e.threadId, e.time);
+          },
+          [](MessageEvent<false> const &e) -> Event<true> {
+            return MessageEvent<true>(e.message, e.color, e.threadId, e.time);
+          },
+          [](ThreadNameEvent<false> const &e) -> Event<true> {
+            return ThreadNameEvent<true>(e.name, e.threadId, e.time);
+          },
+          [](FrameMarkEvent<false> const &e) -> Event<true> {
+            return FrameMarkEvent<true>(e.name, e.kind, e.threadId, e.time);
+          },
+          [](ZoneTextEvent<false> const &e) -> Event<true> {
+            return ZoneTextEvent<true>(e.text, e.threadId, e.time);
+          },
+          [](ZoneValueEvent<false> const &e) -> Event<true> {
+            return ZoneValueEvent<true>(e.value, e.threadId, e.time);
+          },
+          [](ZoneColorEvent<false> const &e) -> Event<true> {
+            return ZoneColorEvent<true>(e.color, e.threadId, e.time);
+          },
+          [](ClockSyncEvent<false> const &e) -> Event<true> {
+            return ClockSyncEvent<true>(e.time, e.unixTime);
+          },
+          [](ThreadStartEvent<false> const &e) -> Event<true> {
+            return ThreadStartEvent<true>(e.threadId, e.time);
+          },
+          [](ThreadExitEvent<false> const &e) -> Event<true> {
+            return ThreadExitEvent<true>(e.threadId, e.time);
+          },
+          [](RecorderMetricsEvent<false> const &e) -> Event<true> {
+            RecorderMetricsEvent<true> metrics;
+            metrics.time = e.time;
+            metrics.bufferedEvents = e.bufferedEvents;
+            metrics.bufferedBytes = e.bufferedBytes;
+            metrics.queuedEvents = e.queuedEvents;
+            metrics.flushedEvents = e.flushedEvents;
+            metrics.flushedBytes = e.flushedBytes;
+            metrics.flushBatches = e.flushBatches;
+            metrics.flushWaitNanoseconds = e.flushWaitNanoseconds;
+            metrics.outputNanoseconds = e.outputNanoseconds;
+            metrics.droppedEvents = e.droppedEvents;
+            metrics.largestBatchBytes = e.largestBatchBytes;
+            metrics.outputLatency = e.outputLatency;
+            metrics.flushWaits = e.flushWaits;
+            metrics.mappedFallbacks = e.mappedFallbacks;
+            return metrics;
+          },
+          [](CategoryEvent<false> const &e) -> Event<true> {
+            return CategoryEvent<true>(e.name, e.enabled, e.threadId, e.time);
+          },
+          [](FiberEnterEvent<false> const &e) -> Event<true> {
+            return FiberEnterEvent<true>(e.fiberId, e.name, e.handover,
+                                         e.continues, e.threadId, e.time);
+          },
+          [](FiberLeaveEvent<false> const &e) -> Event<true> {
+            return FiberLeaveEvent<true>(e.handover, e.threadId, e.time);
+          },
+          [](CpuEvent<false> const &e) -> Event<true> {
+            return CpuEvent<true>(e.cpu, e.threadId, e.time);
+          },
+          [](ModuleEvent<false> const &e) -> Event<true> {
+            return ModuleEvent<true>(e.path, e.base, e.start, e.size,
+                                     e.threadId, e.time);
+          },
+          [](StackFramesEvent<false> const &e) -> Event<true> {
+            return StackFramesEvent<true>(e.stackId, e.frames, e.threadId,
+                                          e.time);
+          },
+          [](StackEvent<false> const &e) -> Event<true> {
+            return StackEvent<true>(e.stackId, e.threadId, e.time);
+          },
+          [](CountersEvent<false> const &e) -> Event<true> {
+            return CountersEvent<true>(e.available, e.deltas, e.threadId,
+                                       e.time);
+          }},
+      event);
+}
+
 std::optional<Event<false>> Event<false>::deserialize(std::istream &data) {
   EventType type;
   DESERIALIZE_RAW(type);
@@ -190,6 +683,38 @@ std::optional<Event<false>> Event<false>::deserialize(std::istream &data) {
     return handleEvent.template operator()<MessageEvent<false>>();
   case EventType::ThreadName:
     return handleEvent.template operator()<ThreadNameEvent<false>>();
+  case EventType::FrameMark:
+    return handleEvent.template operator()<FrameMarkEvent<false>>();
+  case EventType::ZoneText:
+    return handleEvent.template operator()<ZoneTextEvent<false>>();
+  case EventType::ZoneValue:
+    return handleEvent.template operator()<ZoneValueEvent<false>>();
+  case EventType::ZoneColor:
+    return handleEvent.template operator()<ZoneColorEvent<false>>();
+  case EventType::ClockSync:
+    return handleEvent.template operator()<ClockSyncEvent<false>>();
+  case EventType::ThreadStart:
+    return handleEvent.template operator()<ThreadStartEvent<false>>();
+  case EventType::ThreadExit:
+    return handleEvent.template operator()<ThreadExitEvent<false>>();
+  case EventType::RecorderMetrics:
+    return handleEvent.template operator()<RecorderMetricsEvent<false>>();
+  case EventType::Category:
+    return handleEvent.template operator()<CategoryEvent<false>>();
+  case EventType::FiberEnter:
+    return handleEvent.template operator()<FiberEnterEvent<false>>();
+  case EventType::FiberLeave:
+    return handleEvent.template operator()<FiberLeaveEvent<false>>();
+  case EventType::Cpu:
+    return handleEvent.template operator()<CpuEvent<false>>();
+  case EventType::Module:
+    return handleEvent.template operator()<ModuleEvent<false>>();
+  case EventType::StackFrames:
+    return handleEvent.template operator()<StackFramesEvent<false>>();
+  case EventType::Stack:
+    return handleEvent.template operator()<StackEvent<false>>();
+  case EventType::Counters:
+    return handleEvent.template operator()<CountersEvent<false>>();
   case EventType::None:
     break;
   }
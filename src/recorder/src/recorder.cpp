@@ -1,19 +1,43 @@
 #include "recorder.h"
 
+#include "blockFormat.h"
+#include "callstack.h"
+#include "mappedBuffer.h"
+#include "perfCounters.h"
 #include "rawEntries.h"
+#include "stringArena.h"
+#include "utilities.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <stop_token>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #ifdef _WIN32
 #include <Windows.h>
 #else
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 namespace TracyRecorder {
 namespace {
@@ -40,117 +64,734 @@ std::string_view getHostName() {
   return hostname;
 }
 
+// Recording times are taken from the monotonic clock, the wall clock is only
+// sampled next to it so playback can follow how far the two drift apart
 struct ReferenceClocks {
   ReferenceClocks() {
     globalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
                      std::chrono::system_clock::now().time_since_epoch())
                      .count();
-    referenceStart = std::chrono::high_resolution_clock::now();
+    referenceStart = std::chrono::steady_clock::now();
   }
 
   uint64_t globalTime;
-  std::chrono::high_resolution_clock::time_point referenceStart;
+  std::chrono::steady_clock::time_point referenceStart;
 } globalReferenceClocks;
 
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() -
+             globalReferenceClocks.referenceStart)
+      .count();
+}
+
+ClockSyncEvent<true> sampleClocks() {
+  // Bracket the wall clock read to get the recording time closest to it
+  auto before = std::chrono::steady_clock::now();
+  auto unixTime = std::chrono::system_clock::now();
+  auto after = std::chrono::steady_clock::now();
+  return ClockSyncEvent<true>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          before + (after - before) / 2 - globalReferenceClocks.referenceStart)
+          .count(),
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          unixTime.time_since_epoch())
+          .count());
+}
+
+// OS thread ID in the low half, a generation in the high half. The OS reuses
+// the IDs of exited threads, the generation keeps recorded threads apart.
+uint64_t makeThreadId() {
+  static std::atomic<uint32_t> generation = 0;
+#ifdef _WIN32
+  uint64_t osThreadId = GetCurrentThreadId();
+#elif defined(__linux__)
+  uint64_t osThreadId = uint32_t(syscall(SYS_gettid));
+#else
+  uint64_t osThreadId =
+      uint32_t(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+#endif
+  return uint64_t(++generation) << 32 | osThreadId;
+}
+
+thread_local uint64_t const currentThreadId = makeThreadId();
+
+constexpr auto mappedDrainInterval = std::chrono::milliseconds(100);
+
+class CategoryRegistry;
+CategoryRegistry &getCategoryRegistry();
+// Category switches the stream doesn't have yet, see CategoryRegistry
+void serializeCategories(uint64_t streamGeneration,
+                         std::vector<std::byte> &out);
+
 std::vector<std::byte> toByteVector(const char *data, size_t size) {
   return std::vector<std::byte>(
       reinterpret_cast<const std::byte *>(data),
       reinterpret_cast<const std::byte *>(data + size));
 }
 
+// Events of the threads started on a range of CPUs, flushed by a worker pinned
+// to those CPUs. A thread keeps its shard, so its events stay in order.
+struct FlushShard {
+  std::mutex mutexData;
+  std::condition_variable_any condData;
+  std::vector<Event<true>> data;
+  // Only used by the first shard, which drains the mapped buffers
+  bool drainRequested = false;
+  uint64_t counterSubmitted = 0;
+
+  std::mutex mutexFlushed;
+  std::condition_variable condFlushed;
+  uint64_t counterFlushed = 0;
+
+  // Keep last, we want to finish this thread before destroying the shard
+  std::jthread worker;
+};
+
+constexpr unsigned maxFlushShards = 64;
+
+// The shard a thread sends its events to. It stays fixed while the workers
+// run, so the thread's batches can't pass each other on different shards.
+struct ShardAssignment {
+  unsigned shard = 0;
+  // Workers the shard was picked for, zero until the first ones start
+  uint64_t generation = 0;
+};
+
+// Published by each recording thread for metrics queries. Only the owning
+// thread writes, so plain relaxed stores are enough.
+struct ThreadCounters {
+  // Claimed by a thread, see ThreadRegistry
+  std::atomic<bool> used = false;
+  std::atomic<uint64_t> threadId = 0;
+  std::atomic<uint64_t> bufferedEvents = 0;
+  // Held by the buffered events, with the text copied for them
+  std::atomic<uint64_t> bufferedBytes = 0;
+  std::atomic<unsigned> shard = 0;
+  // Index of the mapped buffer plus one in the high half, zero without a
+  // ring, the ring in the low half. Packed so readers never see a ring of
+  // another buffer.
+  std::atomic<uint64_t> mappedRing = 0;
+};
+
+// Counters of the recording threads, in chunks that are only ever added.
+// Threads claim and release slots without locks, metrics readers walk the
+// chunks while threads come and go.
+class ThreadRegistry {
+public:
+  ~ThreadRegistry() {
+    for (auto chunk = mHead.load(); chunk;) {
+      delete std::exchange(chunk, chunk->next);
+    }
+  }
+
+  ThreadCounters &claim(uint64_t threadId) {
+    for (auto chunk = mHead.load(std::memory_order_acquire); chunk;
+         chunk = chunk->next) {
+      for (auto &slot : chunk->slots) {
+        if (claim(slot, threadId)) {
+          return slot;
+        }
+      }
+    }
+    auto chunk = new Chunk;
+    claim(chunk->slots[0], threadId);
+    chunk->next = mHead.load(std::memory_order_relaxed);
+    while (!mHead.compare_exchange_weak(chunk->next, chunk,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    return chunk->slots[0];
+  }
+
+  void release(ThreadCounters &slot) {
+    slot.used.store(false, std::memory_order_release);
+  }
+
+  template <class Visit> void forEach(Visit const &visit) const {
+    for (auto chunk = mHead.load(std::memory_order_acquire); chunk;
+         chunk = chunk->next) {
+      for (auto &slot : chunk->slots) {
+        if (slot.used.load(std::memory_order_acquire)) {
+          visit(slot);
+        }
+      }
+    }
+  }
+
+private:
+  struct Chunk {
+    std::array<ThreadCounters, 64> slots;
+    Chunk *next = nullptr;
+  };
+
+  static bool claim(ThreadCounters &slot, uint64_t threadId) {
+    if (slot.used.load(std::memory_order_relaxed) ||
+        slot.used.exchange(true, std::memory_order_acquire)) {
+      return false;
+    }
+    slot.threadId.store(threadId, std::memory_order_relaxed);
+    slot.bufferedEvents.store(0, std::memory_order_relaxed);
+    slot.bufferedBytes.store(0, std::memory_order_relaxed);
+    slot.mappedRing.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  std::atomic<Chunk *> mHead = nullptr;
+};
+
+// Mapped buffers ever attached, newest first. Threads may hold rings of an
+// earlier one, so none is released before the recorder and readers walk them
+// without a lock.
+struct MappedBufferNode {
+  std::unique_ptr<MappedBuffer> buffer;
+  uint32_t index;
+  MappedBufferNode *next;
+};
+
+// Totals over all threads and shards, relaxed since they are only reported
+struct GlobalCounters {
+  std::atomic<uint64_t> submittedEvents = 0;
+  std::atomic<uint64_t> flushedEvents = 0;
+  std::atomic<uint64_t> flushedBytes = 0;
+  std::atomic<uint64_t> flushBatches = 0;
+  std::atomic<uint64_t> largestBatchBytes = 0;
+  std::atomic<uint64_t> outputNanoseconds = 0;
+  std::array<std::atomic<uint64_t>, outputLatencyBuckets> outputLatency{};
+  std::atomic<uint64_t> flushWaits = 0;
+  std::atomic<uint64_t> flushWaitNanoseconds = 0;
+  std::atomic<uint64_t> mappedFallbacks = 0;
+  std::atomic<uint64_t> droppedEvents = 0;
+};
+
+void addCounter(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t readCounter(std::atomic<uint64_t> const &counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+// Time spent blocked on the flush workers, only counted when blocking at all
+class FlushWait {
+public:
+  explicit FlushWait(GlobalCounters &counters)
+      : mCounters(counters), mStart(std::chrono::steady_clock::now()) {}
+  ~FlushWait() {
+    addCounter(mCounters.flushWaits, 1);
+    addCounter(mCounters.flushWaitNanoseconds,
+               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - mStart)
+                   .count());
+  }
+
+private:
+  GlobalCounters &mCounters;
+  std::chrono::steady_clock::time_point mStart;
+};
+
+unsigned cpuCount() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// One flush worker per 16 cores by default
+unsigned defaultFlushShards() {
+  return std::clamp(cpuCount() / 16, 1u, maxFlushShards);
+}
+
+// Unknown where the platform can't tell
+std::optional<unsigned> currentCpu() {
+#ifdef __linux__
+  if (auto cpu = sched_getcpu(); cpu >= 0) {
+    return cpu;
+  }
+#endif
+  return std::nullopt;
+}
+
+// Pins the calling worker to the CPUs of its shard, so the buffers it
+// allocates afterwards are first touched on their NUMA node
+void pinToShardCpus(unsigned shard, unsigned shards) {
+#ifdef __linux__
+  if (shards < 2) {
+    return;
+  }
+  auto cpus = cpuCount();
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  // With more shards than CPUs several shards share one
+  auto first = shard * cpus / shards;
+  auto last = std::max((shard + 1) * cpus / shards, first + 1);
+  for (unsigned cpu = first; cpu < last; ++cpu) {
+    CPU_SET(cpu, &set);
+  }
+  // Best effort, the allowed CPUs may be restricted
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
 class GlobalRecorder {
 public:
-  GlobalRecorder() { mData.reserve(1024); };
+  GlobalRecorder() {
+    mShards[0].data.reserve(1024);
+    // Created first, so it outlives the workers reading it
+    getCategoryRegistry();
+  };
 
   ~GlobalRecorder() {
-    if (flushThread.joinable()) {
-      flushThread.request_stop();
+    stopWorkers();
+    for (auto node = mMappedBuffers.load(); node;) {
+      delete std::exchange(node, node->next);
     }
-    mCondGlobalData.notify_one();
   };
 
-  void flush(uint64_t upToValue) {
-    std::unique_lock<std::mutex> lock(mMutexCounterFlushed);
-    mCondCounterFlushed.wait(
-        lock, [this, upToValue] { return mCounterFlushed >= upToValue; });
+  void flush(unsigned index, uint64_t upToValue) {
+    auto &shard = mShards[index];
+    std::unique_lock<std::mutex> lock(shard.mutexFlushed);
+    if (shard.counterFlushed >= upToValue) {
+      return;
+    }
+    FlushWait wait(mCounters);
+    shard.condFlushed.wait(lock, [&shard, upToValue] {
+      return shard.counterFlushed >= upToValue;
+    });
   }
 
   void
   setOutput(const std::function<void(std::vector<std::byte> const &)> &output) {
+    stopWorkers();
     mOutput = output;
 
     std::string_view header = "TRCYPLAY\1\0\0\0";
     auto startMessage = toByteVector(header.data(), 12);
-    Event(StartEvent<true>(getHostName(), globalReferenceClocks.globalTime,
-                           getpid()))
-        .serialize(startMessage);
+    serializeStartEvent(startMessage);
     mOutput(std::move(startMessage));
+    ++mStreamGeneration;
+
+    // Events left from before go out ahead of the new workers, threads pick
+    // their shards again and must not get ahead of them
+    auto shards = mRequestedShards.load();
+    std::vector<Event<true>> leftover;
+    std::array<uint64_t, maxFlushShards> leftoverCounts{};
+    {
+      std::array<std::unique_lock<std::mutex>, maxFlushShards> locks;
+      for (unsigned i = 0; i < maxFlushShards; ++i) {
+        locks[i] = std::unique_lock(mShards[i].mutexData);
+        auto &data = mShards[i].data;
+        leftoverCounts[i] = data.size();
+        leftover.insert(leftover.end(), data.begin(), data.end());
+        data.clear();
+      }
+      mShardCount = shards;
+      ++mWorkerGeneration;
+    }
+    if (!leftover.empty()) {
+      std::vector<std::byte> rawMessage;
+      auto block = beginBlock(rawMessage);
+      for (auto &event : leftover) {
+        event.serialize(rawMessage);
+      }
+      endBlock(rawMessage, block);
+      auto outputStart = std::chrono::steady_clock::now();
+      mOutput(rawMessage);
+      countBatch(leftover.size(), rawMessage.size(),
+                 std::chrono::steady_clock::now() - outputStart);
+    }
+    for (unsigned i = 0; i < maxFlushShards; ++i) {
+      if (leftoverCounts[i] > 0) {
+        std::scoped_lock lock(mShards[i].mutexFlushed);
+        mShards[i].counterFlushed += leftoverCounts[i];
+        mShards[i].condFlushed.notify_all();
+      }
+    }
+
+    for (unsigned i = 0; i < shards; ++i) {
+      mShards[i].worker =
+          std::jthread(&GlobalRecorder::flushThreadFunc, this, i, shards);
+    }
+    mFlushing = true;
+  }
+
+  void setFlushShards(unsigned shards) {
+    mRequestedShards =
+        shards == 0 ? defaultFlushShards() : std::min(shards, maxFlushShards);
+  }
 
-    flushThread = std::jthread(&GlobalRecorder::flushThreadFunc, this);
+  void setMappedBuffer(std::optional<MappedBufferOptions> const &options) {
+    if (!options) {
+      // Drained once more for what the threads wrote last, after that the
+      // rings are only drained when their threads flush
+      mMappedBuffer = nullptr;
+      requestDrain();
+      return;
+    }
+    std::vector<std::byte> startEvent;
+    serializeStartEvent(startEvent);
+    auto node = new MappedBufferNode{
+        std::make_unique<MappedBuffer>(*options, startEvent), 0, nullptr};
+
+    // Threads may still hold rings of a previous buffer, it is kept alive and
+    // drained until the recorder goes away
+    node->next = mMappedBuffers.load(std::memory_order_relaxed);
+    do {
+      node->index = node->next ? node->next->index + 1 : 0;
+    } while (!mMappedBuffers.compare_exchange_weak(node->next, node,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+    mMappedBuffer = node->buffer.get();
+    ++mStreamGeneration;
+  }
+
+  MappedBuffer *mappedBuffer() const { return mMappedBuffer; }
+
+  bool flushing() const { return mFlushing; }
+
+  // Falls back to in-memory buffering by returning false, when the event
+  // doesn't fit the ring at all or nothing drains the ring
+  bool writeMapped(MappedBuffer &buffer, uint32_t ring,
+                   std::span<std::byte const> event) {
+    if (event.size() > buffer.ringBytes()) {
+      return false;
+    }
+    auto &drainer = mShards[0];
+    std::optional<FlushWait> wait;
+    while (!buffer.write(ring, event)) {
+      if (!mFlushing) {
+        return false;
+      }
+      if (!wait) {
+        wait.emplace(mCounters);
+      }
+      requestDrain();
+      std::unique_lock lock(drainer.mutexFlushed);
+      drainer.condFlushed.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    return true;
   }
 
-  uint64_t sendRecord(std::vector<Event<true>> &data) {
+  void flushMapped(MappedBuffer &buffer, uint32_t ring) {
+    auto committed = buffer.committed(ring);
+    if (!mFlushing || buffer.consumed(ring) >= committed) {
+      return;
+    }
+    requestDrain();
+    auto &drainer = mShards[0];
+    FlushWait wait(mCounters);
+    std::unique_lock lock(drainer.mutexFlushed);
+    drainer.condFlushed.wait(lock, [&buffer, ring, committed] {
+      return buffer.consumed(ring) >= committed;
+    });
+  }
+
+  // Picks the thread's shard again once setOutput restarted the workers. The
+  // generation is checked under the shard's lock, setOutput takes the events
+  // left over under all of them.
+  uint64_t sendRecord(ShardAssignment &assigned, unsigned homeCpu,
+                      std::vector<Event<true>> &data) {
     uint64_t size = data.size();
-    std::scoped_lock lock(mMutexGlobalData);
+    while (true) {
+      auto generation = mWorkerGeneration.load();
+      if (assigned.generation != generation) {
+        assigned = {pickShard(homeCpu), generation};
+      }
+      auto &shard = mShards[assigned.shard];
+      std::scoped_lock lock(shard.mutexData);
+      if (mWorkerGeneration.load() != assigned.generation) {
+        continue;
+      }
 
-    if (mData.empty()) {
-      std::swap(mData, data);
-    } else {
-      mData.insert(mData.end(), data.begin(), data.end());
-      data.clear();
+      if (shard.data.empty()) {
+        std::swap(shard.data, data);
+      } else {
+        shard.data.insert(shard.data.end(), data.begin(), data.end());
+        data.clear();
+      }
+
+      shard.condData.notify_one();
+      addCounter(mCounters.submittedEvents, size);
+      return shard.counterSubmitted += size;
     }
+  }
+
+  void setClockSyncInterval(std::chrono::nanoseconds interval) {
+    mClockSyncInterval = interval;
+  }
+
+  void setCpuTracking(bool enabled) {
+    mCpuTracking.store(enabled, std::memory_order_relaxed);
+  }
+  bool cpuTracking() const {
+    return mCpuTracking.load(std::memory_order_relaxed);
+  }
+
+  void setPerfCounters(bool enabled) {
+    mPerfCounters.store(enabled, std::memory_order_relaxed);
+  }
+  bool perfCounters() const {
+    return mPerfCounters.load(std::memory_order_relaxed);
+  }
+
+  // Changes whenever events start going to a new stream, which needs the
+  // stacks defined again
+  uint64_t streamGeneration() const {
+    return mStreamGeneration.load(std::memory_order_relaxed);
+  }
+
+  void setMetricsInterval(std::chrono::nanoseconds interval) {
+    mMetricsInterval = interval;
+  }
+
+  GlobalCounters &counters() { return mCounters; }
+
+  // Ring of the thread in the packed form of ThreadCounters::mappedRing
+  uint64_t packMappedRing(MappedBuffer *buffer, uint32_t ring) {
+    for (auto node = mMappedBuffers.load(std::memory_order_acquire); node;
+         node = node->next) {
+      if (node->buffer.get() == buffer) {
+        return uint64_t(node->index + 1) << 32 | ring;
+      }
+    }
+    return 0;
+  }
+
+  ThreadCounters &registerThread(uint64_t threadId) {
+    return mThreads.claim(threadId);
+  }
+
+  void unregisterThread(ThreadCounters &thread) { mThreads.release(thread); }
+
+  ThreadMetrics threadMetrics(ThreadCounters const &thread) {
+    ThreadMetrics metrics{readCounter(thread.threadId),
+                          readCounter(thread.bufferedEvents)};
+    metrics.shard = thread.shard.load(std::memory_order_relaxed);
+    metrics.bufferedBytes = readCounter(thread.bufferedBytes);
+    auto packed = readCounter(thread.mappedRing);
+    for (auto node = mMappedBuffers.load(std::memory_order_acquire);
+         packed && node; node = node->next) {
+      if (node->index + 1 == packed >> 32) {
+        auto ring = uint32_t(packed);
+        metrics.bufferedBytes +=
+            node->buffer->committed(ring) - node->buffer->consumed(ring);
+      }
+    }
+    return metrics;
+  }
 
-    mCondGlobalData.notify_one();
-    return mCounterSubmitted += size;
+  RecorderMetrics metrics() {
+    RecorderMetrics metrics;
+    mThreads.forEach([&](ThreadCounters const &thread) {
+      metrics.threads.push_back(threadMetrics(thread));
+      metrics.bufferedEvents += metrics.threads.back().bufferedEvents;
+      metrics.bufferedBytes += metrics.threads.back().bufferedBytes;
+    });
+    // Flushed is read first, it never gets ahead of submitted that way
+    metrics.flushedEvents = readCounter(mCounters.flushedEvents);
+    metrics.queuedEvents =
+        readCounter(mCounters.submittedEvents) - metrics.flushedEvents;
+    metrics.flushedBytes = readCounter(mCounters.flushedBytes);
+    metrics.flushBatches = readCounter(mCounters.flushBatches);
+    metrics.largestBatchBytes = readCounter(mCounters.largestBatchBytes);
+    metrics.outputNanoseconds = readCounter(mCounters.outputNanoseconds);
+    for (size_t i = 0; i < outputLatencyBuckets; ++i) {
+      metrics.outputLatency[i] = readCounter(mCounters.outputLatency[i]);
+    }
+    metrics.flushWaits = readCounter(mCounters.flushWaits);
+    metrics.flushWaitNanoseconds = readCounter(mCounters.flushWaitNanoseconds);
+    metrics.mappedFallbacks = readCounter(mCounters.mappedFallbacks);
+    metrics.droppedEvents = readCounter(mCounters.droppedEvents);
+    return metrics;
   }
 
 private:
-  void flushThreadFunc(std::stop_token stop_token) {
+  void serializeStartEvent(std::vector<std::byte> &out) {
+    Event(StartEvent<true>(getHostName(), globalReferenceClocks.globalTime,
+                           getpid()))
+        .serialize(out);
+  }
+
+  void requestDrain() {
+    std::scoped_lock lock(mShards[0].mutexData);
+    mShards[0].drainRequested = true;
+    mShards[0].condData.notify_one();
+  }
+
+  void stopWorkers() {
+    for (auto &shard : mShards) {
+      if (shard.worker.joinable()) {
+        shard.worker.request_stop();
+        shard.worker.join();
+      }
+    }
+  }
+
+  // Whichever worker outputs first once the interval passed records the sync
+  // point. Playback sorts them, the order between shards doesn't matter.
+  bool claimClockSync() {
+    auto now = std::chrono::steady_clock::now();
+    auto last = mLastClockSync.load();
+    return now - last >= mClockSyncInterval.load() &&
+           mLastClockSync.compare_exchange_strong(last, now);
+  }
+
+  bool claimMetrics() {
+    auto interval = mMetricsInterval.load();
+    auto now = std::chrono::steady_clock::now();
+    auto last = mLastMetrics.load();
+    return interval.count() > 0 && now - last >= interval &&
+           mLastMetrics.compare_exchange_strong(last, now);
+  }
+
+  // Threads go to the shards of their home CPU, dealt out in turn where a CPU
+  // has several
+  unsigned pickShard(unsigned homeCpu) {
+    auto shards = mShardCount.load();
+    auto cpus = cpuCount();
+    auto cpu = homeCpu % cpus;
+    auto first = cpu * shards / cpus;
+    auto count = std::max((cpu + 1) * shards / cpus, first + 1) - first;
+    return first + mNextShard.fetch_add(1) % count;
+  }
+
+  void countBatch(uint64_t events, uint64_t bytes,
+                  std::chrono::nanoseconds outputTime) {
+    addCounter(mCounters.flushedEvents, events);
+    addCounter(mCounters.flushedBytes, bytes);
+    addCounter(mCounters.flushBatches, 1);
+    auto &largest = mCounters.largestBatchBytes;
+    for (auto seen = readCounter(largest);
+         bytes > seen && !largest.compare_exchange_weak(
+                             seen, bytes, std::memory_order_relaxed);) {
+    }
+    addCounter(mCounters.outputNanoseconds, outputTime.count());
+    auto microseconds =
+        std::chrono::duration_cast<std::chrono::microseconds>(outputTime);
+    auto bucket =
+        std::min<size_t>(std::bit_width(uint64_t(microseconds.count())),
+                         outputLatencyBuckets - 1);
+    addCounter(mCounters.outputLatency[bucket], 1);
+  }
+
+  void flushThreadFunc(std::stop_token stop_token, unsigned index,
+                       unsigned shards) {
+    pinToShardCpus(index, shards);
+    auto &shard = mShards[index];
+    bool drainsMapped = index == 0;
+
     std::vector<Event<true>> data;
     data.reserve(1024);
     std::vector<std::byte> rawMessage;
     rawMessage.reserve(1024 * 128);
+    std::vector<std::byte> clockSync;
+    std::vector<std::byte> metrics;
+    std::vector<std::byte> categories;
+
+    std::vector<MappedBuffer *> mappedBuffers;
 
     while (!stop_token.stop_requested()) {
       {
-        std::unique_lock<std::mutex> lock(mMutexGlobalData);
-        mCondGlobalData.wait(lock, stop_token,
-                             [&stop_token, this] { return !mData.empty(); });
-        std::swap(data, mData);
+        std::unique_lock<std::mutex> lock(shard.mutexData);
+        auto ready = [&shard] {
+          return !shard.data.empty() || shard.drainRequested;
+        };
+        // Rings fill without waking this thread, they are drained periodically
+        // while a mapped buffer is attached
+        if (!drainsMapped || !mMappedBuffer.load()) {
+          shard.condData.wait(lock, stop_token, ready);
+        } else {
+          shard.condData.wait_for(lock, stop_token, mappedDrainInterval,
+                                  ready);
+        }
+        std::swap(data, shard.data);
+        shard.drainRequested = false;
+        mappedBuffers.clear();
+        for (auto node = drainsMapped ? mMappedBuffers.load() : nullptr; node;
+             node = node->next) {
+          mappedBuffers.push_back(node->buffer.get());
+        }
       }
 
-      if (data.empty()) {
+      if (data.empty() && mappedBuffers.empty()) {
         continue;
       }
 
+      // Serializing runs in parallel on all shards
       uint64_t size = data.size();
+      auto block = beginBlock(rawMessage);
       for (auto &event : data) {
         event.serialize(rawMessage);
       }
-      mOutput(rawMessage);
+      // Ring events are already serialized, they are only copied out
+      std::vector<std::vector<uint64_t>> positions;
+      for (auto buffer : mappedBuffers) {
+        positions.push_back(buffer->drain(rawMessage));
+      }
+
+      if (rawMessage.size() > block + blockHeaderSize) {
+        if (claimClockSync()) {
+          clockSync.clear();
+          Event(sampleClocks()).serialize(clockSync);
+          rawMessage.insert(rawMessage.begin() + block + blockHeaderSize,
+                            clockSync.begin(), clockSync.end());
+        }
+        categories.clear();
+        serializeCategories(mStreamGeneration, categories);
+        rawMessage.insert(rawMessage.begin() + block + blockHeaderSize,
+                          categories.begin(), categories.end());
+        if (claimMetrics()) {
+          metrics.clear();
+          Event(RecorderMetricsEvent<true>(now(), this->metrics()))
+              .serialize(metrics);
+          rawMessage.insert(rawMessage.end(), metrics.begin(), metrics.end());
+        }
+        endBlock(rawMessage, block);
+        std::scoped_lock lock(mMutexOutput);
+        auto outputStart = std::chrono::steady_clock::now();
+        mOutput(rawMessage);
+        countBatch(size, rawMessage.size(),
+                   std::chrono::steady_clock::now() - outputStart);
+      }
+      for (size_t i = 0; i < mappedBuffers.size(); ++i) {
+        mappedBuffers[i]->release(positions[i]);
+      }
       data.clear();
       rawMessage.clear();
 
       {
-        std::scoped_lock lock(mMutexCounterFlushed);
-        mCounterFlushed += size;
-        mCondCounterFlushed.notify_one();
+        std::scoped_lock lock(shard.mutexFlushed);
+        shard.counterFlushed += size;
+        shard.condFlushed.notify_all();
       }
     }
   }
   std::function<void(std::vector<std::byte> const &)> mOutput;
+  // Batches of the shards are written whole, one at a time
+  std::mutex mMutexOutput;
+  std::atomic<bool> mCpuTracking = false;
+  std::atomic<bool> mPerfCounters = false;
+  std::atomic<uint64_t> mStreamGeneration = 0;
+  std::atomic<std::chrono::nanoseconds> mClockSyncInterval{
+      std::chrono::seconds(1)};
+  std::atomic<std::chrono::steady_clock::time_point> mLastClockSync{
+      std::chrono::steady_clock::now()};
+  std::atomic<std::chrono::nanoseconds> mMetricsInterval{};
+  std::atomic<std::chrono::steady_clock::time_point> mLastMetrics{};
 
-  std::mutex mMutexGlobalData;
-  std::condition_variable_any mCondGlobalData;
-  std::vector<Event<true>> mData;
-  uint64_t mCounterSubmitted = 0;
+  GlobalCounters mCounters;
+  ThreadRegistry mThreads;
+
+  std::atomic<bool> mFlushing = false;
 
-  std::mutex mMutexCounterFlushed;
-  std::condition_variable mCondCounterFlushed;
-  uint64_t mCounterFlushed = 0;
+  std::atomic<unsigned> mRequestedShards = defaultFlushShards();
+  std::atomic<unsigned> mShardCount = 1;
+  // Bumped whenever setOutput restarts the workers
+  std::atomic<uint64_t> mWorkerGeneration = 0;
+  std::atomic<unsigned> mNextShard = 0;
 
-  // Keep last, we want to finish this thread before destroying the main object
-  std::jthread flushThread;
+  std::atomic<MappedBufferNode *> mMappedBuffers = nullptr;
+  std::atomic<MappedBuffer *> mMappedBuffer = nullptr;
+
+  // Keep last, the workers must finish before destroying the main object
+  std::array<FlushShard, maxFlushShards> mShards;
 };
 
 GlobalRecorder &getGlobalRecorder() {
@@ -158,64 +799,610 @@ GlobalRecorder &getGlobalRecorder() {
   return recorder;
 }
 
+// Open zones of the fibers not running right now. A fiber picks its depth up
+// on whichever thread enters it next, along with the ID it was handed over
+// under.
+class FiberZoneDepths {
+public:
+  struct Suspended {
+    uint32_t depth = 0;
+    uint64_t handover = 0;
+  };
+
+  Suspended take(uint64_t fiberId) {
+    // Fibers usually switch with no zone open, that needs no lock
+    if (mStored.load(std::memory_order_relaxed) == 0) {
+      return {};
+    }
+    std::scoped_lock lock(mMutex);
+    auto node = mDepths.extract(fiberId);
+    mStored = mDepths.size();
+    return node ? node.mapped() : Suspended{};
+  }
+
+  // Returns the handover ID, zero when no zone is open
+  uint64_t store(uint64_t fiberId, uint32_t depth) {
+    if (depth == 0) {
+      return 0;
+    }
+    std::scoped_lock lock(mMutex);
+    auto handover = ++mHandovers;
+    mDepths[fiberId] = {depth, handover};
+    mStored = mDepths.size();
+    return handover;
+  }
+
+private:
+  std::mutex mMutex;
+  std::unordered_map<uint64_t, Suspended> mDepths;
+  std::atomic<size_t> mStored = 0;
+  uint64_t mHandovers = 0;
+};
+
+FiberZoneDepths &getFiberZoneDepths() {
+  static FiberZoneDepths depths;
+  return depths;
+}
+
+// Unique stacks stop being recorded past this many
+constexpr size_t maxStacks = 1 << 16;
+
+uint64_t hashFrames(std::span<uint64_t const> frames) {
+  uint64_t hash = frames.size();
+  for (auto frame : frames) {
+    hash = std::rotl(hash ^ frame, 29) * 0x9E3779B97F4A7C15;
+  }
+  return hash;
+}
+
+// Stacks captured by any thread, each unique one gets an ID. Stacks and
+// modules are never released, recorded events refer to them until flushed.
+class StackTable {
+public:
+  struct Stack {
+    uint32_t id;
+    std::span<uint64_t const> frames;
+  };
+
+  // Nothing once the table is full
+  std::optional<Stack> intern(std::span<uint64_t const> frames,
+                              uint64_t hash) {
+    std::scoped_lock lock(mMutex);
+    auto [first, last] = mIds.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+      if (std::ranges::equal(mStacks[it->second], frames)) {
+        return Stack{it->second, mStacks[it->second]};
+      }
+    }
+    if (mStacks.size() == maxStacks) {
+      return std::nullopt;
+    }
+    auto id = uint32_t(mStacks.size());
+    mStacks.emplace_back(frames.begin(), frames.end());
+    mIds.emplace(hash, id);
+    // Libraries loaded since the last scan show up with their first frame
+    if (!std::ranges::all_of(frames, [this](uint64_t frame) {
+          return covered(frame);
+        })) {
+      scanModules();
+    }
+    return Stack{id, mStacks.back()};
+  }
+
+  // Modules found since the first ones the caller already knows
+  std::vector<LoadedModule const *> modules(size_t known) {
+    std::scoped_lock lock(mMutex);
+    std::vector<LoadedModule const *> result;
+    for (size_t i = known; i < mModules.size(); ++i) {
+      result.push_back(&mModules[i]);
+    }
+    return result;
+  }
+
+private:
+  bool covered(uint64_t address) const {
+    return std::ranges::any_of(mModules, [address](auto const &module) {
+      return address - module.start < module.size;
+    });
+  }
+
+  void scanModules() {
+    for (auto &module : loadedModules()) {
+      if (std::ranges::none_of(mModules, [&module](auto const &known) {
+            return known.base == module.base && known.path == module.path;
+          })) {
+        mModules.push_back(std::move(module));
+      }
+    }
+  }
+
+  std::mutex mMutex;
+  std::unordered_multimap<uint64_t, uint32_t> mIds;
+  std::deque<std::vector<uint64_t>> mStacks;
+  std::deque<LoadedModule> mModules;
+};
+
+StackTable &getStackTable() {
+  static StackTable table;
+  return table;
+}
+
 class LocalRecorder {
 public:
-  LocalRecorder() { mData.reserve(1024); };
+  LocalRecorder()
+      : mThreadId(currentThreadId), mHomeCpu(currentCpu().value_or(0)),
+        mCounters(getGlobalRecorder().registerThread(mThreadId)) {
+    mData.reserve(1024);
+    record(ThreadStartEvent<true>(mThreadId, now()));
+  };
 
-  ~LocalRecorder() { flush(); };
+  ~LocalRecorder() {
+    record(ThreadExitEvent<true>(mThreadId, now()));
+    flush();
+    getGlobalRecorder().unregisterThread(mCounters);
+    if (mRing) {
+      mMappedBuffer->releaseRing(*mRing);
+    }
+  };
 
+  // Events in mData were all recorded after those in the ring, they go first
   void flush() {
-    auto &global = getGlobalRecorder();
-    global.flush(global.sendRecord(mData));
+    flushData();
+    if (mRing) {
+      getGlobalRecorder().flushMapped(*mMappedBuffer, *mRing);
+    }
+  }
+
+  ThreadMetrics metrics() {
+    return getGlobalRecorder().threadMetrics(mCounters);
   }
 
   void zoneBegin(uint32_t line, std::string_view file,
                  std::string_view function, std::string_view name,
-                 uint32_t color) {
-    mData.push_back(TracyRecorder::StartZoneEvent<true>(
-        color, line, file, function, name,
-        std::bit_cast<uint64_t>(std::this_thread::get_id()),
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now() -
-            globalReferenceClocks.referenceStart)
-            .count()));
+                 uint32_t color, std::span<uint64_t const> stack = {}) {
+    auto time = now();
+    trackCpu(time);
+    trackCounters(time);
+    recordStack(stack, time);
+    record(TracyRecorder::StartZoneEvent<true>(color, line, file, function,
+                                               name, mThreadId, time));
+    ++mZoneDepth;
   }
 
   void zoneEnd() {
-    mData.push_back(TracyRecorder::EndZoneEvent<true>(
-        std::bit_cast<uint64_t>(std::this_thread::get_id()),
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now() -
-            globalReferenceClocks.referenceStart)
-            .count()));
+    if (mZoneDepth > 0) {
+      --mZoneDepth;
+    }
+    auto time = now();
+    trackCpu(time);
+    trackCounters(time);
+    record(TracyRecorder::EndZoneEvent<true>(mThreadId, time));
+  }
+
+  template <class ZoneAnnotation, class Value>
+  void zoneAnnotation(Value value) {
+    if (mZoneDepth == 0) {
+      addCounter(getGlobalRecorder().counters().droppedEvents, 1);
+      return;
+    }
+    if constexpr (std::is_same_v<Value, std::string_view>) {
+      recordText(ZoneAnnotation(value, mThreadId, now()));
+    } else {
+      record(ZoneAnnotation(value, mThreadId, now()));
+    }
   }
 
   void nameThread(std::string_view name) {
-    mData.push_back(TracyRecorder::ThreadNameEvent<true>(
-        name, std::bit_cast<uint64_t>(std::this_thread::get_id()),
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now() -
-            globalReferenceClocks.referenceStart)
-            .count()));
+    recordText(TracyRecorder::ThreadNameEvent<true>(name, mThreadId, now()));
+  }
+
+  // Literals are recorded as they are, other text is copied
+  void message(std::string_view message, uint32_t color, bool literal,
+               std::span<uint64_t const> stack = {}) {
+    auto time = now();
+    recordStack(stack, time);
+    TracyRecorder::MessageEvent<true> event(message, color, mThreadId, time);
+    if (literal) {
+      record(std::move(event));
+    } else {
+      recordText(std::move(event));
+    }
+  }
+
+  void frameMark(std::string_view name, FrameMarkKind kind) {
+    record(TracyRecorder::FrameMarkEvent<true>(name, kind, mThreadId, now()));
+  }
+
+  void fiberEnter(uint64_t fiberId, std::string_view name) {
+    uint64_t handover = 0;
+    if (mFiberId) {
+      handover = suspendFiber();
+    } else {
+      mThreadZoneDepth = mZoneDepth;
+    }
+    mFiberId = fiberId;
+    auto suspended = getFiberZoneDepths().take(fiberId);
+    mZoneDepth = suspended.depth;
+    record(TracyRecorder::FiberEnterEvent<true>(
+        fiberId, name, handover, suspended.handover, mThreadId, now()));
+  }
+
+  void fiberLeave() {
+    if (!mFiberId) {
+      return;
+    }
+    auto handover = suspendFiber();
+    record(TracyRecorder::FiberLeaveEvent<true>(handover, mThreadId, now()));
+    mFiberId.reset();
+    mZoneDepth = mThreadZoneDepth;
+  }
+
+private:
+  // Zones left open may end on whichever thread enters the fiber next, whose
+  // batch may be written first. The handover ID lets readers put the fiber's
+  // events back in order.
+  uint64_t suspendFiber() {
+    return getFiberZoneDepths().store(*mFiberId, mZoneDepth);
+  }
+
+  void trackCpu(uint64_t time) {
+    // Recorded again once tracking is back on, the thread may have moved
+    // in between
+    if (!getGlobalRecorder().cpuTracking()) {
+      mCpu.reset();
+      return;
+    }
+    auto cpu = currentCpu();
+    if (cpu && cpu != mCpu) {
+      record(CpuEvent<true>(*cpu, mThreadId, time));
+    }
+    mCpu = cpu;
+  }
+
+  void trackCounters(uint64_t time) {
+    // Read afresh once counting is back on, what ran in between belongs to
+    // no zone boundary
+    if (!getGlobalRecorder().perfCounters()) {
+      mCounterValues.reset();
+      return;
+    }
+    if (!mPerfCounters) {
+      mPerfCounters.emplace();
+    }
+    CounterValues values;
+    if (!mPerfCounters->read(values)) {
+      return;
+    }
+    CounterValues deltas{};
+    for (size_t i = 0; mCounterValues && i < counterCount; ++i) {
+      deltas[i] = values[i] - (*mCounterValues)[i];
+    }
+    mCounterValues = values;
+    record(CountersEvent<true>(mPerfCounters->available(), deltas, mThreadId,
+                               time));
+  }
+
+  // Defines the stack in the stream the first time the thread uses it, along
+  // with the modules it hasn't recorded yet
+  void recordStack(std::span<uint64_t const> frames, uint64_t time) {
+    if (frames.empty()) {
+      return;
+    }
+    auto &global = getGlobalRecorder();
+    if (auto generation = global.streamGeneration();
+        generation != mStackGeneration) {
+      mStackGeneration = generation;
+      mStacks.clear();
+      mModulesRecorded = 0;
+    }
+    auto hash = hashFrames(frames);
+    auto known = mStacks.find(hash);
+    if (known == mStacks.end() ||
+        !std::ranges::equal(known->second.frames, frames)) {
+      auto &table = getStackTable();
+      auto stack = table.intern(frames, hash);
+      if (!stack) {
+        addCounter(global.counters().droppedEvents, 1);
+        return;
+      }
+      for (auto module : table.modules(mModulesRecorded)) {
+        record(ModuleEvent<true>(module->path, module->base, module->start,
+                                 module->size, mThreadId, time));
+        ++mModulesRecorded;
+      }
+      record(StackFramesEvent<true>(stack->id, stack->frames, mThreadId, time));
+      known = mStacks.insert_or_assign(hash, *stack).first;
+    }
+    record(StackEvent<true>(known->second.id, mThreadId, time));
+  }
+
+  void record(Event<true> &&event) {
+    if (!recordMapped(event)) {
+      buffer(std::move(event));
+    }
+  }
+
+  // For events holding text of the caller. The ring serializes it right
+  // away, it is only copied when the event has to wait in mData.
+  void recordText(Event<true> &&event) {
+    if (recordMapped(event)) {
+      return;
+    }
+    auto copy = [this](std::string_view text) {
+      mBufferedBytes += text.size();
+      return mText.copy(text);
+    };
+    std::visit(
+        overloads{
+            [&](ThreadNameEvent<true> &name) { name.name = copy(name.name); },
+            [&](MessageEvent<true> &message) {
+              message.message = copy(message.message);
+            },
+            [&](ZoneTextEvent<true> &text) { text.text = copy(text.text); },
+            [](auto &) {}},
+        event.event);
+    buffer(std::move(event));
+  }
+
+  // Events falling back to mData stay in order with the ring: the ring is
+  // flushed before one falls back, and mData before the ring is written again
+  bool recordMapped(Event<true> const &event) {
+    auto ring = mappedRing();
+    if (!ring) {
+      return false;
+    }
+    auto &global = getGlobalRecorder();
+    if (!mData.empty() && global.flushing()) {
+      flushData();
+    }
+    mScratch.clear();
+    event.serialize(mScratch);
+    if (global.writeMapped(*mMappedBuffer, *ring, mScratch)) {
+      return true;
+    }
+    addCounter(global.counters().mappedFallbacks, 1);
+    if (global.flushing()) {
+      global.flushMapped(*mMappedBuffer, *ring);
+    }
+    return false;
+  }
+
+  void flushData() {
+    auto &global = getGlobalRecorder();
+    auto upTo = global.sendRecord(mShard, mHomeCpu, mData);
+    mCounters.bufferedEvents.store(0, std::memory_order_relaxed);
+    mBufferedBytes = 0;
+    mCounters.bufferedBytes.store(0, std::memory_order_relaxed);
+    mCounters.shard.store(mShard.shard, std::memory_order_relaxed);
+    global.flush(mShard.shard, upTo);
+    // Everything referencing the copied text is serialized by now
+    mText.reset();
+  }
+
+  void buffer(Event<true> &&event) {
+    mData.push_back(std::move(event));
+    mBufferedBytes += sizeof(Event<true>);
+    mCounters.bufferedEvents.store(mData.size(), std::memory_order_relaxed);
+    mCounters.bufferedBytes.store(mBufferedBytes, std::memory_order_relaxed);
   }
 
-  void message(std::string_view message, uint32_t color) {
-    mData.push_back(TracyRecorder::MessageEvent<true>(
-        message, color, std::bit_cast<uint64_t>(std::this_thread::get_id()),
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now() -
-            globalReferenceClocks.referenceStart)
-            .count()));
+  std::optional<uint32_t> mappedRing() {
+    auto &global = getGlobalRecorder();
+    auto buffer = global.mappedBuffer();
+    if (buffer != mMappedBuffer) {
+      mCounters.mappedRing.store(0, std::memory_order_relaxed);
+      if (mRing) {
+        mMappedBuffer->releaseRing(*mRing);
+      }
+      mMappedBuffer = buffer;
+      mRing = buffer ? buffer->acquireRing() : std::nullopt;
+      if (mRing) {
+        mCounters.mappedRing.store(global.packMappedRing(buffer, *mRing),
+                                   std::memory_order_relaxed);
+      }
+    }
+    return mRing;
   }
 
 public:
+  uint64_t mThreadId;
+  // CPU the thread started on, picks its flush shard
+  unsigned mHomeCpu;
+  ShardAssignment mShard;
+  // Last one recorded with CPU tracking on
+  std::optional<unsigned> mCpu;
+  // Opened on the first zone boundary with counters on
+  std::optional<PerfCounters> mPerfCounters;
+  // Last read, the baseline of the next deltas
+  std::optional<CounterValues> mCounterValues;
+  // Stacks the thread defined in the current stream, by hash
+  std::unordered_map<uint64_t, StackTable::Stack> mStacks;
+  uint64_t mStackGeneration = 0;
+  size_t mModulesRecorded = 0;
   std::vector<Event<true>> mData;
+  // Text of the events in mData that the caller may release, events written
+  // to a ring need no copy
+  StringArena mText;
+  // The events in mData plus their copied text
+  uint64_t mBufferedBytes = 0;
+  // Of the running fiber, if any
   uint32_t mZoneDepth = 0;
+  std::optional<uint64_t> mFiberId;
+  // The thread's own depth while it runs a fiber
+  uint32_t mThreadZoneDepth = 0;
+  MappedBuffer *mMappedBuffer = nullptr;
+  std::optional<uint32_t> mRing;
+  std::vector<std::byte> mScratch;
+  // Owned by the registry, which outlives the thread
+  ThreadCounters &mCounters;
 };
 
 thread_local LocalRecorder localRecorder;
+
+constexpr size_t maxCategories = 1024;
+
+bool matchesCategory(std::string_view pattern, std::string_view name) {
+  if (pattern.ends_with('*')) {
+    return name.starts_with(pattern.substr(0, pattern.size() - 1));
+  }
+  return name == pattern;
+}
+
+// Switches of all categories. Names are never released, pending switches
+// reference them. Switches are queued here rather than recorded by the
+// switching thread, the flush workers put them ahead of their next batch.
+class CategoryRegistry {
+public:
+  CategoryRegistry() {
+    if (auto switches = std::getenv(categoriesVariable)) {
+      setCategories(switches);
+    }
+  }
+
+  std::atomic<bool> const *add(std::string_view name, bool enabledByDefault) {
+    std::scoped_lock lock(mMutex);
+    if (auto it = mIndices.find(name); it != mIndices.end()) {
+      return &mFlags[it->second];
+    }
+    if (mIndices.size() == maxCategories) {
+      throw std::length_error("Too many instrumentation categories");
+    }
+    auto index = mIndices.size();
+    auto &storedName = mIndices.emplace(name, index).first->first;
+    bool enabled = enabledByDefault;
+    for (auto &[pattern, value] : mRules) {
+      if (matchesCategory(pattern, storedName)) {
+        enabled = value;
+      }
+    }
+    mFlags[index].store(enabled, std::memory_order_relaxed);
+    addSwitch(storedName, enabled);
+    return &mFlags[index];
+  }
+
+  void setEnabled(std::string_view pattern, bool enabled) {
+    std::scoped_lock lock(mMutex);
+    // A later rule for the same pattern overrides everything the earlier one
+    // did, only the latest is kept
+    std::erase_if(mRules, [pattern](auto const &rule) {
+      return rule.first == pattern;
+    });
+    mRules.emplace_back(pattern, enabled);
+    for (auto &[name, index] : mIndices) {
+      if (matchesCategory(pattern, name) &&
+          mFlags[index].exchange(enabled, std::memory_order_relaxed) !=
+              enabled) {
+        addSwitch(name, enabled);
+      }
+    }
+  }
+
+  void setCategories(std::string_view switches) {
+    while (!switches.empty()) {
+      auto end = std::min(switches.find(','), switches.size());
+      auto pattern = switches.substr(0, end);
+      switches.remove_prefix(std::min(end + 1, switches.size()));
+
+      auto first = pattern.find_first_not_of(' ');
+      if (first == std::string_view::npos) {
+        continue;
+      }
+      auto last = pattern.find_last_not_of(' ');
+      pattern = pattern.substr(first, last + 1 - first);
+      bool enabled = !pattern.starts_with('-');
+      if (!enabled) {
+        pattern.remove_prefix(1);
+      }
+      setEnabled(pattern, enabled);
+    }
+  }
+
+  // Switches since the last call, in order. A new stream holds none of the
+  // earlier ones, it gets the state of every category instead.
+  void serialize(uint64_t streamGeneration, std::vector<std::byte> &out) {
+    if (!mPending.load() && streamGeneration == mServedGeneration.load()) {
+      return;
+    }
+    std::scoped_lock lock(mMutex);
+    if (streamGeneration != mServedGeneration) {
+      mServedGeneration = streamGeneration;
+      mSwitches.clear();
+      auto time = now();
+      for (auto &[name, index] : mIndices) {
+        mSwitches.push_back(
+            {name, mFlags[index].load(std::memory_order_relaxed), time});
+      }
+    }
+    // Thread zero, the workers must not touch the thread_locals here: those
+    // would bring up a LocalRecorder flushing into the worker itself on exit
+    for (auto &change : mSwitches) {
+      Event(CategoryEvent<true>(change.name, change.enabled, 0, change.time))
+          .serialize(out);
+    }
+    mSwitches.clear();
+    mPending = false;
+  }
+
+  std::vector<std::pair<std::string, bool>> categories() {
+    std::scoped_lock lock(mMutex);
+    std::vector<std::pair<std::string, bool>> result;
+    for (auto &[name, index] : mIndices) {
+      result.emplace_back(name, mFlags[index].load(std::memory_order_relaxed));
+    }
+    return result;
+  }
+
+private:
+  struct Switch {
+    std::string_view name;
+    bool enabled;
+    uint64_t time;
+  };
+
+  // Under the lock
+  void addSwitch(std::string_view name, bool enabled) {
+    mSwitches.push_back({name, enabled, now()});
+    mPending = true;
+  }
+
+  std::mutex mMutex;
+  std::map<std::string, size_t, std::less<>> mIndices;
+  std::vector<std::pair<std::string, bool>> mRules;
+  std::vector<Switch> mSwitches;
+  // Lets the workers skip the lock while nothing changed
+  std::atomic<bool> mPending = false;
+  // Stream the switches go to, zero before the first
+  std::atomic<uint64_t> mServedGeneration = 0;
+  // Only read at the callsites, packed so they share few cache lines
+  alignas(64) std::array<std::atomic<bool>, maxCategories> mFlags{};
+};
+
+CategoryRegistry &getCategoryRegistry() {
+  static CategoryRegistry registry;
+  return registry;
+}
+
+void serializeCategories(uint64_t streamGeneration,
+                         std::vector<std::byte> &out) {
+  getCategoryRegistry().serialize(streamGeneration, out);
+}
 } // namespace
 
+Category::Category(std::string_view name, bool enabledByDefault)
+    : mEnabled(getCategoryRegistry().add(name, enabledByDefault)) {}
+
+void setCategoryEnabled(std::string_view pattern, bool enabled) {
+  getCategoryRegistry().setEnabled(pattern, enabled);
+}
+
+void setCategories(std::string_view switches) {
+  getCategoryRegistry().setCategories(switches);
+}
+
+std::vector<std::pair<std::string, bool>> categories() {
+  return getCategoryRegistry().categories();
+}
+
 void setFlushCallback(
     const std::function<void(std::vector<std::byte> const &)> &output) {
   getGlobalRecorder().setOutput(output);
@@ -223,6 +1410,40 @@ void setFlushCallback(
 
 void flush() { localRecorder.flush(); }
 
+uint64_t threadId() { return currentThreadId; }
+
+RecorderMetrics metrics() { return getGlobalRecorder().metrics(); }
+
+ThreadMetrics threadMetrics() { return localRecorder.metrics(); }
+
+void countDroppedEvents(uint64_t count) {
+  addCounter(getGlobalRecorder().counters().droppedEvents, count);
+}
+
+void setMetricsInterval(std::chrono::milliseconds interval) {
+  getGlobalRecorder().setMetricsInterval(interval);
+}
+
+void setFlushShards(unsigned shards) {
+  getGlobalRecorder().setFlushShards(shards);
+}
+
+void setMappedBuffer(std::optional<MappedBufferOptions> const &options) {
+  getGlobalRecorder().setMappedBuffer(options);
+}
+
+void setClockSyncInterval(std::chrono::milliseconds interval) {
+  getGlobalRecorder().setClockSyncInterval(interval);
+}
+
+void setCpuTracking(bool enabled) {
+  getGlobalRecorder().setCpuTracking(enabled);
+}
+
+void setPerfCounters(bool enabled) {
+  getGlobalRecorder().setPerfCounters(enabled);
+}
+
 void nameThread(std::string_view name) { localRecorder.nameThread(name); }
 
 void zoneStart(uint32_t line, std::string_view file, std::string_view function,
@@ -231,7 +1452,51 @@ void zoneStart(uint32_t line, std::string_view file, std::string_view function,
 }
 void zoneEnd() { localRecorder.zoneEnd(); }
 
+void zoneStartWithStack(uint32_t line, std::string_view file,
+                        std::string_view function, std::string_view name,
+                        uint32_t color) {
+  std::array<uint64_t, maxStackFrames> frames;
+  auto count = captureStack(frames, 1);
+  localRecorder.zoneBegin(line, file, function, name, color,
+                          std::span(frames).first(count));
+}
+
+void fiberEnter(uint64_t fiberId, std::string_view name) {
+  localRecorder.fiberEnter(fiberId, name);
+}
+void fiberLeave() { localRecorder.fiberLeave(); }
+
+void zoneText(std::string_view text) {
+  localRecorder.zoneAnnotation<ZoneTextEvent<true>>(text);
+}
+void zoneValue(uint64_t value) {
+  localRecorder.zoneAnnotation<ZoneValueEvent<true>>(value);
+}
+void zoneColor(uint32_t color) {
+  localRecorder.zoneAnnotation<ZoneColorEvent<true>>(color);
+}
+
 void message(std::string_view message, uint32_t color) {
-  localRecorder.message(message, color);
+  localRecorder.message(message, color, false);
+}
+
+void messageLiteral(std::string_view message, uint32_t color) {
+  localRecorder.message(message, color, true);
+}
+
+void messageWithStack(std::string_view message, uint32_t color) {
+  std::array<uint64_t, maxStackFrames> frames;
+  auto count = captureStack(frames, 1);
+  localRecorder.message(message, color, false, std::span(frames).first(count));
+}
+
+void frameMark(std::string_view name) {
+  localRecorder.frameMark(name, FrameMarkKind::Continuous);
+}
+void frameMarkStart(std::string_view name) {
+  localRecorder.frameMark(name, FrameMarkKind::Start);
+}
+void frameMarkEnd(std::string_view name) {
+  localRecorder.frameMark(name, FrameMarkKind::End);
 }
 } // namespace TracyRecorder
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "sinkQueue.h"
+
+#include "eventReader.h"
+#include "recorder.h"
+
+#include <cerrno>
+#include <climits>
+#include <sstream>
+#include <string>
+
+namespace TracyRecorder {
+uint64_t countEvents(std::vector<std::byte> const &data) {
+  std::stringstream stream(
+      std::string(reinterpret_cast<char const *>(data.data()), data.size()));
+  EventReader reader(stream);
+  uint64_t count = 0;
+  while (reader.next()) {
+    ++count;
+  }
+  return count;
+}
+
+void SinkQueue::push(std::vector<std::byte> const &data) {
+  {
+    std::scoped_lock lock(mMutex);
+    if (mHeader.empty()) {
+      mHeader = data;
+      mCondQueue.notify_one();
+      return;
+    }
+    if (mQueuedBytes + data.size() <= mMaxQueuedBytes) {
+      mQueuedBytes += data.size();
+      mQueue.push_back(data);
+      mCondQueue.notify_one();
+      return;
+    }
+  }
+  // Only paid while the sink falls behind
+  countDroppedEvents(countEvents(data));
+}
+
+std::vector<std::byte> SinkQueue::header() const {
+  std::scoped_lock lock(mMutex);
+  return mHeader;
+}
+
+bool SinkQueue::waitForHeader(std::stop_token stopToken) {
+  std::unique_lock lock(mMutex);
+  return mCondQueue.wait(lock, stopToken, [this] { return !mHeader.empty(); });
+}
+
+bool SinkQueue::pop(Batch &batch, std::stop_token stopToken,
+                    std::optional<std::chrono::milliseconds> timeout) {
+  std::unique_lock lock(mMutex);
+  auto ready = [this] { return !mQueue.empty(); };
+  if (timeout) {
+    mCondQueue.wait_for(lock, stopToken, *timeout, ready);
+  } else {
+    mCondQueue.wait(lock, stopToken, ready);
+  }
+  if (mQueue.empty()) {
+    return false;
+  }
+  for (auto &data : mQueue) {
+    batch.push_back(std::move(data));
+  }
+  mQueue.clear();
+  mQueuedBytes = 0;
+  return true;
+}
+
+bool SinkQueue::empty() const {
+  std::scoped_lock lock(mMutex);
+  return mQueue.empty();
+}
+
+void SinkQueue::pause(std::stop_token stopToken,
+                      std::chrono::milliseconds interval) {
+  std::unique_lock lock(mMutex);
+  mCondQueue.wait_for(lock, stopToken, interval, [] { return false; });
+}
+
+bool writeBuffers(std::span<std::vector<std::byte> const> buffers,
+                  std::function<ssize_t(std::span<iovec const>)> const &write,
+                  std::function<bool(int)> const &retry) {
+  size_t buffer = 0;
+  size_t offset = 0;
+  std::vector<iovec> iov;
+  while (buffer < buffers.size()) {
+    iov.clear();
+    for (size_t i = buffer; i < buffers.size() && iov.size() < IOV_MAX; ++i) {
+      size_t skip = i == buffer ? offset : 0;
+      iov.push_back(iovec{const_cast<std::byte *>(buffers[i].data()) + skip,
+                          buffers[i].size() - skip});
+    }
+
+    auto written = write(iov);
+    if (written < 0) {
+      if (retry(errno)) {
+        continue;
+      }
+      return false;
+    }
+
+    size_t remaining = written;
+    while (buffer < buffers.size() &&
+           remaining >= buffers[buffer].size() - offset) {
+      remaining -= buffers[buffer].size() - offset;
+      offset = 0;
+      ++buffer;
+    }
+    offset += remaining;
+  }
+  return true;
+}
+} // namespace TracyRecorder
@@ -0,0 +1,50 @@
+#include "socketAddress.h"
+
+#include <cstring>
+#include <netdb.h>
+#include <sys/un.h>
+
+namespace TracyRecorder {
+std::optional<SocketAddress> parseSocketAddress(std::string_view address) {
+  SocketAddress result{};
+
+  if (address.starts_with("unix:")) {
+    result.path = address.substr(5);
+    sockaddr_un unixAddress{};
+    if (result.path.empty() ||
+        result.path.size() >= sizeof(unixAddress.sun_path)) {
+      return std::nullopt;
+    }
+    unixAddress.sun_family = AF_UNIX;
+    std::memcpy(unixAddress.sun_path, result.path.data(), result.path.size());
+    std::memcpy(&result.address, &unixAddress, sizeof(unixAddress));
+    result.length = sizeof(unixAddress);
+    return result;
+  }
+
+  if (address.starts_with("tcp:")) {
+    auto hostPort = address.substr(4);
+    auto separator = hostPort.rfind(':');
+    if (separator == std::string_view::npos) {
+      return std::nullopt;
+    }
+    std::string host(hostPort.substr(0, separator));
+    std::string port(hostPort.substr(separator + 1));
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *info = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &info) != 0 ||
+        info == nullptr) {
+      return std::nullopt;
+    }
+    std::memcpy(&result.address, info->ai_addr, info->ai_addrlen);
+    result.length = info->ai_addrlen;
+    freeaddrinfo(info);
+    return result;
+  }
+
+  return std::nullopt;
+}
+} // namespace TracyRecorder
@@ -0,0 +1,179 @@
+#include "socketSink.h"
+
+#include "sinkQueue.h"
+#include "socketAddress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stop_token>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace TracyRecorder {
+namespace {
+class SocketSink {
+public:
+  SocketSink(SocketSinkOptions const &options)
+      : mOptions(options), mQueue(options.maxQueuedBytes) {
+    mAddress = parseSocketAddress(options.address);
+    mWriterThread = std::jthread(&SocketSink::writerThreadFunc, this);
+  }
+
+  ~SocketSink() {
+    mWriterThread.request_stop();
+    mWriterThread.join();
+    disconnect();
+  }
+
+  // The first buffer is the recording header, every connection replays it
+  void write(std::vector<std::byte> const &data) { mQueue.push(data); }
+
+private:
+  using Batch = SinkQueue::Batch;
+
+  void writerThreadFunc(std::stop_token stopToken) {
+    Batch batch;
+    // On shutdown, keep going for a little while to drain what is queued
+    std::stop_callback startDraining(stopToken, [this] {
+      mDrainDeadline =
+          std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    });
+
+    while (std::chrono::steady_clock::now() < mDrainDeadline.load()) {
+      if (mSocket < 0) {
+        if (!mQueue.waitForHeader(stopToken)) {
+          return;
+        }
+        if (!connect(stopToken)) {
+          if (stopToken.stop_requested()) {
+            return;
+          }
+          mQueue.pause(stopToken, mOptions.reconnectInterval);
+          continue;
+        }
+      }
+
+      if (batch.empty() && !mQueue.pop(batch, stopToken)) {
+        return;
+      }
+
+      if (send(batch)) {
+        batch.clear();
+      } else {
+        disconnect();
+      }
+    }
+  }
+
+  // Non-blocking from the start, a missing or slow peer costs at most the
+  // connect timeout
+  bool connect(std::stop_token stopToken) {
+    if (!mAddress) {
+      return false;
+    }
+    auto family = mAddress->address.ss_family;
+    mSocket = socket(family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mSocket < 0) {
+      return false;
+    }
+    if (::connect(mSocket, reinterpret_cast<sockaddr *>(&mAddress->address),
+                  mAddress->length) != 0 &&
+        !(errno == EINPROGRESS && awaitConnected(stopToken))) {
+      // A full listen backlog of a Unix socket fails with EAGAIN, it is
+      // retried after the reconnect interval like a missing peer
+      disconnect();
+      return false;
+    }
+    if (family != AF_UNIX) {
+      int noDelay = 1;
+      setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay,
+                 sizeof(noDelay));
+    }
+
+    if (!send(Batch{mQueue.header()})) {
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  bool awaitConnected(std::stop_token stopToken) {
+    auto deadline = std::chrono::steady_clock::now() + mOptions.connectTimeout;
+    while (!stopToken.stop_requested()) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0) {
+        return false;
+      }
+      // In slices, so a stop doesn't wait for the whole timeout
+      pollfd writable{mSocket, POLLOUT, 0};
+      auto ready = poll(&writable, 1, std::min<int>(remaining.count(), 100));
+      if (ready < 0 && errno != EINTR) {
+        return false;
+      }
+      if (ready > 0) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        return getsockopt(mSocket, SOL_SOCKET, SO_ERROR, &error, &length) ==
+                   0 &&
+               error == 0;
+      }
+    }
+    return false;
+  }
+
+  void disconnect() {
+    if (mSocket >= 0) {
+      close(mSocket);
+      mSocket = -1;
+    }
+  }
+
+  bool send(Batch const &batch) {
+    return writeBuffers(
+        batch,
+        [this](std::span<iovec const> iov) {
+          msghdr message{};
+          message.msg_iov = const_cast<iovec *>(iov.data());
+          message.msg_iovlen = iov.size();
+          return sendmsg(mSocket, &message, MSG_NOSIGNAL);
+        },
+        [this](int error) {
+          if (std::chrono::steady_clock::now() >= mDrainDeadline.load()) {
+            return false;
+          }
+          if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            pollfd writable{mSocket, POLLOUT, 0};
+            poll(&writable, 1, 100);
+            return true;
+          }
+          return false;
+        });
+  }
+
+  SocketSinkOptions mOptions;
+  std::optional<SocketAddress> mAddress;
+  int mSocket = -1;
+  std::atomic<std::chrono::steady_clock::time_point> mDrainDeadline =
+      std::chrono::steady_clock::time_point::max();
+
+  SinkQueue mQueue;
+
+  // Keep last, we want to finish this thread before destroying the main object
+  std::jthread mWriterThread;
+};
+} // namespace
+
+std::function<void(std::vector<std::byte> const &)>
+makeSocketSink(SocketSinkOptions const &options) {
+  auto sink = std::make_shared<SocketSink>(options);
+  return [sink](std::vector<std::byte> const &data) { sink->write(data); };
+}
+} // namespace TracyRecorder
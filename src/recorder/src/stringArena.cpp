@@ -0,0 +1,34 @@
+#include "stringArena.h"
+
+namespace TracyRecorder {
+void StringArena::reset() {
+  mLarge.clear();
+  mBlock = 0;
+  mNext = mBlocks.empty() ? nullptr : mBlocks.front().get();
+  mFree = mBlocks.empty() ? 0 : mBlockSize;
+}
+
+size_t StringArena::capacity() const {
+  auto size = mBlocks.size() * mBlockSize;
+  for (auto &[block, blockSize] : mLarge) {
+    size += blockSize;
+  }
+  return size;
+}
+
+std::string_view StringArena::copyToNewBlock(std::string_view text) {
+  // The current block stays open for shorter text
+  if (text.size() > mBlockSize) {
+    auto &block = mLarge.emplace_back(new char[text.size()], text.size());
+    std::memcpy(block.first.get(), text.data(), text.size());
+    return {block.first.get(), text.size()};
+  }
+  mBlock = mNext ? mBlock + 1 : 0;
+  if (mBlock == mBlocks.size()) {
+    mBlocks.emplace_back(new char[mBlockSize]);
+  }
+  mNext = mBlocks[mBlock].get();
+  mFree = mBlockSize;
+  return copy(text);
+}
+} // namespace TracyRecorder
@@ -0,0 +1,84 @@
+#include "captureDiscovery.h"
+#include "filePool.h"
+#include "traceExport.h"
+#include "utilities.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+int main(int argc, char **argv) {
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " --format chrome|perfetto --output <file>"
+                 " [--begin-ns <unix ns>] [--end-ns <unix ns>]"
+                 " [--threads <n>] [--max-open-files <n>]"
+                 " [--include <glob>]... [--exclude <glob>]..."
+                 " [--scan-threads <n>] <trace file/dir>..."
+              << std::endl;
+    return 1;
+  };
+
+  TracyPlayback::ExportOptions options;
+  std::optional<std::string> output;
+  size_t maxOpenFiles = 0;
+  TracyPlayback::DiscoveryOptions discovery;
+  std::vector<std::filesystem::path> traceFiles;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view argument = argv[i];
+    std::optional<std::string_view> value;
+    if (argument.starts_with("--")) {
+      if (i + 1 >= argc) {
+        return usage();
+      }
+      value = argv[++i];
+    }
+
+    if (!value) {
+      traceFiles.emplace_back(argument);
+    } else if (argument == "--format" && *value == "chrome") {
+      options.format = TracyPlayback::ExportFormat::ChromeJson;
+    } else if (argument == "--format" && *value == "perfetto") {
+      options.format = TracyPlayback::ExportFormat::Perfetto;
+    } else if (argument == "--output") {
+      output = *value;
+    } else if (argument == "--begin-ns" && parseNumber<uint64_t>(*value)) {
+      options.beginTime = *parseNumber<uint64_t>(*value);
+    } else if (argument == "--end-ns" && parseNumber<uint64_t>(*value)) {
+      options.endTime = *parseNumber<uint64_t>(*value);
+    } else if (argument == "--threads" && parseNumber<unsigned>(*value)) {
+      options.threads = *parseNumber<unsigned>(*value);
+    } else if (argument == "--max-open-files" && parseNumber<size_t>(*value)) {
+      maxOpenFiles = *parseNumber<size_t>(*value);
+    } else if (argument == "--include") {
+      discovery.include.emplace_back(*value);
+    } else if (argument == "--exclude") {
+      discovery.exclude.emplace_back(*value);
+    } else if (argument == "--scan-threads" && parseNumber<unsigned>(*value)) {
+      discovery.threads = *parseNumber<unsigned>(*value);
+    } else {
+      return usage();
+    }
+  }
+
+  if (!output || traceFiles.empty()) {
+    return usage();
+  }
+
+  auto files = TracyPlayback::FilePool::create(maxOpenFiles);
+  auto [streams, failed] =
+      TracyPlayback::discoverCaptures(traceFiles, discovery, *files);
+  for (auto &path : failed) {
+    std::cerr << "Failed to read capture: " << path << std::endl;
+  }
+
+  std::ofstream out(*output, std::ios::binary);
+  if (!out) {
+    std::cerr << "Failed to open output: " << *output << std::endl;
+    return 1;
+  }
+  std::cout << "Converting " << streams.size() << " streams" << std::endl;
+  TracyPlayback::exportTrace(std::move(streams), out, options);
+  return out ? 0 : 1;
+}
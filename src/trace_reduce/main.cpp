@@ -0,0 +1,95 @@
+#include "captureDiscovery.h"
+#include "filePool.h"
+#include "traceReduce.h"
+#include "utilities.h"
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+int main(int argc, char **argv) {
+  auto usage = [&] {
+    std::cerr << "Usage: " << argv[0]
+              << " --output <dir> [--min-duration-ns <ns>]"
+                 " [--max-depth <levels>]"
+                 " [--begin-ns <unix ns>] [--end-ns <unix ns>]"
+                 " [--threads <n>] [--max-open-files <n>]"
+                 " [--include <glob>]... [--exclude <glob>]..."
+                 " [--scan-threads <n>] <trace file/dir>..."
+              << std::endl;
+    return 1;
+  };
+
+  TracyPlayback::ReduceOptions options;
+  std::optional<std::filesystem::path> output;
+  size_t maxOpenFiles = 0;
+  TracyPlayback::DiscoveryOptions discovery;
+  std::vector<std::filesystem::path> traceFiles;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view argument = argv[i];
+    std::optional<std::string_view> value;
+    if (argument.starts_with("--")) {
+      if (i + 1 >= argc) {
+        return usage();
+      }
+      value = argv[++i];
+    }
+
+    if (!value) {
+      traceFiles.emplace_back(argument);
+    } else if (argument == "--output") {
+      output = *value;
+    } else if (argument == "--min-duration-ns" &&
+               parseNumber<uint64_t>(*value)) {
+      options.minDuration = *parseNumber<uint64_t>(*value);
+    } else if (argument == "--max-depth" && parseNumber<unsigned>(*value)) {
+      options.maxDepth = *parseNumber<unsigned>(*value);
+    } else if (argument == "--begin-ns" && parseNumber<uint64_t>(*value)) {
+      options.beginTime = *parseNumber<uint64_t>(*value);
+    } else if (argument == "--end-ns" && parseNumber<uint64_t>(*value)) {
+      options.endTime = *parseNumber<uint64_t>(*value);
+    } else if (argument == "--threads" && parseNumber<unsigned>(*value)) {
+      options.threads = *parseNumber<unsigned>(*value);
+    } else if (argument == "--max-open-files" && parseNumber<size_t>(*value)) {
+      maxOpenFiles = *parseNumber<size_t>(*value);
+    } else if (argument == "--include") {
+      discovery.include.emplace_back(*value);
+    } else if (argument == "--exclude") {
+      discovery.exclude.emplace_back(*value);
+    } else if (argument == "--scan-threads" && parseNumber<unsigned>(*value)) {
+      discovery.threads = *parseNumber<unsigned>(*value);
+    } else {
+      return usage();
+    }
+  }
+
+  if (!output || traceFiles.empty()) {
+    return usage();
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(*output, error);
+  if (error) {
+    std::cerr << "Failed to create output directory: " << *output << std::endl;
+    return 1;
+  }
+
+  auto files = TracyPlayback::FilePool::create(maxOpenFiles);
+  auto [streams, failed] =
+      TracyPlayback::discoverCaptures(traceFiles, discovery, *files);
+  for (auto &path : failed) {
+    std::cerr << "Failed to read capture: " << path << std::endl;
+  }
+
+  std::cout << "Reducing " << streams.size() << " streams" << std::endl;
+  auto result =
+      TracyPlayback::reduceTraces(std::move(streams), *output, options);
+  for (auto &path : result.failed) {
+    std::cerr << "Failed to write output: " << path << std::endl;
+  }
+  std::cout << "Kept " << result.eventsWritten << " of " << result.eventsRead
+            << " events, dropped " << result.zonesDropped << " zones, merged "
+            << result.zonesSummarized << " zones into " << result.summaries
+            << " summaries" << std::endl;
+  return result.failed.empty() ? 0 : 1;
+}
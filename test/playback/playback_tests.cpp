@@ -1,12 +1,41 @@
 #include "gtest/gtest.h"
 
+#include "blockFormat.h"
+#include "callstack.h"
+#include "captureDiscovery.h"
+#include "eventReader.h"
+#include "eventStream.h"
+#include "filePool.h"
+#include "liveStreamBuffer.h"
+#include "mappedBuffer.h"
+#include "mappedRecovery.h"
+#include "nullSink.h"
 #include "playback.h"
+#include "playbackStatistics.h"
 #include "rawEntries.h"
+#include "recorder.h"
+#include "recordingSink.h"
+#include "socketListener.h"
+#include "socketSink.h"
+#include "traceExport.h"
+#include "traceReduce.h"
+#include "utilities.h"
+#include "zoneStatistics.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <istream>
+#include <mutex>
+#include <semaphore>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+// Frames of recorded stacks point into it
+[[gnu::noinline]] void stackTestCaller() { asm volatile(""); }
+
 class PlaybackTest : public ::testing::Test {
 protected:
   virtual void SetUp() {};
@@ -26,13 +55,43 @@ protected:
     return ss;
   }
 
-  void playStreams(std::vector<std::unique_ptr<std::istream>> streams) {
+  std::string serialize(std::vector<TracyRecorder::Event<true>> events) {
+    std::vector<std::byte> data;
+    for (auto &event : events) {
+      event.serialize(data);
+    }
+    return std::string(reinterpret_cast<const char *>(data.data()),
+                       data.size());
+  }
+
+  void playStreams(std::vector<std::unique_ptr<std::istream>> streams,
+                   std::optional<TracyPlayback::FollowOptions> follow = {}) {
+    TracyPlayback::Playback play;
+    if (follow) {
+      play.setFollowMode(*follow);
+    }
+    for (auto &stream : streams) {
+      play.addStream(
+          TracyPlayback::Playback::StreamInfo{std::move(stream), ""});
+    }
+    play.play();
+  }
+
+  // Replays into a RecordingSink instead of Tracy and returns what it got
+  std::vector<TracyPlayback::RecordingSink::Record>
+  recordStreams(std::vector<std::unique_ptr<std::istream>> streams,
+                std::optional<TracyPlayback::FollowOptions> follow = {}) {
     TracyPlayback::Playback play;
+    if (follow) {
+      play.setFollowMode(*follow);
+    }
     for (auto &stream : streams) {
       play.addStream(
           TracyPlayback::Playback::StreamInfo{std::move(stream), ""});
     }
-    play.play(true);
+    TracyPlayback::RecordingSink sink;
+    play.play(sink);
+    return sink.records();
   }
 };
 
@@ -53,6 +112,33 @@ TEST_F(PlaybackTest, validateWorking) {
   playStreams(std::move(streams));
 }
 
+TEST_F(PlaybackTest, validateZoneAnnotations) {
+  std::vector<std::unique_ptr<std::istream>> streams;
+  streams.push_back(genIStream(
+      {TracyRecorder::Event(
+           TracyRecorder::StartEvent<true>("host", 1234567890, 42)),
+       TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+           0, 1, "file1.cpp", "function1", "name1", 0, 100)),
+       TracyRecorder::Event(
+           TracyRecorder::ZoneTextEvent<true>("request 42", 0, 110)),
+       TracyRecorder::Event(TracyRecorder::ZoneValueEvent<true>(42, 0, 120)),
+       TracyRecorder::Event(
+           TracyRecorder::ZoneColorEvent<true>(0xFF0000, 0, 130)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 200))}));
+  auto records = recordStreams(std::move(streams));
+
+  // Each annotation reaches the sink inside the zone it was recorded in
+  using Kind = TracyPlayback::RecordingSink::Kind;
+  TracyPlayback::ProcessInfo process{"host", 42};
+  std::vector<TracyPlayback::RecordingSink::Record> expected{
+      {Kind::ZoneBegin, process, 0, "name1", 0, 100},
+      {Kind::ZoneText, process, 0, "request 42", 0, 0},
+      {Kind::ZoneValue, process, 0, "", 42, 0},
+      {Kind::ZoneColor, process, 0, "", 0xFF0000, 0},
+      {Kind::ZoneEnd, process, 0, "", 0, 200}};
+  EXPECT_EQ(records, expected);
+}
+
 TEST_F(PlaybackTest, validateMultipleStreams) {
   std::vector<std::vector<TracyRecorder::Event<true>>> events = {
       {TracyRecorder::Event(
@@ -87,4 +173,1095 @@ TEST_F(PlaybackTest, validateMultipleStreams) {
     streams.push_back(genIStream(event));
   }
   playStreams(std::move(streams));
-}
\ No newline at end of file
+}
+
+TEST_F(PlaybackTest, validateFrameMarks) {
+  std::vector<std::vector<TracyRecorder::Event<true>>> events = {
+      {TracyRecorder::Event(
+           TracyRecorder::StartEvent<true>("host1", 1234567890, 42)),
+       TracyRecorder::Event(TracyRecorder::FrameMarkEvent<true>(
+           "", TracyRecorder::FrameMarkKind::Continuous, 0, 100)),
+       TracyRecorder::Event(TracyRecorder::FrameMarkEvent<true>(
+           "batch", TracyRecorder::FrameMarkKind::Start, 0, 150)),
+       TracyRecorder::Event(TracyRecorder::FrameMarkEvent<true>(
+           "batch", TracyRecorder::FrameMarkKind::End, 0, 250))},
+      {TracyRecorder::Event(
+           TracyRecorder::StartEvent<true>("host2", 1234567890, 42)),
+       TracyRecorder::Event(TracyRecorder::FrameMarkEvent<true>(
+           "batch", TracyRecorder::FrameMarkKind::Start, 0, 120)),
+       TracyRecorder::Event(TracyRecorder::FrameMarkEvent<true>(
+           "batch", TracyRecorder::FrameMarkKind::End, 0, 220))},
+  };
+
+  std::vector<std::unique_ptr<std::istream>> streams;
+  for (auto &event : events) {
+    streams.push_back(genIStream(event));
+  }
+  auto records = recordStreams(std::move(streams));
+
+  // Marks of both hosts interleave in time, each keeping its kind
+  using Kind = TracyPlayback::RecordingSink::Kind;
+  auto mark = [](std::string host, std::string name,
+                 TracyRecorder::FrameMarkKind kind, uint64_t time) {
+    return TracyPlayback::RecordingSink::Record{
+        Kind::FrameMark, {host, 42}, 0, name, int64_t(kind), time};
+  };
+  std::vector<TracyPlayback::RecordingSink::Record> expected{
+      mark("host1", "", TracyRecorder::FrameMarkKind::Continuous, 100),
+      mark("host2", "batch", TracyRecorder::FrameMarkKind::Start, 120),
+      mark("host1", "batch", TracyRecorder::FrameMarkKind::Start, 150),
+      mark("host2", "batch", TracyRecorder::FrameMarkKind::End, 220),
+      mark("host1", "batch", TracyRecorder::FrameMarkKind::End, 250)};
+  EXPECT_EQ(records, expected);
+}
+
+TEST_F(PlaybackTest, followPartiallyWrittenEvent) {
+  auto zone =
+      serialize({TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+          0, 1, "file1.cpp", "function1", "name1", 0, 100))});
+  auto stream = std::make_unique<std::stringstream>(
+      std::ios::in | std::ios::out | std::ios::binary);
+  auto &writer = *stream;
+  writer << serialize({TracyRecorder::Event(
+      TracyRecorder::StartEvent<true>("host", 1234567890, 42))});
+  writer << zone.substr(0, zone.size() / 2);
+
+  TracyPlayback::FollowOptions follow;
+  follow.idleTimeout = std::chrono::milliseconds(50);
+  TracyPlayback::EventStream events{
+      TracyPlayback::EventStream::StreamInfo{std::move(stream), ""}, follow};
+  ASSERT_TRUE(events.pop().has_value());
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Starved);
+
+  writer << zone.substr(zone.size() / 2);
+  events.poll();
+  ASSERT_EQ(events.state(), TracyPlayback::EventStream::State::Ready);
+  auto event = events.pop();
+  ASSERT_TRUE(event.has_value());
+  EXPECT_EQ(event->type(), TracyRecorder::EventType::StartZone);
+  EXPECT_EQ(std::get<TracyRecorder::StartZoneEvent<false>>(event->event).name,
+            "name1");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  events.poll();
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Finished);
+}
+
+TEST_F(PlaybackTest, followGrowingStream) {
+  auto path = std::filesystem::temp_directory_path() /
+              std::format("followGrowingStream_{}.trcy", getpid());
+  std::ofstream writer(path, std::ios::binary);
+  writer << serialize({TracyRecorder::Event(
+      TracyRecorder::StartEvent<true>("host", 1234567890, 42))});
+  writer.flush();
+
+  auto zone = serialize(
+      {TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+           0, 1, "file1.cpp", "function1", "name1", 0, 100)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 200))});
+  std::jthread producer([&writer, &zone] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    writer << zone.substr(0, zone.size() / 2) << std::flush;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    writer << zone.substr(zone.size() / 2) << std::flush;
+  });
+
+  TracyPlayback::FollowOptions follow;
+  follow.idleTimeout = std::chrono::milliseconds(2000);
+  std::vector<std::unique_ptr<std::istream>> streams;
+  streams.push_back(std::make_unique<std::ifstream>(path, std::ios::binary));
+  auto records = recordStreams(std::move(streams), follow);
+  std::filesystem::remove(path);
+
+  // The zone appended after playback started is replayed
+  using Kind = TracyPlayback::RecordingSink::Kind;
+  TracyPlayback::ProcessInfo process{"host", 42};
+  std::vector<TracyPlayback::RecordingSink::Record> expected{
+      {Kind::ZoneBegin, process, 0, "name1", 0, 100},
+      {Kind::ZoneEnd, process, 0, "", 0, 200}};
+  EXPECT_EQ(records, expected);
+}
+
+TEST_F(PlaybackTest, pooledFiles) {
+  auto directory = std::filesystem::temp_directory_path() /
+                   std::format("pooledFiles_{}", getpid());
+  std::filesystem::create_directories(directory);
+  auto files = TracyPlayback::FilePool::create(3);
+
+  std::vector<TracyPlayback::EventStream> streams;
+  for (int i = 0; i < 12; ++i) {
+    auto path = directory / std::format("{}.trcy", i);
+    std::vector<TracyRecorder::Event<true>> events{TracyRecorder::Event(
+        TracyRecorder::StartEvent<true>("host", 1234567890, i))};
+    // Larger than one read, so reading continues after the file was closed
+    for (uint64_t time = 0; time < 2000; time += 2) {
+      events.emplace_back(TracyRecorder::StartZoneEvent<true>(
+          0, 1, "file1.cpp", "function1", "name1", 0, time));
+      events.emplace_back(TracyRecorder::EndZoneEvent<true>(0, time + 1));
+    }
+    std::ofstream(path, std::ios::binary) << serialize(events);
+    streams.emplace_back(
+        TracyPlayback::EventStream::StreamInfo{files->open(path), ""});
+    EXPECT_LE(files->openFiles(), 3);
+  }
+
+  for (bool popped = true; popped;) {
+    popped = false;
+    for (auto &stream : streams) {
+      popped |= stream.pop().has_value();
+      EXPECT_LE(files->openFiles(), 3);
+    }
+  }
+  for (auto &stream : streams) {
+    EXPECT_EQ(stream.state(), TracyPlayback::EventStream::State::Finished);
+  }
+  streams.clear();
+  EXPECT_EQ(files->openFiles(), 0);
+
+  // Follow mode seeks back over partially written events
+  auto path = directory / "growing.trcy";
+  auto zone = serialize({TracyRecorder::Event(
+      TracyRecorder::StartZoneEvent<true>(0, 1, "file1.cpp", "function1",
+                                          "name1", 0, 100))});
+  std::ofstream writer(path, std::ios::binary);
+  writer << serialize({TracyRecorder::Event(
+                TracyRecorder::StartEvent<true>("host", 1234567890, 42))})
+         << zone.substr(0, zone.size() / 2) << std::flush;
+  TracyPlayback::EventStream growing{
+      TracyPlayback::EventStream::StreamInfo{files->open(path), ""},
+      TracyPlayback::FollowOptions{}};
+  EXPECT_TRUE(growing.pop().has_value());
+  EXPECT_EQ(growing.state(), TracyPlayback::EventStream::State::Starved);
+  writer << zone.substr(zone.size() / 2) << std::flush;
+  growing.poll();
+  EXPECT_EQ(growing.state(), TracyPlayback::EventStream::State::Ready);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(PlaybackTest, discoverCaptures) {
+  auto directory = std::filesystem::temp_directory_path() /
+                   std::format("discoverCaptures_{}", getpid());
+  std::filesystem::create_directories(directory / "a" / "b");
+  auto header = std::string("TRCYPLAY\1\0\0\0", 12);
+  auto capture =
+      header +
+      serialize({TracyRecorder::Event(
+                     TracyRecorder::StartEvent<true>("host", 1234567890, 42)),
+                 TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+                     0, 1, "file1.cpp", "function1", "name1", 0, 100)),
+                 TracyRecorder::Event(
+                     TracyRecorder::EndZoneEvent<true>(0, 200))});
+  auto write = [&directory](std::filesystem::path path, std::string data) {
+    std::ofstream(directory / path, std::ios::binary) << data;
+  };
+  write("1.trcy", capture);
+  write("a/2.trcy", capture);
+  write("a/b/3.trcy", capture);
+  write("a/b/skipped.trcy", capture);
+  write("a/notes.txt", "not a capture");
+  write("a/b/noStart.trcy",
+        header + serialize({TracyRecorder::Event(
+                     TracyRecorder::EndZoneEvent<true>(0, 200))}));
+  // A cycle that must not be walked, and a link to nothing
+  std::filesystem::create_directory_symlink("..", directory / "a" / "loop");
+  std::filesystem::create_symlink("missing.trcy",
+                                  directory / "a" / "dangling.trcy");
+
+  TracyPlayback::DiscoveryOptions options;
+  options.include = {"*.trcy"};
+  options.exclude = {"a/b/skip*"};
+  options.threads = 4;
+  auto files = TracyPlayback::FilePool::create();
+  auto [streams, failed] =
+      TracyPlayback::discoverCaptures({directory}, options, *files);
+
+  std::vector<std::string> names;
+  for (auto &[stream, name] : streams) {
+    names.push_back(
+        std::filesystem::path(name).lexically_relative(directory).string());
+  }
+  EXPECT_EQ(names, (std::vector<std::string>{"1.trcy", "a/2.trcy",
+                                             "a/b/3.trcy"}));
+  EXPECT_EQ(failed, (std::vector<std::filesystem::path>{
+                        directory / "a" / "b" / "noStart.trcy"}));
+
+  // Streams are positioned past the header, ready to be played
+  TracyPlayback::Playback play;
+  play.addStreams(std::move(streams));
+  play.play();
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_F(PlaybackTest, reportPlaybackStatistics) {
+  using namespace std::chrono_literals;
+  TracyPlayback::ProgressOptions options;
+  options.format = TracyPlayback::ProgressFormat::Json;
+  std::ostringstream out;
+  TracyPlayback::PlaybackStatistics statistics(options, out);
+
+  int first, second;
+  TracyPlayback::ProcessInfo host1{"host1", 1};
+  TracyPlayback::ProcessInfo host2{"host\"2", 2};
+  statistics.addEvent(&first, host1, 1'000);
+  statistics.addEvent(&second, host2, 3'000);
+  statistics.addEvent(&first, host1, 2'000);
+  statistics.setStreamState(&first, host1,
+                            TracyPlayback::PlaybackStatistics::StreamState::
+                                Starved);
+  statistics.addTime(TracyPlayback::PlaybackPhase::Dispatch, 5us);
+  statistics.addStall();
+  statistics.setPlaybackThreads(4);
+
+  // Nothing is due yet
+  statistics.report();
+  EXPECT_TRUE(out.str().empty());
+
+  statistics.report(true);
+  auto report = out.str();
+  EXPECT_TRUE(report.starts_with("{\"events\":3,"));
+  EXPECT_NE(report.find("\"playbackThreads\":4,\"stalls\":1,"
+                        "\"decodeNs\":0,\"dispatchNs\":5000,"
+                        "\"stallNs\":0,"),
+            std::string::npos);
+  EXPECT_TRUE(report.ends_with(
+      "\"streams\":[{\"host\":\"host1\",\"processId\":1,"
+      "\"events\":2,\"positionNs\":2000,\"lagNs\":1000,"
+      "\"state\":\"starved\"},{\"host\":\"host\\\"2\",\"processId\":2,"
+      "\"events\":1,\"positionNs\":3000,\"lagNs\":0,"
+      "\"state\":\"ready\"}]}\n"));
+
+  // Finished streams are reported once more
+  statistics.setStreamState(&first, host1,
+                            TracyPlayback::PlaybackStatistics::StreamState::
+                                Finished);
+  statistics.report(true);
+  EXPECT_NE(out.str().find("host1", report.size()), std::string::npos);
+  auto reported = out.str().size();
+  statistics.report(true);
+  EXPECT_EQ(out.str().find("host1", reported), std::string::npos);
+}
+
+TEST_F(PlaybackTest, followLiveStreamBuffer) {
+  auto zone =
+      serialize({TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+          0, 1, "file1.cpp", "function1", "name1", 0, 100))});
+  auto start = serialize({TracyRecorder::Event(
+      TracyRecorder::StartEvent<true>("host", 1234567890, 42))});
+  auto buffer = std::make_shared<TracyPlayback::LiveStreamBuffer>();
+  buffer->append(start);
+  buffer->append(std::string_view(zone).substr(0, 10));
+
+  TracyPlayback::EventStream events{
+      TracyPlayback::EventStream::StreamInfo{
+          std::make_unique<TracyPlayback::LiveStream>(buffer), ""},
+      TracyPlayback::FollowOptions{}};
+  ASSERT_TRUE(events.pop().has_value());
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Starved);
+
+  buffer->append(std::string_view(zone).substr(10));
+  events.poll();
+  ASSERT_EQ(events.state(), TracyPlayback::EventStream::State::Ready);
+  EXPECT_EQ(events.pop()->type(), TracyRecorder::EventType::StartZone);
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Starved);
+
+  buffer->close();
+  events.poll();
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Finished);
+}
+
+TEST_F(PlaybackTest, listenForRecorderConnections) {
+  auto address = std::format(
+      "unix:{}", (std::filesystem::temp_directory_path() /
+                  std::format("listenForRecorderConnections_{}.sock", getpid()))
+                     .string());
+
+  TracyPlayback::Playback play;
+  play.setFollowMode(TracyPlayback::FollowOptions{});
+  play.setAcceptingStreams(true);
+  TracyPlayback::SocketListener listener(play, address);
+  TracyPlayback::RecordingSink sink;
+  std::jthread player([&play, &sink] { play.play(sink); });
+
+  auto toBytes = [](std::string const &data) {
+    return std::vector<std::byte>(
+        reinterpret_cast<std::byte const *>(data.data()),
+        reinterpret_cast<std::byte const *>(data.data() + data.size()));
+  };
+  for (auto host : {"host1", "host2"}) {
+    auto sink = TracyRecorder::makeSocketSink({address});
+    sink(toBytes(std::string("TRCYPLAY\1\0\0\0", 12) +
+                 serialize({TracyRecorder::Event(
+                     TracyRecorder::StartEvent<true>(host, 1234567890, 42))})));
+    sink(toBytes(serialize(
+        {TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "name1", 0, 100)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 200))})));
+  }
+
+  // Both connections are accepted and their zones replayed while the
+  // producers stay connected
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (sink.records().size() < 4 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  listener.stop();
+  play.setAcceptingStreams(false);
+  player.join();
+
+  using Kind = TracyPlayback::RecordingSink::Kind;
+  auto records = sink.records();
+  for (auto host : {"host1", "host2"}) {
+    TracyPlayback::ProcessInfo process{host, 42};
+    std::vector<TracyPlayback::RecordingSink::Record> expected{
+        {Kind::ZoneBegin, process, 0, "name1", 0, 100},
+        {Kind::ZoneEnd, process, 0, "", 0, 200}};
+    std::vector<TracyPlayback::RecordingSink::Record> replayed;
+    std::ranges::copy_if(records, std::back_inserter(replayed),
+                         [&process](auto const &record) {
+                           return record.process == process;
+                         });
+    EXPECT_EQ(replayed, expected) << host;
+  }
+}
+
+TEST_F(PlaybackTest, chainRotatedSegments) {
+  auto segment = [this](uint64_t firstTime) {
+    auto stream = std::make_unique<std::stringstream>(serialize(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, 42)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "name1", 0, firstTime)),
+         TracyRecorder::Event(
+             TracyRecorder::EndZoneEvent<true>(0, firstTime + 50))}));
+    TracyPlayback::EventStream events{
+        TracyPlayback::EventStream::StreamInfo{std::move(stream), ""}};
+    events.pop();
+    return events;
+  };
+
+  auto events = segment(300);
+  events.addSegment(segment(500));
+  events.addSegment(segment(100));
+
+  std::vector<uint64_t> times;
+  while (auto event = events.pop()) {
+    times.push_back(std::visit(
+        overloads{[](TracyRecorder::StartEvent<false> const &) -> uint64_t {
+                    return 0;
+                  },
+                  [](auto const &e) -> uint64_t { return e.time; }},
+        event->event));
+  }
+  EXPECT_EQ(times, (std::vector<uint64_t>{100, 150, 300, 350, 500, 550}));
+  EXPECT_EQ(events.state(), TracyPlayback::EventStream::State::Finished);
+}
+
+TEST_F(PlaybackTest, readAheadDecoding) {
+  // Tiny queues make the decoders wait for the consumer all the time
+  auto pool = TracyPlayback::ReadAheadPool::create({2, 4});
+  auto open = [this, &pool](uint64_t firstTime) {
+    std::vector<TracyRecorder::Event<true>> events{TracyRecorder::Event(
+        TracyRecorder::StartEvent<true>("host", 1234567890, 42))};
+    for (uint64_t time = firstTime; time < firstTime + 100; time += 2) {
+      events.emplace_back(TracyRecorder::StartZoneEvent<true>(
+          0, 1, "file1.cpp", "function1", "name1", 0, time));
+      events.emplace_back(TracyRecorder::EndZoneEvent<true>(0, time + 1));
+    }
+    TracyPlayback::EventStream stream{
+        TracyPlayback::EventStream::StreamInfo{
+            std::make_unique<std::stringstream>(serialize(events)), ""},
+        std::nullopt, pool};
+    stream.pop();
+    return stream;
+  };
+
+  std::vector<TracyPlayback::EventStream> streams;
+  streams.push_back(open(1000));
+  streams.push_back(open(100));
+  streams.back().addSegment(open(0));
+  streams.push_back(open(2000));
+
+  // Pop round robin, each stream has to stay in order
+  std::vector<std::vector<uint64_t>> times(streams.size());
+  for (bool popped = true; popped;) {
+    popped = false;
+    for (size_t i = 0; i < streams.size(); ++i) {
+      if (auto event = streams[i].pop()) {
+        times[i].push_back(std::visit(
+            overloads{
+                [](TracyRecorder::StartEvent<false> const &) -> uint64_t {
+                  return 0;
+                },
+                [](auto const &e) -> uint64_t { return e.time; }},
+            event->event));
+        popped = true;
+      }
+    }
+  }
+  uint64_t const firstTimes[] = {1000, 0, 2000};
+  for (size_t i = 0; i < streams.size(); ++i) {
+    uint64_t firstTime = firstTimes[i];
+    uint64_t events = i == 1 ? 200 : 100;
+    ASSERT_EQ(times[i].size(), events);
+    for (uint64_t j = 0; j < events; ++j) {
+      EXPECT_EQ(times[i][j], firstTime + j);
+    }
+  }
+}
+
+TEST_F(PlaybackTest, readAheadSplitsStreams) {
+  // One block per zone, parts of a few blocks each
+  std::vector<std::byte> data;
+  TracyRecorder::Event(TracyRecorder::StartEvent<true>("host", 1234567890, 42))
+      .serialize(data);
+  for (uint64_t time = 0; time < 200; time += 2) {
+    auto block = TracyRecorder::beginBlock(data);
+    TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+                             0, 1, "file1.cpp", "function1", "name1", 0, time))
+        .serialize(data);
+    TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, time + 1))
+        .serialize(data);
+    TracyRecorder::endBlock(data, block);
+  }
+  std::string bytes(reinterpret_cast<char const *>(data.data()), data.size());
+
+  for (uint64_t partBytes : {uint64_t(0), uint64_t(300), uint64_t(1000)}) {
+    auto pool = TracyPlayback::ReadAheadPool::create({2, 4, partBytes});
+    TracyPlayback::EventStream stream{
+        TracyPlayback::EventStream::StreamInfo{
+            std::make_unique<std::stringstream>(bytes), ""},
+        std::nullopt, pool};
+    EXPECT_EQ(stream.pop()->type(), TracyRecorder::EventType::Start);
+
+    // Every block is decoded once and the parts come back in order
+    std::vector<uint64_t> times;
+    while (auto event = stream.pop()) {
+      std::visit(
+          overloads{[](TracyRecorder::StartEvent<false> const &) {},
+                    [&times](auto const &e) { times.push_back(e.time); }},
+          event->event);
+    }
+    ASSERT_EQ(times.size(), 200) << partBytes;
+    for (uint64_t i = 0; i < times.size(); ++i) {
+      EXPECT_EQ(times[i], i) << partBytes;
+    }
+  }
+}
+
+TEST_F(PlaybackTest, correctClockDrift) {
+  uint64_t const start = 1'000'000'000'000;
+  auto stream = std::make_unique<std::stringstream>(serialize(
+      {TracyRecorder::Event(TracyRecorder::StartEvent<true>("host", start, 42)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 500'000)),
+       TracyRecorder::Event(
+           TracyRecorder::ClockSyncEvent<true>(1'000'000, start + 1'000'100)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 2'000'000)),
+       TracyRecorder::Event(
+           TracyRecorder::ClockSyncEvent<true>(3'000'000, start + 3'000'100)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 2'500'000)),
+       TracyRecorder::Event(
+           TracyRecorder::EndZoneEvent<true>(0, 4'000'000))}));
+  TracyPlayback::EventStream events{
+      TracyPlayback::EventStream::StreamInfo{std::move(stream), ""}};
+  events.setClockOffset(-1000);
+  EXPECT_EQ(events.getNanosecondsSincePosix(), start - 1000);
+  events.pop();
+
+  // Sync points are consumed as they are read. Times interpolate between the
+  // points read so far and extrapolate past the last one.
+  std::vector<uint64_t> times;
+  while (events.state() == TracyPlayback::EventStream::State::Ready) {
+    times.push_back(events.getNanosecondsSincePosix() - start + 1000);
+    EXPECT_EQ(events.pop()->type(), TracyRecorder::EventType::EndZone);
+  }
+  EXPECT_EQ(times, (std::vector<uint64_t>{500'000, 2'000'200, 2'500'100,
+                                          4'000'100}));
+}
+
+TEST_F(PlaybackTest, recoverMappedBuffer) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("recoverMapped_" + std::to_string(getpid()) + ".trcy");
+  auto bytes = [](TracyRecorder::Event<true> event) {
+    std::vector<std::byte> data;
+    event.serialize(data);
+    return data;
+  };
+  {
+    TracyRecorder::MappedBufferOptions options;
+    options.path = path;
+    options.ringBytes = 128;
+    options.maxThreads = 2;
+    TracyRecorder::MappedBuffer buffer(
+        options,
+        bytes(TracyRecorder::StartEvent<true>("host", 1234567890, 42)));
+    auto ring = buffer.acquireRing();
+    ASSERT_TRUE(ring.has_value());
+
+    auto zone = bytes(TracyRecorder::StartZoneEvent<true>(
+        0, 1, "file1.cpp", "function1", "name1", 0, 100));
+    ASSERT_TRUE(buffer.write(*ring, zone));
+    std::vector<std::byte> flushed;
+    buffer.release(buffer.drain(flushed));
+    EXPECT_EQ(flushed, zone);
+
+    // Left unflushed, the second one wraps around the end of the ring
+    ASSERT_TRUE(buffer.write(
+        *ring, bytes(TracyRecorder::ZoneTextEvent<true>("text", 0, 150))));
+    ASSERT_TRUE(
+        buffer.write(*ring, bytes(TracyRecorder::EndZoneEvent<true>(0, 200))));
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  auto recovered = TracyPlayback::recoverMappedBuffer(file);
+  ASSERT_TRUE(recovered);
+  TracyPlayback::EventStream events{
+      TracyPlayback::EventStream::StreamInfo{std::move(recovered), ""}};
+  auto start = events.pop();
+  ASSERT_TRUE(start.has_value());
+  EXPECT_EQ(std::get<TracyRecorder::StartEvent<false>>(start->event).host,
+            "host");
+  auto text = events.pop();
+  ASSERT_TRUE(text.has_value());
+  EXPECT_EQ(std::get<TracyRecorder::ZoneTextEvent<false>>(text->event).text,
+            "text");
+  auto end = events.pop();
+  ASSERT_TRUE(end.has_value());
+  EXPECT_EQ(end->type(), TracyRecorder::EventType::EndZone);
+  EXPECT_FALSE(events.pop().has_value());
+  std::filesystem::remove(path);
+}
+
+TEST_F(PlaybackTest, computeZoneStatistics) {
+  auto recording = [this](uint64_t pid, uint64_t outerEnd) {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, pid)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "outer", 0, 1000)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 2, "file1.cpp", "function2", "inner", 0, 1100)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 2, "file1.cpp", "function2", "inner", 1, 1200)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 1110)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1220)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, outerEnd)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "unfinished", 0, 3000))});
+  };
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(recording(1, 2000), "");
+  streams.emplace_back(recording(2, 5000), "");
+
+  auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams), 2);
+  ASSERT_EQ(statistics.size(), 2);
+  auto &outer = statistics[0];
+  EXPECT_EQ(outer.name, "outer");
+  EXPECT_EQ(outer.count, 2);
+  EXPECT_EQ(outer.totalTime, 5000);
+  EXPECT_EQ(outer.selfTime, 5000 - 2 * 10);
+  EXPECT_EQ(outer.maxTime, 4000);
+  EXPECT_NEAR(double(outer.p50), 1000, 1000 * 0.03);
+  EXPECT_NEAR(double(outer.p99), 4000, 4000 * 0.03);
+  auto &inner = statistics[1];
+  EXPECT_EQ(inner.name, "inner");
+  EXPECT_EQ(inner.count, 4);
+  EXPECT_EQ(inner.totalTime, 60);
+  EXPECT_EQ(inner.meanTime(), 15);
+  EXPECT_EQ(inner.p50, 10);
+  EXPECT_EQ(inner.maxTime, 20);
+
+  std::stringstream csv;
+  TracyPlayback::writeZoneStatisticsCsv(csv, statistics);
+  std::string line;
+  std::getline(csv, line);
+  std::getline(csv, line);
+  EXPECT_EQ(line, "\"outer\",\"function1\",\"file1.cpp\",1,2,5000,4980,2500,"
+                  + std::to_string(outer.p50) + "," +
+                  std::to_string(outer.p99) + ",4000,0,0,0,,,,,");
+}
+
+TEST_F(PlaybackTest, fiberZones) {
+  // Thread 2's batch continuing the fiber is written ahead of thread 1's
+  auto recording = [this] {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, 1)),
+         TracyRecorder::Event(
+             TracyRecorder::FiberEnterEvent<true>(7, "task", 0, 5, 2, 1500)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(2, 1700)),
+         TracyRecorder::Event(
+             TracyRecorder::FiberLeaveEvent<true>(0, 2, 1800)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "thread", 1, 1000)),
+         TracyRecorder::Event(
+             TracyRecorder::FiberEnterEvent<true>(7, "task", 0, 0, 1, 1100)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 2, "file1.cpp", "function2", "fiber", 1, 1200)),
+         TracyRecorder::Event(
+             TracyRecorder::FiberLeaveEvent<true>(5, 1, 1300)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1400))});
+  };
+
+  // The fiber's zone spans both threads without breaking the thread's nesting
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(recording(), "");
+  auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams), 1);
+  ASSERT_EQ(statistics.size(), 2);
+  EXPECT_EQ(statistics[0].name, "fiber");
+  EXPECT_EQ(statistics[0].totalTime, 500);
+  EXPECT_EQ(statistics[1].name, "thread");
+  EXPECT_EQ(statistics[1].totalTime, 400);
+  EXPECT_EQ(statistics[1].selfTime, 400);
+
+  std::vector<std::unique_ptr<std::istream>> playback;
+  playback.push_back(recording());
+  playStreams(std::move(playback));
+}
+
+TEST_F(PlaybackTest, fiberZonesAcrossRecordingThreads) {
+  std::mutex mutexOutput;
+  std::string output;
+  TracyRecorder::setFlushCallback(
+      [&mutexOutput, &output](std::vector<std::byte> const &data) {
+        std::scoped_lock lock(mutexOutput);
+        output.append(reinterpret_cast<char const *>(data.data()),
+                      data.size());
+      });
+
+  // The thread continuing the fiber exits and flushes first, the one that
+  // started the zone only afterwards. Reading puts the fiber back in order.
+  std::binary_semaphore left{0};
+  std::binary_semaphore ended{0};
+  std::jthread first([&] {
+    TracyRecorder::fiberEnter(7, "task");
+    TracyRecorder::zoneStart(1, "file1.cpp", "function1", "fiber", 0);
+    TracyRecorder::fiberLeave();
+    left.release();
+    ended.acquire();
+  });
+  std::jthread second([&] {
+    left.acquire();
+    TracyRecorder::fiberEnter(7, "task");
+    TracyRecorder::zoneEnd();
+    TracyRecorder::fiberLeave();
+  });
+  second.join();
+  ended.release();
+  first.join();
+  TracyRecorder::setFlushCallback([](std::vector<std::byte> const &) {});
+
+  // Streams are read past the header, as discovery hands them over
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(std::make_unique<std::stringstream>(output.substr(12)),
+                       "");
+  auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams), 1);
+  ASSERT_EQ(statistics.size(), 1);
+  EXPECT_EQ(statistics[0].name, "fiber");
+  EXPECT_EQ(statistics[0].count, 1);
+}
+
+TEST_F(PlaybackTest, cpuMigrations) {
+  auto recording = [this] {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, 1)),
+         TracyRecorder::Event(TracyRecorder::CpuEvent<true>(3, 1, 900)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "outer", 1, 1000)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 2, "file1.cpp", "function2", "inner", 1, 1100)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1200)),
+         TracyRecorder::Event(TracyRecorder::CpuEvent<true>(5, 1, 1300)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1300))});
+  };
+
+  // Only the outer zone ended on another CPU than it started on
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(recording(), "");
+  auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams), 1);
+  ASSERT_EQ(statistics.size(), 2);
+  EXPECT_EQ(statistics[0].name, "outer");
+  EXPECT_EQ(statistics[0].migrations, 1);
+  EXPECT_EQ(statistics[1].name, "inner");
+  EXPECT_EQ(statistics[1].migrations, 0);
+
+  std::vector<std::unique_ptr<std::istream>> playback;
+  playback.push_back(recording());
+  playStreams(std::move(playback));
+}
+
+TEST_F(PlaybackTest, recordingSink) {
+  auto recording = [this] {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, 1)),
+         TracyRecorder::Event(
+             TracyRecorder::ThreadNameEvent<true>("worker", 7, 900)),
+         TracyRecorder::Event(TracyRecorder::CpuEvent<true>(3, 7, 1000)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0x112233, 1, "file1.cpp", "function1", "outer", 7, 1000)),
+         TracyRecorder::Event(
+             TracyRecorder::ZoneTextEvent<true>("request 42", 7, 1100)),
+         TracyRecorder::Event(TracyRecorder::CpuEvent<true>(5, 7, 1300)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 1300)),
+         TracyRecorder::Event(
+             TracyRecorder::MessageEvent<true>("message1", 1234, 8, 1400))});
+  };
+
+  TracyPlayback::Playback play;
+  play.addStream(TracyPlayback::Playback::StreamInfo{recording(), ""});
+  TracyPlayback::RecordingSink sink;
+  play.play(sink);
+
+  // In merge order, with the annotations playback adds itself
+  using Kind = TracyPlayback::RecordingSink::Kind;
+  TracyPlayback::ProcessInfo process{"host", 1};
+  std::vector<TracyPlayback::RecordingSink::Record> expected{
+      {Kind::ThreadName, process, 7, "worker", 0, 0},
+      {Kind::ZoneBegin, process, 7, "outer", 0x112233, 1000},
+      {Kind::ZoneText, process, 7, "request 42", 0, 0},
+      {Kind::ZoneText, process, 7, "Migrated from CPU 3 to CPU 5", 0, 0},
+      {Kind::ZoneEnd, process, 7, "", 0, 1300},
+      {Kind::Message, process, 8, "message1", 1234, 1400}};
+  EXPECT_EQ(sink.records(), expected);
+
+  TracyPlayback::Playback nullPlay;
+  nullPlay.addStream(TracyPlayback::Playback::StreamInfo{recording(), ""});
+  TracyPlayback::NullSink nullSink;
+  nullPlay.play(nullSink);
+}
+
+TEST_F(PlaybackTest, zoneCounters) {
+  using TracyRecorder::Counter;
+  auto all = uint8_t((1 << TracyRecorder::counterCount) - 1);
+  auto counters = [all](uint64_t instructions, uint64_t cycles,
+                        uint64_t misses, uint64_t time) {
+    TracyRecorder::CounterValues deltas{};
+    deltas[size_t(Counter::Instructions)] = instructions;
+    deltas[size_t(Counter::Cycles)] = cycles;
+    deltas[size_t(Counter::CacheMisses)] = misses;
+    deltas[size_t(Counter::TaskClock)] = 50;
+    return TracyRecorder::Event(
+        TracyRecorder::CountersEvent<true>(all, deltas, 1, time));
+  };
+  auto recording = [&, this] {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1234567890, 1)),
+         counters(0, 0, 0, 1000),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "outer", 1, 1000)),
+         counters(100, 100, 1, 1100),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 2, "file1.cpp", "function2", "inner", 1, 1100)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1200)),
+         counters(300, 100, 5, 1300),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(1, 1300))});
+  };
+
+  // The inner zone ended after counting was turned off
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(recording(), "");
+  auto statistics = TracyPlayback::computeZoneStatistics(std::move(streams), 1);
+  ASSERT_EQ(statistics.size(), 2);
+  auto &outer = statistics[0];
+  EXPECT_EQ(outer.name, "outer");
+  EXPECT_EQ(outer.countedZones, 1);
+  EXPECT_EQ(outer.countedTime, 300);
+  EXPECT_EQ(outer.instructions, 400);
+  EXPECT_EQ(outer.cycles, 200);
+  EXPECT_EQ(outer.cacheMisses, 6);
+  EXPECT_EQ(outer.contextSwitches, 0);
+  EXPECT_EQ(outer.taskClockTime, 100);
+  EXPECT_EQ(statistics[1].countedZones, 0);
+  EXPECT_FALSE(statistics[1].instructions);
+
+  std::stringstream text;
+  TracyPlayback::writeZoneStatisticsText(text, statistics);
+  std::string line;
+  std::getline(text, line);
+  std::getline(text, line);
+  EXPECT_NE(line.find(" 2.00 "), std::string::npos);
+  EXPECT_NE(line.find(" 33% "), std::string::npos);
+
+  std::vector<std::unique_ptr<std::istream>> playback;
+  playback.push_back(recording());
+  playStreams(std::move(playback));
+}
+
+TEST_F(PlaybackTest, exportChromeJson) {
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(
+      genIStream(
+          {TracyRecorder::Event(
+               TracyRecorder::StartEvent<true>("host", 1'000'000, 42)),
+           TracyRecorder::Event(TracyRecorder::ThreadNameEvent<true>(
+               "main \"thread\"", 7, 0)),
+           TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+               0, 1, "file1.cpp", "function1", "early", 7, 100)),
+           TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 200)),
+           TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+               0, 2, "file1.cpp", "function2", "", 7, 1500)),
+           TracyRecorder::Event(
+               TracyRecorder::MessageEvent<true>("hello", 0, 7, 1600)),
+           TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 9000))}),
+      "");
+
+  TracyPlayback::ExportOptions options;
+  options.beginTime = 1'001'000;
+  options.endTime = 1'005'000;
+  std::stringstream out;
+  TracyPlayback::exportTrace(std::move(streams), out, options);
+
+  // The zone before the window is dropped, the one crossing its end is cut
+  EXPECT_EQ(out.str(),
+            "{\"traceEvents\":[\n"
+            R"({"name":"process_name","ph":"M","pid":1,)"
+            R"("args":{"name":"host PID 42"}},)"
+            "\n"
+            R"({"name":"thread_name","ph":"M","pid":1,"tid":7,)"
+            R"("args":{"name":"main \"thread\""}},)"
+            "\n"
+            R"({"name":"function2","cat":"zone","ph":"B","ts":1.500,)"
+            R"("pid":1,"tid":7,"args":{"function":"function2",)"
+            R"("file":"file1.cpp","line":2}},)"
+            "\n"
+            R"({"name":"hello","ph":"i","s":"t","ts":1.600,"pid":1,)"
+            R"("tid":7},)"
+            "\n"
+            R"({"ph":"E","ts":5.000,"pid":1,"tid":7})"
+            "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+TEST_F(PlaybackTest, symbolizeStacks) {
+  auto modules = TracyRecorder::loadedModules();
+  ASSERT_FALSE(modules.empty());
+  auto &executable = modules.front();
+  std::vector<uint64_t> frames{
+      reinterpret_cast<uint64_t>(&stackTestCaller) + 1, 0x10};
+  auto recording = [&, this] {
+    return genIStream(
+        {TracyRecorder::Event(
+             TracyRecorder::StartEvent<true>("host", 1'000'000, 42)),
+         TracyRecorder::Event(TracyRecorder::ModuleEvent<true>(
+             executable.path, executable.base, executable.start,
+             executable.size, 7, 0)),
+         TracyRecorder::Event(
+             TracyRecorder::StackFramesEvent<true>(5, frames, 7, 0)),
+         TracyRecorder::Event(TracyRecorder::StackEvent<true>(5, 7, 1000)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "zone", 7, 1000)),
+         TracyRecorder::Event(TracyRecorder::StackEvent<true>(5, 7, 1500)),
+         TracyRecorder::Event(
+             TracyRecorder::MessageEvent<true>("hello", 0, 7, 1500)),
+         TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+             0, 1, "file1.cpp", "function1", "plain", 7, 1600)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 1700)),
+         TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 2000))});
+  };
+
+  std::vector<TracyPlayback::StreamInfo> streams;
+  streams.emplace_back(recording(), "");
+  std::stringstream out;
+  TracyPlayback::exportTrace(std::move(streams), out, {});
+  std::string stack =
+      "\"stack\":[\"stackTestCaller() (playback_tests)\",\"0x10\"]";
+  auto json = out.str();
+  // On the zone and the message, not on the zone without one
+  auto first = json.find(stack);
+  ASSERT_NE(first, std::string::npos);
+  auto second = json.find(stack, first + 1);
+  ASSERT_NE(second, std::string::npos);
+  EXPECT_EQ(json.find(stack, second + 1), std::string::npos);
+  EXPECT_LT(json.find(R"("name":"zone")"), first);
+  EXPECT_LT(json.find(R"("name":"hello")"), second);
+
+  std::vector<std::unique_ptr<std::istream>> playback;
+  playback.push_back(recording());
+  playStreams(std::move(playback));
+}
+
+TEST_F(PlaybackTest, exportPerfetto) {
+  std::vector<TracyPlayback::StreamInfo> streams;
+  for (uint64_t pid : {1, 2}) {
+    streams.emplace_back(
+        genIStream(
+            {TracyRecorder::Event(
+                 TracyRecorder::StartEvent<true>("host", 1'000'000, pid)),
+             TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+                 0, 1, "file1.cpp", "function1", "name1", 7, 100)),
+             TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(7, 200))}),
+        "");
+  }
+
+  TracyPlayback::ExportOptions options;
+  options.format = TracyPlayback::ExportFormat::Perfetto;
+  // Every chunk is a single packet, the queue holds at most one at a time
+  options.chunkBytes = 1;
+  options.maxQueuedBytes = 1;
+  std::stringstream out;
+  TracyPlayback::exportTrace(std::move(streams), out, options);
+
+  // Process and thread descriptors, then begin and end, per recording
+  auto data = out.str();
+  size_t packets = 0;
+  for (size_t offset = 0; offset < data.size(); ++packets) {
+    ASSERT_EQ(data[offset++], 0x0A); // Trace.packet, length delimited
+    uint64_t size = 0;
+    for (int shift = 0;; shift += 7) {
+      auto byte = uint8_t(data[offset++]);
+      size |= uint64_t(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+        break;
+      }
+    }
+    offset += size;
+    ASSERT_LE(offset, data.size());
+  }
+  EXPECT_EQ(packets, 8);
+  EXPECT_NE(data.find("host PID 1"), std::string::npos);
+  EXPECT_NE(data.find("host PID 2"), std::string::npos);
+}
+
+TEST_F(PlaybackTest, validateRotatedSegments) {
+  std::vector<std::vector<TracyRecorder::Event<true>>> events = {
+      {TracyRecorder::Event(
+           TracyRecorder::StartEvent<true>("host", 1234567890, 42)),
+       TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 200))},
+      {TracyRecorder::Event(
+           TracyRecorder::StartEvent<true>("host", 1234567890, 42)),
+       TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+           0, 1, "file1.cpp", "function1", "name1", 0, 100))},
+  };
+
+  std::vector<std::unique_ptr<std::istream>> streams;
+  for (auto &event : events) {
+    streams.push_back(genIStream(event));
+  }
+  playStreams(std::move(streams));
+}
+
+TEST_F(PlaybackTest, reduceCapture) {
+  auto zone = [](uint32_t line, char const *name, uint64_t start,
+                 uint64_t end) {
+    return std::vector{
+        TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+            0, line, "file1.cpp", "function1", name, 0, start)),
+        TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, end))};
+  };
+  std::vector<TracyRecorder::Event<true>> events = {
+      TracyRecorder::Event(
+          TracyRecorder::StartEvent<true>("host", 1'000'000, 1)),
+      TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+          0, 1, "file1.cpp", "function1", "outer", 0, 1000))};
+  for (uint64_t start = 1100; start < 1150; start += 10) {
+    std::ranges::copy(zone(2, "tick", start, start + 5),
+                      std::back_inserter(events));
+  }
+  std::ranges::copy(zone(3, "other", 1200, 1210), std::back_inserter(events));
+  events.push_back(TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+      0, 4, "file1.cpp", "function1", "deep", 0, 2000)));
+  std::ranges::copy(zone(5, "deeper", 2100, 4000), std::back_inserter(events));
+  events.push_back(
+      TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 5000)));
+  events.push_back(
+      TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, 9000)));
+
+  TracyPlayback::ReduceOptions options;
+  options.minDuration = 100;
+  options.maxDepth = 2;
+  std::stringstream out;
+  auto result = TracyPlayback::reduceTrace(*genIStream(events), out, options);
+  EXPECT_EQ(result.eventsRead, events.size());
+  EXPECT_EQ(result.zonesDropped, 2);
+  EXPECT_EQ(result.zonesSummarized, 5);
+  EXPECT_EQ(result.summaries, 1);
+
+  // The ticks become one zone counting them, the lone short zone and the
+  // zone beyond the depth limit are gone
+  auto startZone = [](uint32_t line, std::string name, uint64_t time) {
+    return TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+        0, line, "file1.cpp", "function1", name, 0, time));
+  };
+  auto endZone = [](uint64_t time) {
+    return TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(0, time));
+  };
+  std::vector<TracyRecorder::Event<false>> expected = {
+      TracyRecorder::Event(
+          TracyRecorder::StartEvent<false>("host", 1'000'000, 1)),
+      startZone(1, "outer", 1000),
+      startZone(2, "tick", 1100),
+      TracyRecorder::Event(TracyRecorder::ZoneValueEvent<false>(5, 0, 1100)),
+      endZone(1145),
+      startZone(4, "deep", 2000),
+      endZone(5000),
+      endZone(9000)};
+
+  std::string header(12, '\0');
+  out.read(header.data(), header.size());
+  EXPECT_EQ(header, std::string("TRCYPLAY\1\0\0\0", 12));
+  std::vector<TracyRecorder::Event<false>> reduced;
+  TracyRecorder::EventReader reader(out);
+  while (auto event = reader.next()) {
+    reduced.push_back(std::move(*event));
+  }
+  EXPECT_EQ(reduced, expected);
+  EXPECT_EQ(result.eventsWritten, expected.size());
+}
+
+TEST_F(PlaybackTest, reduceCaptureWindow) {
+  auto startZone = [](std::string name, uint64_t time) {
+    return TracyRecorder::Event(TracyRecorder::StartZoneEvent<true>(
+        0, 1, "file1.cpp", "function1", name, 0, time));
+  };
+  auto endZone = [](uint64_t time) {
+    return TracyRecorder::Event(TracyRecorder::EndZoneEvent<true>(0, time));
+  };
+  std::vector<TracyRecorder::Event<true>> events = {
+      TracyRecorder::Event(
+          TracyRecorder::StartEvent<true>("host", 1'000'000, 1)),
+      startZone("early", 100),
+      endZone(500),
+      startZone("outer", 1000),
+      startZone("before", 1100),
+      endZone(1200),
+      startZone("inner", 4000),
+      endZone(4500),
+      startZone("late", 7000),
+      endZone(7500),
+      endZone(9000),
+      startZone("after", 9500),
+      endZone(9600)};
+
+  TracyPlayback::ReduceOptions options;
+  options.beginTime = 1'003'000;
+  options.endTime = 1'006'000;
+  std::stringstream out;
+  auto result = TracyPlayback::reduceTrace(*genIStream(events), out, options);
+  // Reading stops once the last zone overlapping the window ended
+  EXPECT_EQ(result.eventsRead, events.size() - 2);
+  EXPECT_EQ(result.zonesDropped, 3);
+
+  // The zone open when the window begins is kept along with what it holds
+  // inside the window
+  std::vector<TracyRecorder::Event<false>> expected = {
+      TracyRecorder::Event(
+          TracyRecorder::StartEvent<false>("host", 1'000'000, 1)),
+      TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+          0, 1, "file1.cpp", "function1", "outer", 0, 1000)),
+      TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+          0, 1, "file1.cpp", "function1", "inner", 0, 4000)),
+      TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(0, 4500)),
+      TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(0, 9000))};
+
+  out.ignore(12);
+  std::vector<TracyRecorder::Event<false>> reduced;
+  TracyRecorder::EventReader reader(out);
+  while (auto event = reader.next()) {
+    reduced.push_back(std::move(*event));
+  }
+  EXPECT_EQ(reduced, expected);
+}
@@ -1,9 +1,27 @@
 #include "gtest/gtest.h"
 
+#include "blockFormat.h"
+#include "eventReader.h"
+#include "fileSink.h"
+#include "perfCounters.h"
 #include "rawEntries.h"
 #include "recorder.h"
+#include "socketAddress.h"
+#include "socketSink.h"
 #include "utilities.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <semaphore>
+#include <set>
+#include <thread>
+#include <sched.h>
+#include <sys/socket.h>
+
 using namespace std;
 
 namespace {
@@ -43,6 +61,9 @@ protected:
       count++;
       output.push_back(std::move(p2));
     });
+    // Keep the ThreadStartEvent of a fresh test thread out of the checks
+    TracyRecorder::flush();
+    output.resize(1);
   };
 
   virtual void TearDown() {};
@@ -64,16 +85,14 @@ protected:
                     output.back().size()),
         std::ios::in | std::ios::out | std::ios::binary);
 
+    TracyRecorder::EventReader reader(strstream);
     auto it = events.begin();
-    while (strstream) {
-      auto event = TracyRecorder::Event<false>::deserialize(strstream);
-      if (event.has_value()) {
-        if (it == events.end()) {
-          FAIL() << "Too many events";
-        }
-        ASSERT_TRUE(compareIgnoreTime(*it, *event));
-        ++it;
+    while (auto event = reader.next()) {
+      if (it == events.end()) {
+        FAIL() << "Too many events";
       }
+      ASSERT_TRUE(compareIgnoreTime(*it, *event));
+      ++it;
     }
   }
 
@@ -84,11 +103,9 @@ protected:
         std::ios::in | std::ios::out | std::ios::binary);
 
     std::vector<TracyRecorder::Event<false>> events;
-    while (strstream) {
-      auto event = TracyRecorder::Event<false>::deserialize(strstream);
-      if (event.has_value()) {
-        events.push_back(std::move(*event));
-      }
+    TracyRecorder::EventReader reader(strstream);
+    while (auto event = reader.next()) {
+      events.push_back(std::move(*event));
     }
     return events;
   }
@@ -123,7 +140,7 @@ TEST_F(RecorderTest, testZoneStartEvent) {
 
   testEvent({TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
       0, 1, "file1.cpp", "function1", "name1",
-      std::bit_cast<uint64_t>(std::this_thread::get_id()), 0))});
+      TracyRecorder::threadId(), 0))});
 }
 
 TEST_F(RecorderTest, testZoneEndEvent) {
@@ -131,7 +148,7 @@ TEST_F(RecorderTest, testZoneEndEvent) {
   TracyRecorder::flush();
 
   testEvent({TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(
-      std::bit_cast<uint64_t>(std::this_thread::get_id()), 0))});
+      TracyRecorder::threadId(), 0))});
 }
 
 TEST_F(RecorderTest, testMessageEvent) {
@@ -139,7 +156,7 @@ TEST_F(RecorderTest, testMessageEvent) {
   TracyRecorder::flush();
 
   testEvent({TracyRecorder::Event(TracyRecorder::MessageEvent<false>(
-      "message1", 1234, std::bit_cast<uint64_t>(std::this_thread::get_id()),
+      "message1", 1234, TracyRecorder::threadId(),
       0))});
 }
 
@@ -148,7 +165,34 @@ TEST_F(RecorderTest, testThreadNameEvent) {
   TracyRecorder::flush();
 
   testEvent({TracyRecorder::Event(TracyRecorder::ThreadNameEvent<false>(
-      "thread1", std::bit_cast<uint64_t>(std::this_thread::get_id()), 0))});
+      "thread1", TracyRecorder::threadId(), 0))});
+}
+
+TEST_F(RecorderTest, testDynamicText) {
+  // Released before the flush, the recorder keeps copies
+  for (int i = 0; i < 2; ++i) {
+    {
+      auto name = std::format("thread{}", i);
+      TracyRecorder::nameThread(name);
+      auto text = std::format("message{}", i);
+      TracyRecorder::message(text, 1234);
+      text.assign(text.size(), 'x');
+    }
+    TracyRecorder::messageLiteral("literal", 0);
+    // Longer than an arena block
+    TracyRecorder::message(std::string(100000, char('a' + i)), 0);
+    TracyRecorder::flush();
+
+    auto threadId = TracyRecorder::threadId();
+    testEvent({TracyRecorder::Event(TracyRecorder::ThreadNameEvent<false>(
+                   std::format("thread{}", i), threadId, 0)),
+               TracyRecorder::Event(TracyRecorder::MessageEvent<false>(
+                   std::format("message{}", i), 1234, threadId, 0)),
+               TracyRecorder::Event(TracyRecorder::MessageEvent<false>(
+                   "literal", 0, threadId, 0)),
+               TracyRecorder::Event(TracyRecorder::MessageEvent<false>(
+                   std::string(100000, char('a' + i)), 0, threadId, 0))});
+  }
 }
 
 TEST_F(RecorderTest, testMultipleEvents) {
@@ -160,13 +204,799 @@ TEST_F(RecorderTest, testMultipleEvents) {
 
   testEvent({TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
                  0, 1, "file1.cpp", "function1", "name1",
-                 std::bit_cast<uint64_t>(std::this_thread::get_id()), 0)),
+                 TracyRecorder::threadId(), 0)),
              TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(
-                 std::bit_cast<uint64_t>(std::this_thread::get_id()), 0)),
+                 TracyRecorder::threadId(), 0)),
              TracyRecorder::Event(TracyRecorder::MessageEvent<false>(
                  "message1", 1234,
-                 std::bit_cast<uint64_t>(std::this_thread::get_id()), 0)),
+                 TracyRecorder::threadId(), 0)),
              TracyRecorder::Event(TracyRecorder::ThreadNameEvent<false>(
-                 "thread1", std::bit_cast<uint64_t>(std::this_thread::get_id()),
+                 "thread1", TracyRecorder::threadId(),
                  0))});
-}
\ No newline at end of file
+}
+
+TEST_F(RecorderTest, testFrameMarkEvents) {
+  TracyRecorder::frameMark("batch");
+  TracyRecorder::frameMarkStart("load");
+  TracyRecorder::frameMarkEnd("load");
+  TracyRecorder::flush();
+
+  testEvent({TracyRecorder::Event(TracyRecorder::FrameMarkEvent<false>(
+                 "batch", TracyRecorder::FrameMarkKind::Continuous,
+                 TracyRecorder::threadId(), 0)),
+             TracyRecorder::Event(TracyRecorder::FrameMarkEvent<false>(
+                 "load", TracyRecorder::FrameMarkKind::Start,
+                 TracyRecorder::threadId(), 0)),
+             TracyRecorder::Event(TracyRecorder::FrameMarkEvent<false>(
+                 "load", TracyRecorder::FrameMarkKind::End,
+                 TracyRecorder::threadId(), 0))});
+}
+
+TEST_F(RecorderTest, testZoneAnnotationEvents) {
+  auto threadId = TracyRecorder::threadId();
+  TracyRecorder::zoneText("dropped outside of a zone");
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::zoneText("request 42");
+  TracyRecorder::zoneValue(std::numeric_limits<uint64_t>::max());
+  TracyRecorder::zoneValue(7);
+  TracyRecorder::zoneColor(0xFF0000);
+  TracyRecorder::zoneEnd();
+  TracyRecorder::zoneValue(8);
+  TracyRecorder::flush();
+
+  testEvent({TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+                 0, 1, "file1.cpp", "function1", "name1", threadId, 0)),
+             TracyRecorder::Event(TracyRecorder::ZoneTextEvent<false>(
+                 "request 42", threadId, 0)),
+             TracyRecorder::Event(TracyRecorder::ZoneValueEvent<false>(
+                 std::numeric_limits<uint64_t>::max(), threadId, 0)),
+             TracyRecorder::Event(
+                 TracyRecorder::ZoneValueEvent<false>(7, threadId, 0)),
+             TracyRecorder::Event(
+                 TracyRecorder::ZoneColorEvent<false>(0xFF0000, threadId, 0)),
+             TracyRecorder::Event(
+                 TracyRecorder::EndZoneEvent<false>(threadId, 0))});
+}
+
+TEST_F(RecorderTest, testZoneValueIsCompact) {
+  std::vector<std::byte> small;
+  TracyRecorder::Event(TracyRecorder::ZoneValueEvent<true>(1, 0, 0))
+      .serialize(small);
+  std::vector<std::byte> large;
+  TracyRecorder::Event(TracyRecorder::ZoneValueEvent<true>(
+                           std::numeric_limits<uint64_t>::max(), 0, 0))
+      .serialize(large);
+
+  EXPECT_EQ(large.size() - small.size(), 9);
+}
+
+TEST_F(RecorderTest, testThreadLifecycleEvents) {
+  auto first = output.size();
+  uint64_t threadIds[2];
+  for (auto &threadId : threadIds) {
+    std::thread([&threadId] {
+      threadId = TracyRecorder::threadId();
+      TracyRecorder::message("from thread", 0);
+    }).join();
+  }
+
+  // Sequential threads may share the OS thread ID, never the recorded one
+  EXPECT_NE(threadIds[0], threadIds[1]);
+  EXPECT_NE(threadIds[0], TracyRecorder::threadId());
+
+  std::vector<TracyRecorder::Event<false>> events;
+  for (size_t i = first; i < output.size(); ++i) {
+    std::stringstream strstream(
+        std::string(reinterpret_cast<const char *>(output[i].data()),
+                    output[i].size()),
+        std::ios::in | std::ios::binary);
+    TracyRecorder::EventReader reader(strstream);
+    while (auto event = reader.next()) {
+      events.push_back(std::move(*event));
+    }
+  }
+  std::vector<TracyRecorder::Event<false>> expected;
+  for (auto threadId : threadIds) {
+    expected.emplace_back(TracyRecorder::ThreadStartEvent<false>(threadId, 0));
+    expected.emplace_back(
+        TracyRecorder::MessageEvent<false>("from thread", 0, threadId, 0));
+    expected.emplace_back(TracyRecorder::ThreadExitEvent<false>(threadId, 0));
+  }
+  ASSERT_EQ(events.size(), expected.size());
+  for (size_t i = 0; i < events.size(); ++i) {
+    ASSERT_TRUE(compareIgnoreTime(events[i], expected[i]));
+  }
+}
+
+TEST_F(RecorderTest, testFlushShards) {
+  TracyRecorder::setFlushShards(4);
+  SetUp();
+
+  constexpr int threads = 8;
+  constexpr int messages = 100;
+  // Recorded strings are referenced until they are flushed
+  std::vector<std::string> texts;
+  for (int i = 0; i < messages; ++i) {
+    texts.push_back(std::to_string(i));
+  }
+  // Started across the allowed CPUs, so they spread over the shards even
+  // where each CPU has a single one
+  cpu_set_t affinity;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(affinity), &affinity), 0);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &affinity)) {
+      cpus.push_back(cpu);
+    }
+  }
+  std::mutex mutexShards;
+  std::set<unsigned> shards;
+  {
+    std::vector<std::jthread> workers;
+    for (int thread = 0; thread < threads; ++thread) {
+      workers.emplace_back([&, cpu = cpus[thread * cpus.size() / threads]] {
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        sched_setaffinity(0, sizeof(pinned), &pinned);
+        for (auto &text : texts) {
+          TracyRecorder::message(text, 0);
+        }
+        TracyRecorder::flush();
+        std::scoped_lock lock(mutexShards);
+        shards.insert(TracyRecorder::threadMetrics().shard);
+      });
+    }
+  }
+  EXPECT_GT(shards.size(), 1);
+
+  // Shards interleave their batches, each thread's events must stay in order
+  std::map<uint64_t, std::vector<std::string>> threadMessages;
+  for (size_t i = 1; i < output.size(); ++i) {
+    std::stringstream strstream(
+        std::string(reinterpret_cast<const char *>(output[i].data()),
+                    output[i].size()),
+        std::ios::in | std::ios::binary);
+    TracyRecorder::EventReader reader(strstream);
+    while (auto event = reader.next()) {
+      if (auto message =
+              std::get_if<TracyRecorder::MessageEvent<false>>(&event->event)) {
+        threadMessages[message->threadId].push_back(message->message);
+      }
+    }
+  }
+  ASSERT_EQ(threadMessages.size(), threads);
+  for (auto &[threadId, received] : threadMessages) {
+    ASSERT_EQ(received.size(), messages);
+    for (int i = 0; i < messages; ++i) {
+      ASSERT_EQ(received[i], texts[i]);
+    }
+  }
+
+  TracyRecorder::setFlushShards(0);
+}
+
+TEST_F(RecorderTest, testClockSyncEvent) {
+  TracyRecorder::setClockSyncInterval(std::chrono::milliseconds(0));
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::zoneEnd();
+  TracyRecorder::flush();
+  TracyRecorder::setClockSyncInterval(std::chrono::seconds(1));
+
+  auto events = getLastEvents();
+  ASSERT_EQ(events.size(), 3);
+  auto &sync = std::get<TracyRecorder::ClockSyncEvent<false>>(events[0].event);
+  auto &zone = std::get<TracyRecorder::StartZoneEvent<false>>(events[1].event);
+  EXPECT_GT(sync.time, zone.time);
+  auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::system_clock::now().time_since_epoch())
+                 .count();
+  EXPECT_LE(sync.unixTime, uint64_t(now));
+  EXPECT_GT(sync.unixTime, uint64_t(now) - 1'000'000'000);
+}
+
+TEST_F(RecorderTest, testRecorderMetrics) {
+  auto before = TracyRecorder::metrics();
+  TracyRecorder::zoneText("outside of a zone");
+  TracyRecorder::message("first", 0);
+  TracyRecorder::message("second", 0);
+  auto thread = TracyRecorder::threadMetrics();
+  EXPECT_EQ(thread.threadId, TracyRecorder::threadId());
+  EXPECT_EQ(thread.bufferedEvents, 2);
+  // The events themselves and the copies of "first" and "second"
+  EXPECT_EQ(thread.bufferedBytes, 2 * sizeof(TracyRecorder::Event<true>) + 11);
+  EXPECT_GE(TracyRecorder::metrics().bufferedEvents, 2);
+
+  TracyRecorder::setMetricsInterval(std::chrono::milliseconds(1));
+  TracyRecorder::flush();
+  TracyRecorder::setMetricsInterval(std::chrono::milliseconds(0));
+
+  auto after = TracyRecorder::metrics();
+  EXPECT_EQ(TracyRecorder::threadMetrics().bufferedEvents, 0);
+  EXPECT_EQ(TracyRecorder::threadMetrics().bufferedBytes, 0);
+  EXPECT_EQ(after.flushedEvents - before.flushedEvents, 2);
+  EXPECT_EQ(after.flushBatches - before.flushBatches, 1);
+  EXPECT_EQ(after.flushedBytes - before.flushedBytes, output.back().size());
+  EXPECT_GE(after.largestBatchBytes, output.back().size());
+  EXPECT_EQ(after.droppedEvents - before.droppedEvents, 1);
+  EXPECT_EQ(after.queuedEvents, 0);
+  uint64_t outputs = 0;
+  for (size_t i = 0; i < after.outputLatency.size(); ++i) {
+    outputs += after.outputLatency[i] - before.outputLatency[i];
+  }
+  EXPECT_EQ(outputs, 1);
+
+  // The self-report goes at the end of the batch it was sampled for
+  auto events = getLastEvents();
+  ASSERT_FALSE(events.empty());
+  auto &report =
+      std::get<TracyRecorder::RecorderMetricsEvent<false>>(events.back().event);
+  EXPECT_EQ(report.queuedEvents, 2);
+  EXPECT_EQ(report.flushedEvents, before.flushedEvents);
+  EXPECT_EQ(report.droppedEvents, after.droppedEvents);
+  EXPECT_EQ(report.largestBatchBytes, before.largestBatchBytes);
+  EXPECT_EQ(report.outputLatency, before.outputLatency);
+  EXPECT_EQ(report.mappedFallbacks, after.mappedFallbacks);
+
+  // Threads are reported while they run
+  auto reported = [](uint64_t threadId) {
+    return std::ranges::any_of(
+        TracyRecorder::metrics().threads,
+        [threadId](auto const &thread) { return thread.threadId == threadId; });
+  };
+  std::binary_semaphore recorded{0};
+  std::binary_semaphore checked{0};
+  uint64_t threadId = 0;
+  std::jthread worker([&] {
+    TracyRecorder::message("worker", 0);
+    threadId = TracyRecorder::threadId();
+    recorded.release();
+    checked.acquire();
+  });
+  recorded.acquire();
+  EXPECT_TRUE(reported(threadId));
+  checked.release();
+  worker.join();
+  EXPECT_FALSE(reported(threadId));
+}
+
+TEST_F(RecorderTest, testCategories) {
+  static TracyRecorder::Category network("test.network");
+  static TracyRecorder::Category storage("test.storage", false);
+  EXPECT_TRUE(network.enabled());
+  EXPECT_FALSE(storage.enabled());
+
+  bool started = TracyRecorder::zoneStart(storage, 1, "file1.cpp",
+                                          "function1", "name1", 0);
+  EXPECT_FALSE(started);
+  TracyRecorder::zoneEnd(started);
+
+  TracyRecorder::setCategories("-test.*, test.storage");
+  EXPECT_FALSE(network.enabled());
+  EXPECT_TRUE(storage.enabled());
+  TracyRecorder::message(network, "message1", 0);
+  TracyRecorder::message(storage, "message2", 0);
+  TracyRecorder::setCategoryEnabled("test.*", true);
+  EXPECT_TRUE(network.enabled());
+
+  auto categories = TracyRecorder::categories();
+  EXPECT_NE(std::find(categories.begin(), categories.end(),
+                      std::pair<std::string, bool>("test.storage", true)),
+            categories.end());
+
+  TracyRecorder::flush();
+  // The switches lead the batch, in order, and come from the flush worker
+  std::vector<std::pair<std::string, bool>> switches;
+  std::vector<std::string> messages;
+  for (auto &event : getLastEvents()) {
+    if (auto e = std::get_if<TracyRecorder::CategoryEvent<false>>(
+            &event.event)) {
+      EXPECT_TRUE(messages.empty());
+      EXPECT_EQ(e->threadId, 0);
+      switches.emplace_back(e->name, e->enabled);
+    } else if (auto e = std::get_if<TracyRecorder::MessageEvent<false>>(
+                   &event.event)) {
+      messages.push_back(e->message);
+    }
+  }
+  EXPECT_EQ(switches, (std::vector<std::pair<std::string, bool>>{
+                          {"test.network", true},
+                          {"test.storage", false},
+                          {"test.network", false},
+                          {"test.storage", true},
+                          {"test.network", true}}));
+  EXPECT_EQ(messages, std::vector<std::string>{"message2"});
+
+  // A new stream starts with the state of every category
+  SetUp();
+  TracyRecorder::message("message3", 0);
+  TracyRecorder::flush();
+  switches.clear();
+  for (auto &event : getLastEvents()) {
+    if (auto e = std::get_if<TracyRecorder::CategoryEvent<false>>(
+            &event.event)) {
+      switches.emplace_back(e->name, e->enabled);
+    }
+  }
+  EXPECT_EQ(switches, (std::vector<std::pair<std::string, bool>>{
+                          {"test.network", true}, {"test.storage", true}}));
+}
+
+TEST_F(RecorderTest, testFiberEvents) {
+  auto threadId = TracyRecorder::threadId();
+  TracyRecorder::fiberEnter(7, "task");
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::fiberLeave();
+  TracyRecorder::flush();
+  // Left with a zone open, the fiber is handed over
+  auto events = getLastEvents();
+  ASSERT_EQ(events.size(), 3);
+  auto leave = std::get<TracyRecorder::FiberLeaveEvent<false>>(events[2].event);
+  EXPECT_NE(leave.handover, 0);
+  testEvent({TracyRecorder::Event(TracyRecorder::FiberEnterEvent<false>(
+                 7, "task", 0, 0, threadId, 0)),
+             TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+                 0, 1, "file1.cpp", "function1", "name1", threadId, 0)),
+             TracyRecorder::Event(TracyRecorder::FiberLeaveEvent<false>(
+                 leave.handover, threadId, 0))});
+
+  // The fiber's open zone moves along with it to another thread
+  uint64_t otherThreadId = 0;
+  std::jthread([&otherThreadId] {
+    otherThreadId = TracyRecorder::threadId();
+    TracyRecorder::fiberEnter(7, "task");
+    TracyRecorder::zoneValue(42);
+    TracyRecorder::zoneEnd();
+    TracyRecorder::fiberLeave();
+  }).join();
+  // Outside of the fiber, this thread has no zone open
+  TracyRecorder::zoneValue(1);
+  TracyRecorder::flush();
+
+  std::vector<uint64_t> values;
+  std::vector<uint64_t> continues;
+  for (size_t i = 1; i < output.size(); ++i) {
+    std::stringstream strstream(
+        std::string(reinterpret_cast<const char *>(output[i].data()),
+                    output[i].size()),
+        std::ios::in | std::ios::binary);
+    TracyRecorder::EventReader reader(strstream);
+    while (auto event = reader.next()) {
+      using ZoneValue = TracyRecorder::ZoneValueEvent<false>;
+      if (auto value = std::get_if<ZoneValue>(&event->event)) {
+        EXPECT_EQ(value->threadId, otherThreadId);
+        values.push_back(value->value);
+      }
+      using FiberEnter = TracyRecorder::FiberEnterEvent<false>;
+      auto enter = std::get_if<FiberEnter>(&event->event);
+      if (enter && enter->threadId == otherThreadId) {
+        continues.push_back(enter->continues);
+      }
+    }
+  }
+  EXPECT_EQ(values, std::vector<uint64_t>{42});
+  EXPECT_EQ(continues, std::vector<uint64_t>{leave.handover});
+}
+
+TEST_F(RecorderTest, testCpuTracking) {
+  // Pinned, so the thread cannot migrate between the zones
+  cpu_set_t affinity;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(affinity), &affinity), 0);
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &affinity))
+    ++cpu;
+  cpu_set_t pinned;
+  CPU_ZERO(&pinned);
+  CPU_SET(cpu, &pinned);
+  ASSERT_EQ(sched_setaffinity(0, sizeof(pinned), &pinned), 0);
+
+  auto threadId = TracyRecorder::threadId();
+  TracyRecorder::setCpuTracking(true);
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::zoneEnd();
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::setCpuTracking(false);
+  TracyRecorder::zoneEnd();
+  // Turned back on, the CPU is recorded again
+  TracyRecorder::setCpuTracking(true);
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  TracyRecorder::setCpuTracking(false);
+  TracyRecorder::zoneEnd();
+  TracyRecorder::flush();
+  sched_setaffinity(0, sizeof(affinity), &affinity);
+
+  auto cpuEvent =
+      TracyRecorder::Event(TracyRecorder::CpuEvent<false>(cpu, threadId, 0));
+  auto start = TracyRecorder::Event(TracyRecorder::StartZoneEvent<false>(
+      0, 1, "file1.cpp", "function1", "name1", threadId, 0));
+  auto end =
+      TracyRecorder::Event(TracyRecorder::EndZoneEvent<false>(threadId, 0));
+  testEvent({cpuEvent, start, end, start, end, cpuEvent, start, end});
+}
+
+TEST_F(RecorderTest, testPerfCounters) {
+  // Whatever perf_event_paranoid and the sandbox allow here
+  auto available = TracyRecorder::PerfCounters().available();
+  TracyRecorder::setPerfCounters(true);
+  TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+  volatile uint64_t sum = 0;
+  for (int i = 0; i < 100000; ++i) {
+    sum = sum + i;
+  }
+  TracyRecorder::zoneEnd();
+  TracyRecorder::setPerfCounters(false);
+  TracyRecorder::flush();
+
+  std::vector<TracyRecorder::CountersEvent<false>> counters;
+  std::vector<uint64_t> zoneTimes;
+  std::vector<TracyRecorder::EventType> types;
+  for (auto &event : getLastEvents()) {
+    std::visit(overloads{[&](TracyRecorder::CountersEvent<false> &e) {
+                           counters.push_back(e);
+                           types.push_back(e.type());
+                         },
+                         [&](TracyRecorder::StartZoneEvent<false> &e) {
+                           zoneTimes.push_back(e.time);
+                           types.push_back(e.type());
+                         },
+                         [&](TracyRecorder::EndZoneEvent<false> &e) {
+                           zoneTimes.push_back(e.time);
+                           types.push_back(e.type());
+                         },
+                         [&](auto &e) { types.push_back(e.type()); }},
+               event.event);
+  }
+
+  using Type = TracyRecorder::EventType;
+  if (available == 0) {
+    EXPECT_EQ(types, (std::vector{Type::StartZone, Type::EndZone}));
+    return;
+  }
+  // Read at the zone's own timestamps, so playback can tell them apart
+  ASSERT_EQ(types, (std::vector{Type::Counters, Type::StartZone,
+                                Type::Counters, Type::EndZone}));
+  EXPECT_EQ(counters[0].time, zoneTimes[0]);
+  EXPECT_EQ(counters[1].time, zoneTimes[1]);
+  EXPECT_EQ(counters[1].available, available);
+  auto taskClock = TracyRecorder::Counter::TaskClock;
+  if (available & TracyRecorder::counterBit(taskClock)) {
+    EXPECT_GT(counters[1].deltas[size_t(taskClock)], 0);
+  }
+}
+
+TEST_F(RecorderTest, testPerfCountersToggle) {
+  auto available = TracyRecorder::PerfCounters().available();
+  auto busyZone = [] {
+    TracyRecorder::zoneStart(1, "file1.cpp", "function1", "name1", 0);
+    volatile uint64_t sum = 0;
+    for (int i = 0; i < 100000; ++i) {
+      sum = sum + i;
+    }
+    TracyRecorder::zoneEnd();
+  };
+  TracyRecorder::setPerfCounters(true);
+  busyZone();
+  TracyRecorder::setPerfCounters(false);
+  busyZone();
+  TracyRecorder::setPerfCounters(true);
+  busyZone();
+  TracyRecorder::setPerfCounters(false);
+  TracyRecorder::flush();
+
+  std::vector<TracyRecorder::CountersEvent<false>> counters;
+  for (auto &event : getLastEvents()) {
+    if (auto e = std::get_if<TracyRecorder::CountersEvent<false>>(
+            &event.event)) {
+      counters.push_back(*e);
+    }
+  }
+  if (available == 0) {
+    EXPECT_TRUE(counters.empty());
+    return;
+  }
+  // The zone recorded while off isn't counted into the one after it
+  ASSERT_EQ(counters.size(), 4);
+  EXPECT_EQ(counters[2].deltas, TracyRecorder::CounterValues{});
+  auto taskClock = TracyRecorder::Counter::TaskClock;
+  if (available & TracyRecorder::counterBit(taskClock)) {
+    EXPECT_GT(counters[3].deltas[size_t(taskClock)], 0);
+  }
+}
+
+TEST_F(RecorderTest, testStackCapture) {
+  for (int i = 0; i < 2; ++i) {
+    TracyRecorder::zoneStartWithStack(1, "file1.cpp", "function1", "name1", 0);
+    TracyRecorder::zoneEnd();
+  }
+  TracyRecorder::messageWithStack("message1", 0);
+  TracyRecorder::flush();
+
+  std::vector<TracyRecorder::StackFramesEvent<false>> stacks;
+  std::vector<TracyRecorder::ModuleEvent<false>> modules;
+  std::vector<uint32_t> references;
+  std::vector<TracyRecorder::EventType> types;
+  for (auto &event : getLastEvents()) {
+    std::visit(overloads{[&](TracyRecorder::StackFramesEvent<false> &e) {
+                           stacks.push_back(e);
+                         },
+                         [&](TracyRecorder::ModuleEvent<false> &e) {
+                           modules.push_back(e);
+                         },
+                         [&](TracyRecorder::StackEvent<false> &e) {
+                           references.push_back(e.stackId);
+                           types.push_back(TracyRecorder::EventType::Stack);
+                         },
+                         [&](auto &e) { types.push_back(e.type()); }},
+               event.event);
+  }
+
+  // The loop's stack is defined once, the message's has its own callsite
+  using Type = TracyRecorder::EventType;
+  EXPECT_EQ(types, (std::vector{Type::Stack, Type::StartZone, Type::EndZone,
+                                Type::Stack, Type::StartZone, Type::EndZone,
+                                Type::Stack, Type::Message}));
+  ASSERT_EQ(stacks.size(), 2);
+  EXPECT_EQ(references, (std::vector{stacks[0].stackId, stacks[0].stackId,
+                                     stacks[1].stackId}));
+  EXPECT_NE(stacks[0].stackId, stacks[1].stackId);
+  ASSERT_FALSE(stacks[0].frames.empty());
+  EXPECT_NE(stacks[0].frames[0], stacks[1].frames[0]);
+
+  // The callsites are inside the test executable
+  auto inModule = [&modules](uint64_t address) {
+    return std::ranges::any_of(modules, [address](auto const &module) {
+      return address - module.start < module.size &&
+             module.path.ends_with("recorder_tests");
+    });
+  };
+  EXPECT_TRUE(inModule(stacks[0].frames[0]));
+  EXPECT_TRUE(inModule(stacks[1].frames[0]));
+}
+
+TEST_F(RecorderTest, testMappedBuffer) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("mappedBuffer_" + std::to_string(getpid()) + ".trcy");
+  TracyRecorder::MappedBufferOptions options;
+  options.path = path;
+  // Small enough for the messages to wrap around and fill the ring
+  options.ringBytes = 256;
+  options.maxThreads = 2;
+  TracyRecorder::setMappedBuffer(options);
+
+  // Too long for the ring, it falls back between the ring's messages and
+  // still has to reach the output in order
+  auto expected = [](int i) {
+    return i == 20 ? std::string(1000, 'x') : std::format("message {}", i);
+  };
+  auto first = output.size();
+  for (int i = 0; i < 40; ++i) {
+    TracyRecorder::message(expected(i), 0);
+  }
+  TracyRecorder::flush();
+  TracyRecorder::setMappedBuffer(std::nullopt);
+
+  std::string data;
+  for (size_t i = first; i < output.size(); ++i) {
+    data.append(reinterpret_cast<const char *>(output[i].data()),
+                output[i].size());
+  }
+  std::stringstream strstream(data, std::ios::in | std::ios::binary);
+  int count = 0;
+  TracyRecorder::EventReader reader(strstream);
+  while (auto event = reader.next()) {
+    auto message =
+        std::get_if<TracyRecorder::MessageEvent<false>>(&event->event);
+    if (!message) {
+      continue;
+    }
+    EXPECT_EQ(message->message, expected(count));
+    ++count;
+  }
+  EXPECT_EQ(count, 40);
+  EXPECT_GE(TracyRecorder::metrics().mappedFallbacks, 1u);
+  std::filesystem::remove(path);
+}
+
+TEST(SocketSinkTest, testReconnectReplaysHeader) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("socketSink_" + std::to_string(getpid()) + ".sock");
+  std::filesystem::remove(path);
+  auto address = TracyRecorder::parseSocketAddress("unix:" + path.string());
+  ASSERT_TRUE(address.has_value());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr *>(&address->address),
+                 address->length),
+            0);
+  ASSERT_EQ(listen(listener, 4), 0);
+
+  auto toBytes = [](std::string_view text) {
+    return std::vector<std::byte>(
+        reinterpret_cast<std::byte const *>(text.data()),
+        reinterpret_cast<std::byte const *>(text.data() + text.size()));
+  };
+  auto readExactly = [](int socket, size_t size) {
+    std::string data(size, '\0');
+    size_t offset = 0;
+    while (offset < size) {
+      auto received = recv(socket, data.data() + offset, size - offset, 0);
+      if (received <= 0) {
+        break;
+      }
+      offset += received;
+    }
+    return data.substr(0, offset);
+  };
+
+  TracyRecorder::SocketSinkOptions options;
+  options.address = "unix:" + path.string();
+  options.reconnectInterval = std::chrono::milliseconds(10);
+  auto sink = TracyRecorder::makeSocketSink(options);
+  sink(toBytes("header"));
+  sink(toBytes("first"));
+
+  int connection = accept(listener, nullptr, nullptr);
+  EXPECT_EQ(readExactly(connection, 11), "headerfirst");
+  close(connection);
+
+  // The write that notices the broken connection may be lost, the sink
+  // reconnects and starts over with the header
+  for (int i = 0; i < 10; ++i) {
+    sink(toBytes("again"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  connection = accept(listener, nullptr, nullptr);
+  EXPECT_EQ(readExactly(connection, 11), "headeragain");
+  close(connection);
+
+  sink = nullptr;
+  close(listener);
+  std::filesystem::remove(path);
+}
+
+TEST(FileSinkTest, testRotationRepeatsHeader) {
+  auto directory = std::filesystem::temp_directory_path() /
+                   ("fileSink_" + std::to_string(getpid()));
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  auto toBytes = [](std::string_view text) {
+    return std::vector<std::byte>(
+        reinterpret_cast<std::byte const *>(text.data()),
+        reinterpret_cast<std::byte const *>(text.data() + text.size()));
+  };
+
+  TracyRecorder::FileSinkOptions options;
+  options.path = directory / "trace.trcy";
+  options.maxSegmentBytes = 16;
+  options.preallocateBytes = 4096;
+  {
+    auto sink = TracyRecorder::makeFileSink(options);
+    sink(toBytes("header"));
+    for (auto batch : {"first", "second", "third", "fourth"}) {
+      sink(toBytes(batch));
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  auto readFile = [](std::filesystem::path const &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+  };
+  EXPECT_EQ(readFile(directory / "trace.000000.trcy"), "headerfirst");
+  EXPECT_EQ(readFile(directory / "trace.000001.trcy"), "headersecond");
+  EXPECT_EQ(readFile(directory / "trace.000002.trcy"), "headerthird");
+  EXPECT_EQ(readFile(directory / "trace.000003.trcy"), "headerfourth");
+  EXPECT_FALSE(std::filesystem::exists(directory / "trace.000004.trcy"));
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST(FileSinkTest, testFullQueueCountsDroppedEvents) {
+  TracyRecorder::FileSinkOptions options;
+  options.path = std::filesystem::temp_directory_path() /
+                 ("fileSinkDropped_" + std::to_string(getpid()) + ".trcy");
+  // Everything after the header is dropped
+  options.maxQueuedBytes = 0;
+
+  auto dropped = TracyRecorder::metrics().droppedEvents;
+  {
+    auto sink = TracyRecorder::makeFileSink(options);
+    sink(std::vector<std::byte>(12));
+    std::vector<std::byte> batch;
+    auto block = TracyRecorder::beginBlock(batch);
+    for (auto text : {"first", "second"}) {
+      TracyRecorder::Event(TracyRecorder::MessageEvent<true>(text, 0, 1, 100))
+          .serialize(batch);
+    }
+    TracyRecorder::endBlock(batch, block);
+    sink(batch);
+  }
+  EXPECT_EQ(TracyRecorder::metrics().droppedEvents - dropped, 2);
+}
+
+TEST(FileSinkTest, testFailedOpenCountsDroppedEvents) {
+  TracyRecorder::FileSinkOptions options;
+  // No such directory, no segment can be opened
+  options.path = std::filesystem::temp_directory_path() /
+                 ("fileSinkMissing_" + std::to_string(getpid())) / "t.trcy";
+
+  auto dropped = TracyRecorder::metrics().droppedEvents;
+  {
+    auto sink = TracyRecorder::makeFileSink(options);
+    sink(std::vector<std::byte>(12));
+    std::vector<std::byte> batch;
+    auto block = TracyRecorder::beginBlock(batch);
+    for (auto text : {"first", "second", "third"}) {
+      TracyRecorder::Event(TracyRecorder::MessageEvent<true>(text, 0, 1, 100))
+          .serialize(batch);
+    }
+    TracyRecorder::endBlock(batch, block);
+    sink(batch);
+  }
+  EXPECT_EQ(TracyRecorder::metrics().droppedEvents - dropped, 3);
+  EXPECT_FALSE(std::filesystem::exists(options.path.parent_path()));
+}
+
+TEST(EventReaderTest, skipDamagedBlocks) {
+  auto bytes = [](std::string_view text) {
+    return std::as_bytes(std::span(text.data(), text.size()));
+  };
+  EXPECT_EQ(TracyRecorder::crc32c(bytes("123456789")), 0xe3069283);
+  EXPECT_EQ(TracyRecorder::crc32c(bytes("56789"),
+                                  TracyRecorder::crc32c(bytes("1234"))),
+            0xe3069283);
+
+  std::vector<std::byte> data;
+  TracyRecorder::Event(TracyRecorder::StartEvent<true>("host", 1, 2))
+      .serialize(data);
+  std::vector<size_t> blocks;
+  for (int i = 0; i < 4; ++i) {
+    blocks.push_back(TracyRecorder::beginBlock(data));
+    TracyRecorder::Event(TracyRecorder::MessageEvent<true>(
+                             std::format("message {}", i), 0, 1, i))
+        .serialize(data);
+    TracyRecorder::endBlock(data, blocks.back());
+  }
+  auto stream = [&data](size_t size) {
+    return std::stringstream(
+        std::string(reinterpret_cast<char const *>(data.data()), size),
+        std::ios::in | std::ios::binary);
+  };
+  auto messages = [](TracyRecorder::EventReader &reader) {
+    std::vector<std::string> result;
+    while (auto event = reader.next()) {
+      if (auto message = std::get_if<TracyRecorder::MessageEvent<false>>(
+              &event->event)) {
+        result.push_back(message->message);
+      }
+    }
+    return result;
+  };
+
+  // A damaged block is skipped, a torn one at the end is left unread
+  data[blocks[1] + TracyRecorder::blockHeaderSize + 2] ^= std::byte{1};
+  auto torn = stream(data.size() - 3);
+  TracyRecorder::EventReader reader(torn);
+  EXPECT_EQ(messages(reader),
+            (std::vector<std::string>{"message 0", "message 2"}));
+  EXPECT_EQ(reader.damagedBlocks(), 1);
+  EXPECT_EQ(reader.skippedBytes(), blocks[2] - blocks[1]);
+  EXPECT_TRUE(reader.incomplete());
+
+  // Ranges split at arbitrary offsets decode every block exactly once
+  data[blocks[1] + TracyRecorder::blockHeaderSize + 2] ^= std::byte{1};
+  std::vector<std::string> all;
+  std::vector<size_t> splits = {0, blocks[1] + 5, blocks[2], data.size()};
+  for (size_t i = 0; i + 1 < splits.size(); ++i) {
+    auto part = stream(data.size());
+    TracyRecorder::EventReader reader(part, splits[i + 1]);
+    if (i > 0) {
+      reader.syncTo(splits[i]);
+    }
+    std::ranges::copy(messages(reader), std::back_inserter(all));
+    EXPECT_EQ(reader.skippedBytes(), 0);
+  }
+  EXPECT_EQ(all, (std::vector<std::string>{"message 0", "message 1",
+                                           "message 2", "message 3"}));
+}